@@ -7,6 +7,9 @@
 #ifndef ANALYTICFIELDS_H_
 #define ANALYTICFIELDS_H_
 
+#include <vector>
+#include <string>
+
 #include "field.h"
 
 /**
@@ -314,6 +317,42 @@ class TCustomBField: public TField{
 private:
 	std::unique_ptr<double> tvar, xvar, yvar, zvar; ///< Variables used to evaluate formulas, they need to be pointers to make sure references stored in the exprtk expression do not get invalidated when copying
 	std::array<exprtk::expression<double>, 3> Bexpr; ///< Formula interpreters, one for each field component
+
+	/// Operations of compiled formulas
+	enum opcode { CONSTANT, VAR_X, VAR_Y, VAR_Z, VAR_T, ADD, SUB, MUL, DIV, POW, NEG,
+				SIN, COS, TAN, EXP, LOG, LOG10, SQRT, ABS, ASIN, ACOS, ATAN, SINH, COSH, TANH, ATAN2, MIN, MAX };
+	/// Instruction of a compiled formula, operating on a stack of values and their spatial derivatives
+	struct instruction{
+		opcode op; ///< operation
+		double value; ///< value of CONSTANT
+	};
+	static const unsigned maxstack = 32; ///< maximum stack depth of compiled formulas
+	std::array<std::vector<instruction>, 3> Btape; ///< formulas compiled to postfix instructions, empty if a formula uses features the compiler does not support
+	struct parser;
+
+	/**
+	 * Compile formula into postfix instructions for evaluation with forward-mode automatic differentiation
+	 *
+	 * Supports numbers, the variables x, y, z, and t, the constant pi, the operators + - * / ^, and common elementary functions,
+	 * with the same precedence as exprtk.
+	 *
+	 * @param formula Formula
+	 * @param tape Returns instructions, empty if formula contains anything else
+	 */
+	static void Compile(const std::string &formula, std::vector<instruction> &tape);
+
+	/**
+	 * Evaluate compiled formula together with its exact spatial derivatives
+	 *
+	 * @param tape Instructions created by TCustomBField::Compile
+	 * @param x Cartesian x coordinate
+	 * @param y Cartesian y coordinate
+	 * @param z Cartesian z coordinate
+	 * @param t Time
+	 * @param F Returns value of formula
+	 * @param dFdxi Returns spatial derivatives of formula (optional)
+	 */
+	static void Evaluate(const std::vector<instruction> &tape, const double x, const double y, const double z, const double t, double &F, double dFdxi[3]);
 public:
 	/**
 	 * Constructor
@@ -328,7 +367,9 @@ public:
 	/**
 	 * Calculates B field B[3] and the derivatives dBidxj[3][3] for a given point x,y,z and time t
 	 * 
-	 * Spatial derivatives are calculated numerically using a five-point stencil method
+	 * If derivatives are requested, formulas are evaluated from their compiled instructions with forward-mode automatic differentiation,
+	 * giving exact derivatives in one pass. Otherwise, and for formulas the compiler does not support, they are evaluated by exprtk,
+	 * approximating derivatives with a five-point stencil method.
 	 *
 	 * @param x Cartesian x coordinate
 	 * @param y Cartesian y coordinate
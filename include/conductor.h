@@ -6,6 +6,11 @@
 #ifndef RACETRACK_H_
 #define RACETRACK_H_
 
+#include <vector>
+#include <array>
+#include <string>
+#include <iostream>
+
 #include "field.h"
 
 /**
@@ -46,4 +51,62 @@ public:
 };
 
 
+/**
+ * Set of straight wires sharing one field-scaling formula.
+ *
+ * Start points, wire vectors, and currents of all wires are stored in separate arrays,
+ * so the fields of all wires are summed in a single loop that the compiler can vectorize.
+ * This is much faster than one TConductorField per wire, each with its own field-scaling formula.
+ */
+class TConductorSetField: public TField{
+private:
+	std::vector<double> x1; ///< x coordinates of start points
+	std::vector<double> y1; ///< y coordinates of start points
+	std::vector<double> z1; ///< z coordinates of start points
+	std::vector<double> lx; ///< x components of vectors from start to end points
+	std::vector<double> ly; ///< y components of vectors from start to end points
+	std::vector<double> lz; ///< z components of vectors from start to end points
+	std::vector<double> prefactor; ///< mu0*I/(4 pi) of each wire
+public:
+	/**
+	 * Constructor
+	 *
+	 * @param wires List of wires, each given by current I, start point x1, y1, z1, and end point x2, y2, z2
+	 */
+	TConductorSetField(const std::vector<std::array<double, 7> > &wires);
+
+	/**
+	 * Compute magnetic field of all wires.
+	 *
+	 * The field of each wire is B = mu0 I/(4 pi) * (r1 x r2) (|r1| + |r2|)/(|r1| |r2| (|r1| |r2| + r1.r2)),
+	 * with r1 and r2 pointing from start and end point to the field point. Points on a wire do not get a field contribution from it.
+	 * For parameter doc see TField::BField.
+	 */
+	void BField(const double x, const double y, const double z, const double t,
+			double B[3], double dBidxj[3][3]) const override;
+
+	/**
+	 * Conductors produce no electric field.
+	 *
+	 * For parameter doc see TField::EField.
+	 */
+	void EField(const double x, const double y, const double z, const double t,
+			double &V, double Ei[3]) const override {};
+};
+
+
+/**
+ * Instantiate a set of straight wires from a file.
+ *
+ * Each line of the file contains current, start point, and end point of a wire: I x1 y1 z1 x2 y2 z2.
+ * Empty lines and lines starting with # are ignored.
+ *
+ * @param params Parameter string read from config file: ConductorSet file scale
+ * @param out Stream to which log messages are written
+ *
+ * @return Returns created set of wires.
+ */
+TFieldContainer ReadConductorSet(const std::string &params, std::ostream &out = std::cout);
+
+
 #endif /*RACETRACK_H_*/
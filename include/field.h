@@ -53,11 +53,28 @@ public:
 
 /**
  * Class to calculate a time-dependent field-scaling factor based on a formula string
+ *
+ * Besides the usual exprtk functions, formulas can use pwlinear(x, x0, y0, x1, y1, ...) and pwconst(x, x0, y0, x1, y1, ...),
+ * which interpolate linearly between the points (x_i, y_i) or keep y_i constant from x_i up to x_i+1, respectively,
+ * and are constant outside of the first and last point.
+ * Formulas that do not depend on time and formulas consisting only of a single pwlinear(t, ...) or pwconst(t, ...) call
+ * are evaluated without the formula interpreter.
+ * The last scaling factor is cached, since all components of a field are scaled at the same time.
  */
 class TFieldScaler{
 private:
+	/// Type of precompiled scaling formula
+	enum scalerType { FORMULA, ///< general formula evaluated by exprtk
+					CONSTANT, ///< formula that does not depend on time
+					PIECEWISE_LINEAR, ///< single pwlinear(t, ...) call
+					PIECEWISE_CONSTANT ///< single pwconst(t, ...) call
+	};
 	exprtk::expression<double> scaler; ///< formula interpreter for field scaling
 	std::unique_ptr<double> tvar; ///< time variable for use in scaling-formula parsers. It needs to be a pointer to make sure the reference in the exprtk expression will not be invalidated when copying
+	scalerType type; ///< type of scaling formula
+	std::vector<double> points; ///< scaling factor for CONSTANT formulas, or list of points x0, y0, x1, y1, ... for piecewise formulas
+	mutable double lastt; ///< time of last calculated scaling factor
+	mutable double lastfactor; ///< last calculated scaling factor
 public:
 	/**
 	 * Calculate time-dependent scaling factor from parsed formula
@@ -68,6 +85,18 @@ public:
 	 */
 	double scalingFactor(const double t) const;
 
+	/**
+	 * Evaluate piecewise-linear or piecewise-constant function
+	 *
+	 * @param x Function argument
+	 * @param points List of points x0, y0, x1, y1, ..., with ascending x_i
+	 * @param n Number of points
+	 * @param linear Interpolate linearly between points if true, else keep y_i constant between x_i and x_i+1
+	 *
+	 * @return Returns function value
+	 */
+	static double piecewise(const double x, const double *points, const size_t n, const bool linear);
+
 	/**
 	 * Scale scalar field F with gradient dFdxi by calculated scaling factor
 	 * 
@@ -124,6 +153,14 @@ public:
 	 */
 	virtual bool inBounds(const double x, const double y, const double z) const = 0;
 
+	/**
+	 * Get axis-aligned box enclosing the boundary region, only valid if hasBounds() returns true
+	 *
+	 * @param min Returns minimum x, y, and z coordinates
+	 * @param max Returns maximum x, y, and z coordinates
+	 */
+	virtual void getBoundingBox(double min[3], double max[3]) const = 0;
+
 	/**
 	 * Smoothly scale field at the edges of the boundary region
 	 *
@@ -193,6 +230,14 @@ public:
 	 */
 	bool inBounds(const double x, const double y, const double z) const override;
 
+	/**
+	 * Get bounding box
+	 *
+	 * @param min Returns xmin, ymin, zmin
+	 * @param max Returns xmax, ymax, zmax
+	 */
+	void getBoundingBox(double min[3], double max[3]) const override;
+
 	/**
 	 * Smoothly scale field at the edges of the boundary region
 	 *
@@ -305,6 +350,16 @@ public:
 	 * @param Ei Returns electric field vector
 	 */
 	void EField(const double x, const double y, const double z, const double t, double &V, double Ei[3]) const;
+
+	/**
+	 * Get axis-aligned box outside of which the field is zero
+	 *
+	 * @param min Returns minimum x, y, and z coordinates
+	 * @param max Returns maximum x, y, and z coordinates
+	 *
+	 * @return Returns false if the field has no boundary, min and max are not set in that case
+	 */
+	bool GetBoundingBox(double min[3], double max[3]) const;
 };
 
 
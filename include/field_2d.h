@@ -1,121 +1,169 @@
-/**
- * \file
- * Bicubic interpolation of axisymmetric field tables.
- */
-
-#ifndef FIELD_2D_H_
-#define FIELD_2D_H_
-
-#include <memory>
-
-#include "field.h"
-
-#include "interpolation.h"
-
-/**
- * Class for bicubic field interpolation, create one for every table file you want to use.
- *
- * This class loads a special file format from "Vectorfields Opera" containing a regular, rectangular table of magnetic and electric fields and
- * calculates bicubic interpolation coefficients (4x4 matrix for each grid point) to allow fast evaluation of the fields at arbitrary points.
- * Therefore it assumes that the fields are axisymmetric around the z axis.
- *
- */
-class TabField: public TField{
-	private:
-		int m; ///< radial size of the table file
-		int n; ///< axial size of the arrays
-		double rdist; ///< distance between grid points in radial direction
-		double zdist; ///< distance between grid points in axial direction
-		double r_mi; ///< lower radial coordinate of rectangular grid
-		double z_mi; ///< lower axial coordinate of rectangular grid
-		bool fBrc, fBphic, fBzc, fErc, fEphic, fEzc, fVc; ///< remember which field components were loaded from table file
-		alglib::spline2dinterpolant Brc, Bphic, Bzc, Erc, Ephic, Ezc, Vc; ///< spline interpolant for each field component
-
-
-		/**
-		 * Reads an Opera table file.
-		 *
-		 * File has to contain x and z coordinates, it may contain B_x, B_y ,B_z, E_x, E_y, E_z and V columns. If V is present, E_i are ignored.
-		 * Sets TabField::m, TabField::n, TabField::rdist, TabField::zdist, TabField::r_mi, TabField::z_mi according to the values in the table file which are used to determine the needed indeces on interpolation.
-		 *
-		 * @param tabfile Path to table file
-		 * @param Bscale Magnetic field is always scaled by this factor
-		 * @param Escale Electric field is always scaled by this factor
-		 * @param rind Vector containing r-components of grid
-		 * @param zind Vector containing z-components of grid
-		 * @param BTabs Three vectors containing magnetic field components at each grid point
-		 * @param ETabs Three vectors containing electric field components at each grid point
-		 * @param VTab Vector containing electric potential at each grid point
-		 */
-		void ReadTabFile(const std::string &tabfile, const double lengthconv, alglib::real_1d_array &rind, alglib::real_1d_array &zind,
-						alglib::real_1d_array BTabs[3], alglib::real_1d_array ETabs[3], alglib::real_1d_array &VTab);
-
-
-		/**
-		 * Print some information for each table column
-		 *
-		 * @param rind Vector containing r-components of grid
-		 * @param zind Vector containing z-components of grid
-		 * @param BTabs Three vectors containing magnetic field components at each grid point
-		 * @param ETabs Three vectors containing electric field components at each grid point
-		 * @param VTab Vector containing electric potential at each grid point
-		 */
-		void CheckTab(const alglib::real_1d_array &rind, const alglib::real_1d_array &zind,
-				const alglib::real_1d_array BTabs[3], const alglib::real_1d_array ETabs[3], const alglib::real_1d_array &VTab);
-
-
-	public:
-		/**
-		 * Constructor.
-		 *
-		 * Calls TabField::ReadTabFile, TabField::CheckTab and for each column TabField::PreInterpol
-		 *
-		 * @param tabfile Path of table file
-		 * @param alengthconv Factor to convert length units in file to PENTrack units (default: expect cm (cgs), convert to m)
-		 */
-		TabField(const std::string &tabfile, const double alengthconv);
-
-		/**
-		 * Get magnetic field at a specific point.
-		 *
-		 * Evaluates the interpolation polynoms and their derivatives for each field component.
-		 * These radial, axial und azimuthal components have to be rotated into cartesian coordinate system.
-		 *
-		 * @param x X coordinate where the field shall be evaluated
-		 * @param y Y coordinate where the field shall be evaluated
-		 * @param z Z coordinate where the field shall be evaluated
-		 * @param t Time
-		 * @param B Return magnetic-field components
-		 * @param dBidxj Returns spatial derivatives of magnetic-field components (optional)
-		 */
-		void BField(const double x, const double y, const double z, const double t, double B[3], double dBidxj[3][3]) const override;
-
-
-		/**
-		 * Get electric field at a specific point.
-		 *
-		 * Evaluates the interpolation polynoms for each field component or the potential and its derivatives.
-		 * These radial, axial und azimuthal components have to be rotated into cartesian coordinate system.
-		 *
-		 * @param x X coordinate where the field shall be evaluated
-		 * @param y Y coordinate where the field shall be evaluated
-		 * @param z Z coordinate where the field shall be evaluated
-		 * @param t Time
-		 * @param V Returns electric potential
-		 * @param Ei Return electric field (negative spatial derivatives of V)
-		 */
-		void EField(const double x, const double y, const double z, const double t,
-				double &V, double Ei[3]) const override;
-};
-
-
-/**
- * Instantiate a 2D field map created with OPERA
- * 
- * @param params Parameter string read from config file.
- * 
- * @return Returns created 2D field map.
- */
-TFieldContainer ReadOperaField2(const std::string &params);
-
-#endif // FIELD_2D_H_
+/**
+ * \file
+ * Bicubic interpolation of axisymmetric field tables.
+ */
+
+#ifndef FIELD_2D_H_
+#define FIELD_2D_H_
+
+#include <memory>
+#include <iostream>
+#include <vector>
+
+#include "field.h"
+
+#include "interpolation.h"
+
+/**
+ * Class for bicubic field interpolation, create one for every table file you want to use.
+ *
+ * This class loads a special file format from "Vectorfields Opera" containing a regular, rectangular table of magnetic and electric fields and
+ * calculates bicubic interpolation coefficients (4x4 matrix for each grid cell) to allow fast evaluation of the fields at arbitrary points.
+ * Therefore it assumes that the fields are axisymmetric around the z axis.
+ *
+ */
+class TabField: public TField{
+	private:
+		int m; ///< radial size of the table file
+		int n; ///< axial size of the arrays
+		double rdist; ///< distance between grid points in radial direction
+		double zdist; ///< distance between grid points in axial direction
+		double r_mi; ///< lower radial coordinate of rectangular grid
+		double z_mi; ///< lower axial coordinate of rectangular grid
+		std::vector<double> rgrid; ///< radial coordinates of grid points
+		std::vector<double> zgrid; ///< axial coordinates of grid points
+		std::vector<double> Brc, Bphic, Bzc, Erc, Ephic, Ezc, Vc; ///< bicubic coefficients (16 per grid cell) for each field component, empty if component was not loaded from table file
+
+
+		/**
+		 * Reads an Opera table file.
+		 *
+		 * File has to contain x and z coordinates, it may contain B_x, B_y ,B_z, E_x, E_y, E_z and V columns. If V is present, E_i are ignored.
+		 * Sets TabField::m, TabField::n, TabField::rdist, TabField::zdist, TabField::r_mi, TabField::z_mi according to the values in the table file which are used to determine the needed indeces on interpolation.
+		 *
+		 * @param tabfile Path to table file
+		 * @param Bscale Magnetic field is always scaled by this factor
+		 * @param Escale Electric field is always scaled by this factor
+		 * @param rind Vector containing r-components of grid
+		 * @param zind Vector containing z-components of grid
+		 * @param BTabs Three vectors containing magnetic field components at each grid point
+		 * @param ETabs Three vectors containing electric field components at each grid point
+		 * @param VTab Vector containing electric potential at each grid point
+		 * @param out Stream to which log messages are written
+		 */
+		void ReadTabFile(const std::string &tabfile, const double lengthconv, alglib::real_1d_array &rind, alglib::real_1d_array &zind,
+						alglib::real_1d_array BTabs[3], alglib::real_1d_array ETabs[3], alglib::real_1d_array &VTab, std::ostream &out);
+
+
+		/**
+		 * Print some information for each table column
+		 *
+		 * @param rind Vector containing r-components of grid
+		 * @param zind Vector containing z-components of grid
+		 * @param BTabs Three vectors containing magnetic field components at each grid point
+		 * @param ETabs Three vectors containing electric field components at each grid point
+		 * @param VTab Vector containing electric potential at each grid point
+		 * @param out Stream to which information is written
+		 */
+		void CheckTab(const alglib::real_1d_array &rind, const alglib::real_1d_array &zind,
+				const alglib::real_1d_array BTabs[3], const alglib::real_1d_array ETabs[3], const alglib::real_1d_array &VTab, std::ostream &out);
+
+
+		/**
+		 * Calculate bicubic interpolation coefficients for one table column.
+		 *
+		 * Builds an alglib bicubic spline and unpacks its coefficients into a flat array, 16 for each grid cell.
+		 *
+		 * @param rind Vector containing r-components of grid
+		 * @param zind Vector containing z-components of grid
+		 * @param Tab Vector containing field component at each grid point
+		 * @param coeff Returns coefficients c_ij of the polynomial sum c_ij*(r - r_cell)^i*(z - z_cell)^j, stored at index 16*cell + 4*i + j
+		 */
+		void PreInterpol(const alglib::real_1d_array &rind, const alglib::real_1d_array &zind, const alglib::real_1d_array &Tab, std::vector<double> &coeff) const;
+
+
+		/**
+		 * Find grid cell containing a point.
+		 *
+		 * Calculates cell index from the grid spacing and corrects it if rounding put the point into a neighboring cell.
+		 *
+		 * @param r Radial coordinate of point
+		 * @param z Axial coordinate of point
+		 * @param dr Returns radial distance of point from lower cell corner
+		 * @param dz Returns axial distance of point from lower cell corner
+		 * @return Returns index of grid cell
+		 */
+		int FindCell(const double r, const double z, double &dr, double &dz) const;
+
+
+		/**
+		 * Evaluate interpolation polynomial of one field component in a grid cell.
+		 *
+		 * @param coeff Interpolation coefficients of field component, see TabField::PreInterpol
+		 * @param cell Index of grid cell, see TabField::FindCell
+		 * @param dr Radial distance from lower cell corner
+		 * @param dz Axial distance from lower cell corner
+		 * @param dfdr Returns radial derivative of field component (optional)
+		 * @param dfdz Returns axial derivative of field component (optional)
+		 * @return Returns interpolated field component
+		 */
+		double Interpolate(const std::vector<double> &coeff, const int cell, const double dr, const double dz, double *dfdr = nullptr, double *dfdz = nullptr) const;
+
+
+	public:
+		/**
+		 * Constructor.
+		 *
+		 * Calls TabField::ReadTabFile, TabField::CheckTab and for each column TabField::PreInterpol
+		 *
+		 * @param tabfile Path of table file
+		 * @param alengthconv Factor to convert length units in file to PENTrack units (default: expect cm (cgs), convert to m)
+		 * @param out Stream to which log messages are written
+		 */
+		TabField(const std::string &tabfile, const double alengthconv, std::ostream &out = std::cout);
+
+		/**
+		 * Get magnetic field at a specific point.
+		 *
+		 * Finds the grid cell and evaluates the interpolation polynoms and their derivatives for each field component.
+		 * These radial, axial und azimuthal components have to be rotated into cartesian coordinate system.
+		 *
+		 * @param x X coordinate where the field shall be evaluated
+		 * @param y Y coordinate where the field shall be evaluated
+		 * @param z Z coordinate where the field shall be evaluated
+		 * @param t Time
+		 * @param B Return magnetic-field components
+		 * @param dBidxj Returns spatial derivatives of magnetic-field components (optional)
+		 */
+		void BField(const double x, const double y, const double z, const double t, double B[3], double dBidxj[3][3]) const override;
+
+
+		/**
+		 * Get electric field at a specific point.
+		 *
+		 * Evaluates the interpolation polynoms for each field component or the potential and its derivatives.
+		 * These radial, axial und azimuthal components have to be rotated into cartesian coordinate system.
+		 *
+		 * @param x X coordinate where the field shall be evaluated
+		 * @param y Y coordinate where the field shall be evaluated
+		 * @param z Z coordinate where the field shall be evaluated
+		 * @param t Time
+		 * @param V Returns electric potential
+		 * @param Ei Return electric field (negative spatial derivatives of V)
+		 */
+		void EField(const double x, const double y, const double z, const double t,
+				double &V, double Ei[3]) const override;
+};
+
+
+/**
+ * Instantiate a 2D field map created with OPERA
+ * 
+ * @param params Parameter string read from config file.
+ * @param out Stream to which log messages are written
+ * 
+ * @return Returns created 2D field map.
+ */
+TFieldContainer ReadOperaField2(const std::string &params, std::ostream &out = std::cout);
+
+#endif // FIELD_2D_H_
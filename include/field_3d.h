@@ -1,135 +1,273 @@
-/**
- * \file
- * Tricubic interpolation of 3D field tables.
- */
-
-#ifndef FIELD_3D_H_
-#define FIELD_3D_H_
-
-#include "field.h"
-
-#include <vector>
-
-#include "boost/multi_array.hpp"
-
-/**
- * Class for tricubic field interpolation, create one for every table file you want to use.
- *
- * This class loads a tabulated magnetic and electric field on a rectilinear, three-dimensional grid and
- * calculates tricubic interpolation coefficients (4x4x4 = 64 for each grid point) to allow fast evaluation of the fields at arbitrary points.
- *
- */
-class TabField3: public TField{
-private:
-        std::array<std::vector<double>, 3> xyz; ///< coordinates of points on interpolation grid
-        typedef boost::multi_array<double, 3> array3D;
-        typedef std::array<double, 64> tricubic_coeff; ///< interpolation coefficients for one grid cell
-        typedef boost::multi_array<tricubic_coeff, 3> field_type; ///< interpolation coefficients for all grid cells
-        std::array<field_type, 3> Bc; ///< interpolation coefficients for magnetix x,y, and z components
-        field_type Vc; ///< interpolation coefficients for electric potential
-private:
-		/**
-		 * Print some information for each table column
-		 *
-         * @param B Lists of Bx, By, and Bz magnetic field components on grid points
-         * @param V List of electric potentials on grid points
-		 */
-        void CheckTab(const std::array<std::vector<double>, 3> &B, const std::vector<double> &V);
-
-
-		/**
-         * Calculate spatial derivatives of a table column along one dimension using 1D cubic spline interpolations.
-		 *
-         * @param Tab 3D array of field components on grid points
-         * @param diff_dim Coordinate dimension to differentiate (0, 1, or 2 for x, y, or z)
-         * @param DiffTab Returns 3D array of field components differentiated with respect to dimension diff_dim
-         */
-        void CalcDerivs(const array3D &Tab, const unsigned long diff_dim, array3D &DiffTab) const;
-
-
-		/**
-		 * Calculate tricubic interpolation coefficients for a table column
-		 *
-		 * Calls TabField3::CalcDerivs and determines the interpolation coefficients with ::tricubic_get_coeff
-		 *
-         * @param Tab 3D array of field components on grid
-         * @param coeff Returns 3D array of tricubic interpolation coefficients for each grid cell
-         */
-        void PreInterpol(const array3D &Tab, field_type &coeff) const;
-
-
-		/**
-		 * Interpolate field component at a specific point.
-		 *
-		 * Uses a binary search to find the grid cell that contains the point (x,y,z) and and calculates the tricubic interpolation using the coefficients belonging to the grid cell.
-		 *
-		 * @param x X coordinate where the field shall be evaluated
-		 * @param y Y coordinate where the field shall be evaluated
-		 * @param z Z coordinate where the field shall be evaluated
-		 * @param coeffs 3D array of tricubic interpolation coefficients
-		 * @param F Returns interpolated field component
-		 * @param dFdxi Returns spatial derivatives of field component (can be null)
-		 */
-		void Interpolate(const double x, const double y, const double z,
-                            const field_type& coeffs, double &F, double dFdxi[3]) const;
-	public:
-		/**
-		 * Constructor.
-		 *
-		 * Calls TabField3::ReadTabFile, TabField3::CheckTab and for each column TabField3::PreInterpol
-		 *
-         * @param xyzTab Lists of x, y, and z coordinates of grid points
-         * @param BTab Lists of Bx, By, and Bz magnetic field components on grid points
-         * @param VTab List of electric potentials on grid points
-		 */
-        TabField3(const std::array<std::vector<double>, 3> &xyzTab, const std::array<std::vector<double>, 3> &BTab, const std::vector<double> &VTab);
-
-
-		/**
-		 * Get magnetic field at a specific point.
-		 *
-		 * Searches the right interpolation coefficients by determining the indices from TabField3::x_mi, TabField3::xdist, TabField3::y_mi, TabField3::ydist, TabField3::z_mi, TabField3::zdist
-		 * and evaluates the interpolation polynom tricubic.h#tricubic_eval.
-		 *
-		 * @param x X coordinate where the field shall be evaluated
-		 * @param y Y coordinate where the field shall be evaluated
-		 * @param z Z coordinate where the field shall be evaluated
-		 * @param t Time
-		 * @param B Returns magnetic-field components
-		 * @param dBidxj Returns spatial derivatives of magnetic-field components (optional)
-		 */
-		void BField(const double x, const double y, const double z, const double t, double B[3], double dBidxj[3][3]) const override;
-
-
-		/**
-		 * Get electric field at a specific point.
-		 *
-		 * Searches the right interpolation coefficients by determining the indices from TabField3::x_mi, TabField3::xdist, TabField3::y_mi, TabField3::ydist, TabField3::z_mi, TabField3::zdist
-		 * and evaluates the interpolation polynom tricubic.h#tricubic_eval.
-		 *
-		 * @param x X coordinate where the field shall be evaluated
-		 * @param y Y coordinate where the field shall be evaluated
-		 * @param z Z coordinate where the field shall be evaluated
-		 * @param t Time
-		 * @param V Returns electric potential
-		 * @param Ei Returns electric field (negative spatial derivatives of V)
-		 */
-		void EField(const double x, const double y, const double z, const double t,
-				double &V, double Ei[3]) const override;
-};
-
-/**
- * Read 3D table file exported from OPERA
- * @param params String containing parameters defined in config.in. Should contain field type "3Dtable", file name, magnetic field scaling formula, electric field scaling formula, and boundary width
- * @return Pointer to created class, derived from TField
- */
-TFieldContainer ReadOperaField3(const std::string &params);
-
-/**
-* Read generic file containing table of magnetic field mapped on list of points, e.g. exported from COMSOL
-* @param params String containing parameters defined in config.in. Should contain field type "COMSOL", file name, magnetic field scaling formula, and boundary width
-* @return Pointer to created class, derived from TField
-*/
-TFieldContainer ReadComsolField(const std::string &params);
-
-#endif // FIELD_3D_H_
+/**
+ * \file
+ * Tricubic interpolation of 3D field tables.
+ */
+
+#ifndef FIELD_3D_H_
+#define FIELD_3D_H_
+
+#include "field.h"
+
+#include <vector>
+#include <memory>
+#include <iostream>
+
+#include "boost/multi_array.hpp"
+
+/**
+ * Class for tricubic field interpolation, create one for every table file you want to use.
+ *
+ * This class loads a tabulated magnetic and electric field on a rectilinear, three-dimensional grid and
+ * calculates tricubic interpolation coefficients (4x4x4 = 64 for each grid point) to allow fast evaluation of the fields at arbitrary points.
+ *
+ * In compact mode only the field value and its seven derivatives (d/dx, d/dy, d/dxdy, d/dz, d/dxdz, d/dydz, d/dxdydz) are stored for each grid point,
+ * reducing memory by a factor of eight. The interpolation is then evaluated as the equivalent tensor product of cubic Hermite polynomials.
+ *
+ * The grid and the interpolation data can be saved to a binary file with TabField3::Save. Loading such a file memory-maps it read-only,
+ * so it starts instantly and concurrent processes on the same machine share the memory.
+ */
+class TabField3: public TField{
+private:
+        std::array<std::vector<double>, 3> xyz; ///< coordinates of points on interpolation grid
+        std::array<double, 3> gridstep; ///< grid spacing along each axis, zero if the axis is not evenly spaced
+        typedef boost::multi_array<double, 3> array3D;
+        typedef std::array<double, 64> tricubic_coeff; ///< interpolation coefficients for one grid cell
+        typedef boost::multi_array<tricubic_coeff, 3> field_type; ///< interpolation coefficients for all grid cells
+        std::array<field_type, 3> Bc; ///< interpolation coefficients for magnetix x,y, and z components
+        field_type Vc; ///< interpolation coefficients for electric potential
+        typedef std::array<double, 8> node_derivs; ///< field value and derivatives at one grid point, the n-th entry is differentiated with respect to x if bit 0 of n is set, y if bit 1 is set, and z if bit 2 is set
+        typedef boost::multi_array<node_derivs, 3> node_type; ///< field values and derivatives on all grid points
+        std::array<node_type, 3> Bn; ///< values and derivatives of magnetic x, y, and z components on grid points (compact mode only)
+        node_type Vn; ///< values and derivatives of electric potential on grid points (compact mode only)
+        bool compact; ///< true if field is stored in compact mode
+        std::array<const double*, 3> Bdata; ///< interpolation data of magnetic x, y, and z components, pointing into Bc or Bn, or into memory-mapped file (null if component is not present)
+        const double *Vdata; ///< interpolation data of electric potential, pointing into Vc or Vn, or into memory-mapped file (null if not present)
+        std::shared_ptr<const void> mapping; ///< keeps memory-mapped file open
+private:
+		/**
+		 * Print some information for each table column
+		 *
+         * @param B Lists of Bx, By, and Bz magnetic field components on grid points
+         * @param V List of electric potentials on grid points
+         * @param out Stream to which information is written
+		 */
+        void CheckTab(const std::array<std::vector<double>, 3> &B, const std::vector<double> &V, std::ostream &out);
+
+
+		/**
+         * Calculate spatial derivatives of a table column along one dimension using 1D cubic spline interpolations.
+		 *
+         * @param Tab 3D array of field components on grid points
+         * @param diff_dim Coordinate dimension to differentiate (0, 1, or 2 for x, y, or z)
+         * @param DiffTab Returns 3D array of field components differentiated with respect to dimension diff_dim
+         */
+        void CalcDerivs(const array3D &Tab, const unsigned long diff_dim, array3D &DiffTab) const;
+
+
+		/**
+		 * Calculate field values and derivatives on grid points for a table column
+		 *
+		 * Calls TabField3::CalcDerivs for each combination of coordinate dimensions
+		 *
+         * @param Tab 3D array of field components on grid
+         * @param nodes Returns 3D array of field values and derivatives on grid points
+         */
+        void CalcNodes(const array3D &Tab, node_type &nodes) const;
+
+
+		/**
+		 * Calculate tricubic interpolation coefficients for a table column
+		 *
+		 * Determines the interpolation coefficients from values and derivatives calculated by TabField3::CalcNodes with ::tricubic_get_coeff
+		 *
+         * @param nodes 3D array of field values and derivatives on grid points
+         * @param coeff Returns 3D array of tricubic interpolation coefficients for each grid cell
+         */
+        void PreInterpol(const node_type &nodes, field_type &coeff) const;
+
+
+		/**
+		 * Find grid cell containing a specific point.
+		 *
+		 * On evenly spaced axes the cell index is calculated directly from TabField3::gridstep, on other axes a binary search is used.
+		 *
+		 * @param x X coordinate of point
+		 * @param y Y coordinate of point
+		 * @param z Z coordinate of point
+		 * @param index Returns indices of grid cell
+		 * @param r Returns coordinates of point scaled to unit cube of grid cell
+		 * @param dist Returns size of grid cell
+		 * @return Returns false if point is outside of grid
+		 */
+		bool FindCell(const double x, const double y, const double z,
+                            std::array<long, 3> &index, std::array<double, 3> &r, std::array<double, 3> &dist) const;
+
+
+		/**
+		 * Interpolation basis for a point in a grid cell.
+		 *
+		 * Tricubic interpolation is a tensor product of four one-dimensional basis functions along each axis, contracted with 4x4x4 coefficients.
+		 */
+		struct basis_type{
+			double p[3][4]; ///< basis functions along each axis (powers of scaled coordinate or, in compact mode, cubic Hermite polynomials)
+			double dp[3][4]; ///< derivatives of basis functions with respect to unscaled coordinate
+			double yz[16]; ///< products of y and z basis functions
+			double dyz[16]; ///< products of y-derivative and z basis functions
+			double ydz[16]; ///< products of y and z-derivative basis functions
+		};
+
+
+		/**
+		 * Calculate interpolation basis for a point in a grid cell.
+		 *
+		 * Calculating it once for each point allows all field components and their derivatives to be evaluated in a single pass over their coefficients.
+		 *
+		 * @param r Coordinates scaled to unit cube of grid cell
+		 * @param dist Size of grid cell
+		 * @param b Returns interpolation basis
+		 */
+		void CalcBasis(const std::array<double, 3> &r, const std::array<double, 3> &dist, basis_type &b) const;
+
+
+		/**
+		 * Interpolate field component in a grid cell.
+		 *
+		 * Contracts the basis calculated by TabField3::CalcBasis with the coefficients belonging to the grid cell found by TabField3::FindCell,
+		 * or, in compact mode, with the values and derivatives on the cell's corners.
+		 *
+		 * @param index Indices of grid cell
+		 * @param b Interpolation basis
+		 * @param data Interpolation data of field component
+		 * @param F Returns interpolated field component
+		 * @param dFdxi Returns spatial derivatives of field component (can be null)
+		 */
+		void Interpolate(const std::array<long, 3> &index, const basis_type &b, const double *data, double &F, double dFdxi[3]) const;
+
+
+		/**
+		 * Detect evenly spaced axes of the grid and set TabField3::gridstep
+		 */
+		void CheckGridSpacing();
+	public:
+		/**
+		 * Constructor.
+		 *
+		 * Calls TabField3::ReadTabFile, TabField3::CheckTab and for each column TabField3::PreInterpol
+		 *
+         * @param xyzTab Lists of x, y, and z coordinates of grid points
+         * @param BTab Lists of Bx, By, and Bz magnetic field components on grid points
+         * @param VTab List of electric potentials on grid points
+         * @param compact If true, store only field values and derivatives on grid points instead of interpolation coefficients for each grid cell
+         * @param out Stream to which log messages are written
+		 */
+        TabField3(const std::array<std::vector<double>, 3> &xyzTab, const std::array<std::vector<double>, 3> &BTab, const std::vector<double> &VTab,
+                  const bool compact = false, std::ostream &out = std::cout);
+
+
+		/**
+		 * Constructor.
+		 *
+		 * Memory-maps a binary file written by TabField3::Save.
+		 *
+		 * @param filename Path of binary file
+		 * @param out Stream to which log messages are written
+		 */
+		TabField3(const std::string &filename, std::ostream &out = std::cout);
+
+		TabField3(const TabField3&) = delete; ///< copies would point to the interpolation data of the original
+		TabField3& operator=(const TabField3&) = delete;
+
+
+		/**
+		 * Save grid and interpolation data to a binary file.
+		 *
+		 * The file starts with the 16-character identifier "PENTrackTable3D", followed by the format version, a flag for compact mode, a bit mask of the stored components (Bx, By, Bz, V),
+		 * and the number of grid points along x, y, and z (uint32, uint32, uint32, uint32, and 3 uint64).
+		 * It continues with the x, y, and z coordinates of the grid and the interpolation data of each stored component (doubles).
+		 * All numbers are stored in the native byte order.
+		 *
+		 * @param filename Path of binary file
+		 */
+		void Save(const std::string &filename) const;
+
+
+		/**
+		 * Get bounding box of field table
+		 *
+		 * @param min Returns lower corner of grid
+		 * @param max Returns upper corner of grid
+		 */
+		void GetGridBounds(double min[3], double max[3]) const;
+
+
+		/**
+		 * Check which fields the table contains
+		 *
+		 * @param B Returns true if the table contains at least one magnetic-field component
+		 * @param V Returns true if the table contains an electric potential
+		 */
+		void GetComponents(bool &B, bool &V) const;
+
+
+		/**
+		 * Get magnetic field at a specific point.
+		 *
+		 * Finds the grid cell with TabField3::FindCell, calculates the interpolation basis once with TabField3::CalcBasis
+		 * and evaluates all field components and their derivatives with them.
+		 *
+		 * @param x X coordinate where the field shall be evaluated
+		 * @param y Y coordinate where the field shall be evaluated
+		 * @param z Z coordinate where the field shall be evaluated
+		 * @param t Time
+		 * @param B Returns magnetic-field components
+		 * @param dBidxj Returns spatial derivatives of magnetic-field components (optional)
+		 */
+		void BField(const double x, const double y, const double z, const double t, double B[3], double dBidxj[3][3]) const override;
+
+
+		/**
+		 * Get electric field at a specific point.
+		 *
+		 * Finds the grid cell with TabField3::FindCell and evaluates the interpolated potential and its derivatives.
+		 *
+		 * @param x X coordinate where the field shall be evaluated
+		 * @param y Y coordinate where the field shall be evaluated
+		 * @param z Z coordinate where the field shall be evaluated
+		 * @param t Time
+		 * @param V Returns electric potential
+		 * @param Ei Returns electric field (negative spatial derivatives of V)
+		 */
+		void EField(const double x, const double y, const double z, const double t,
+				double &V, double Ei[3]) const override;
+};
+
+/**
+ * Read 3D table file exported from OPERA
+ * @param params String containing parameters defined in config.in. Should contain field type "3Dtable", file name, magnetic field scaling formula, electric field scaling formula, and boundary width.
+ * Field type "OPERA3D" additionally requires a coordinate scaling factor and can be followed by "compact" to select TabField3's compact mode
+ * and "convert" to save the table with TabField3::Save to the table's file name with ".bin" appended.
+ * "octree Btolerance Vtolerance maxdepth" resamples the table on a TOctreeField, which "convert" then saves with ".octree" appended
+ * @param out Stream to which log messages are written
+ * @return Pointer to created class, derived from TField
+ */
+TFieldContainer ReadOperaField3(const std::string &params, std::ostream &out = std::cout);
+
+/**
+ * Read binary 3D table file written by TabField3::Save
+ * @param params String containing parameters defined in config.in. Should contain field type "BINARY3D", file name, magnetic field scaling formula, electric field scaling formula, and boundary width
+ * @param out Stream to which log messages are written
+ * @return Pointer to created class, derived from TField
+ */
+TFieldContainer ReadBinaryField3(const std::string &params, std::ostream &out = std::cout);
+
+/**
+* Read generic file containing table of magnetic field mapped on list of points, e.g. exported from COMSOL
+* @param params String containing parameters defined in config.in. Should contain field type "COMSOL", file name, magnetic field scaling formula, boundary width, and coordinate scaling factor,
+* optionally followed by "compact" to select TabField3's compact mode and "convert" to save the table with TabField3::Save to the table's file name with ".bin" appended.
+* "octree Btolerance Vtolerance maxdepth" resamples the table on a TOctreeField, which "convert" then saves with ".octree" appended
+* @param out Stream to which log messages are written
+* @return Pointer to created class, derived from TField
+*/
+TFieldContainer ReadComsolField(const std::string &params, std::ostream &out = std::cout);
+
+#endif // FIELD_3D_H_
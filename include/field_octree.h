@@ -0,0 +1,189 @@
+/**
+ * \file
+ * Tricubic interpolation of fields on adaptively refined octrees.
+ */
+
+#ifndef FIELD_OCTREE_H_
+#define FIELD_OCTREE_H_
+
+#include <array>
+#include <vector>
+#include <string>
+#include <functional>
+#include <iostream>
+#include <cstdint>
+
+#include "field.h"
+
+/**
+ * Tricubic field interpolation on an adaptively refined octree.
+ *
+ * The bounding box is recursively split into octants until the interpolation error in each leaf cell is below a given tolerance,
+ * so fine cells are only stored where the field varies quickly.
+ * In each leaf the field components are interpolated with tricubic Hermite polynomials, defined by the values and derivatives
+ * (d/dx, d/dy, d/dz, d2/dxdy, d2/dxdz, d2/dydz, d3/dxdydz) at the eight corners of the leaf.
+ * Corners that lie on a face or edge of a larger neighboring leaf take their values from that leaf's polynomial,
+ * which keeps the interpolation continuous across refinement levels.
+ *
+ * The octree can contain the magnetic field, the electric potential, or both. It can be saved to a binary file with TOctreeField::Save.
+ */
+class TOctreeField: public TField{
+public:
+	/**
+	 * Function sampling the field at a point
+	 *
+	 * Returns magnetic field components and electric potential (Bx, By, Bz, V) and their spatial derivatives in F and dFidxj
+	 */
+	typedef std::function<void(const double x, const double y, const double z, double F[4], double dFidxj[4][3])> sampler_type;
+
+private:
+	/// Index of a grid node: integer coordinates at the finest refinement level
+	typedef std::array<long, 3> node_index;
+
+	/// Cell of the octree: lower corner at the finest refinement level and depth in the tree
+	struct cell_type{
+		node_index corner; ///< integer coordinates of lower corner
+		int depth; ///< refinement depth, size of cell is 2^(maxdepth - depth)
+	};
+
+	static const unsigned maxcomp = 4; ///< maximum number of interpolated components
+	bool hasB; ///< true if octree contains magnetic field, stored as first three components
+	bool hasV; ///< true if octree contains electric potential, stored as last component
+	unsigned ncomp; ///< number of interpolated components
+	std::array<double, 3> boxmin; ///< lower corner of bounding box
+	std::array<double, 3> boxsize; ///< size of bounding box
+	int maxdepth; ///< maximum refinement depth
+	std::vector<int32_t> tree; ///< octree: index of first of eight children of each tree node, or -1 - leaf index for leaves
+	std::vector<std::array<uint32_t, 8> > leafcorners; ///< node indices of the eight corners of each leaf, bit 0/1/2 of corner number selects upper x/y/z side
+	std::vector<double> nodes; ///< values and derivatives of each component at each node, ncomp*8 per node, bit 0/1/2 of derivative number selects d/dx, d/dy, d/dz
+
+	/**
+	 * Calculate values and derivatives of each component at a grid node from sampled field
+	 *
+	 * Mixed derivatives are calculated by finite differences of the sampled first derivatives.
+	 *
+	 * @param n Grid node
+	 * @param sampler Function returning field and its first derivatives
+	 * @param data Returns ncomp*8 values and derivatives
+	 */
+	void SampleNode(const node_index &n, const sampler_type &sampler, double *data) const;
+
+	/**
+	 * Calculate Hermite interpolation coefficients of one component in a cell, from the values and derivatives at its corners
+	 *
+	 * @param corners Pointers to values and derivatives at eight corners of cell
+	 * @param comp Component
+	 * @param c Returns 64 coefficients, index i + 4*j + 16*k with i, j, k = 2*corner + derivative in x, y, z direction
+	 */
+	void Coefficients(const std::array<const double*, 8> &corners, const unsigned comp, double c[64]) const;
+
+	/**
+	 * Find leaf containing a point
+	 *
+	 * @param x Cartesian x coordinate
+	 * @param y Cartesian y coordinate
+	 * @param z Cartesian z coordinate
+	 * @param t Returns position of point relative to leaf, each coordinate between 0 and 1
+	 * @param size Returns size of leaf in each direction
+	 *
+	 * @return Returns index of leaf or -1 if point is outside of bounding box
+	 */
+	long FindLeaf(const double x, const double y, const double z, std::array<double, 3> &t, std::array<double, 3> &size) const;
+
+	/**
+	 * Interpolate components in a leaf
+	 *
+	 * @param leaf Index of leaf
+	 * @param t Position in leaf, see TOctreeField::FindLeaf
+	 * @param size Size of leaf
+	 * @param first First component to interpolate
+	 * @param count Number of components to interpolate
+	 * @param F Returns components
+	 * @param dFidxj Returns spatial derivatives of components (optional)
+	 */
+	void Interpolate(const long leaf, const std::array<double, 3> &t, const std::array<double, 3> &size, const unsigned first, const unsigned count,
+					double F[], double dFidxj[][3]) const;
+
+	/**
+	 * Print number of leaves and nodes and memory usage
+	 *
+	 * @param out Stream to which information is written
+	 */
+	void PrintStatistics(std::ostream &out) const;
+
+public:
+	/**
+	 * Constructor
+	 *
+	 * Refines the octree level by level. Each cell deeper than two levels is checked by comparing its interpolation to the sampled field
+	 * at the centers of its edges, faces, and volume. If the error of any component exceeds the tolerance, the cell is split into octants.
+	 * Afterwards the achieved error and memory usage are printed.
+	 *
+	 * @param min Lower corner of bounding box
+	 * @param max Upper corner of bounding box
+	 * @param sampler Function sampling the field and its derivatives
+	 * @param withB Interpolate magnetic field
+	 * @param withV Interpolate electric potential
+	 * @param Btolerance Maximum allowed interpolation error of magnetic-field components
+	 * @param Vtolerance Maximum allowed interpolation error of electric potential
+	 * @param amaxdepth Maximum refinement depth, smallest cells are 2^-maxdepth times the bounding box
+	 * @param out Stream to which log messages are written
+	 */
+	TOctreeField(const std::array<double, 3> &min, const std::array<double, 3> &max, const sampler_type &sampler, const bool withB, const bool withV,
+				const double Btolerance, const double Vtolerance, const int amaxdepth, std::ostream &out = std::cout);
+
+	/**
+	 * Constructor
+	 *
+	 * Loads a binary file written by TOctreeField::Save.
+	 *
+	 * @param filename Path of binary file
+	 * @param out Stream to which log messages are written
+	 */
+	TOctreeField(const std::string &filename, std::ostream &out = std::cout);
+
+	/**
+	 * Save octree to a binary file.
+	 *
+	 * The file starts with the 16-character identifier "PENTrackOctree", followed by the format version, a bit mask of the stored components (B, V),
+	 * the maximum depth, a reserved field, the lower corner and size of the bounding box, and the number of tree nodes, leaves, and grid nodes
+	 * (4 uint32, 6 doubles, 3 uint64). It continues with the tree (int32), the corners of each leaf (8 uint32), and the grid-node data (doubles).
+	 * All numbers are stored in the native byte order.
+	 *
+	 * @param filename Path of binary file
+	 */
+	void Save(const std::string &filename) const;
+
+	/**
+	 * Get bounding box of octree
+	 *
+	 * @param min Returns lower corner
+	 * @param max Returns upper corner
+	 */
+	void GetBounds(double min[3], double max[3]) const;
+
+	/**
+	 * Get interpolated magnetic field at a specific point.
+	 *
+	 * For parameter doc see TField::BField.
+	 */
+	void BField(const double x, const double y, const double z, const double t, double B[3], double dBidxj[3][3]) const override;
+
+	/**
+	 * Get interpolated electric potential and field at a specific point.
+	 *
+	 * For parameter doc see TField::EField.
+	 */
+	void EField(const double x, const double y, const double z, const double t, double &V, double Ei[3]) const override;
+};
+
+
+/**
+ * Read binary octree file written by TOctreeField::Save
+ * @param params String containing parameters defined in config.in. Should contain field type "BINARYOCTREE", file name, magnetic field scaling formula, electric field scaling formula, and boundary width
+ * @param out Stream to which log messages are written
+ * @return Pointer to created class, derived from TField
+ */
+TFieldContainer ReadBinaryOctree(const std::string &params, std::ostream &out = std::cout);
+
+#endif // FIELD_OCTREE_H_
@@ -7,6 +7,11 @@
 #define FIELDS_H_
 
 #include <vector>
+#include <map>
+#include <string>
+#include <iostream>
+#include <memory>
+#include <array>
 
 #include "field.h"
 #include "config.h"
@@ -18,6 +23,59 @@
 class TFieldManager{
 private:
     std::vector< TFieldContainer > fields; ///< list of fields
+
+    /**
+     * Uniform grid over the bounding boxes of all fields, so each evaluation only visits fields which can be non-zero at that point.
+     *
+     * Each cell lists, in their original order, all fields without boundary and all fields whose bounding box overlaps the cell.
+     */
+    double gridmin[3]; ///< Lower corner of grid
+    double cellsize[3]; ///< Size of grid cells
+    int gridsize[3]; ///< Number of grid cells in each direction
+    std::vector<std::vector<size_t> > cells; ///< Indices of fields to visit in each cell
+    std::vector<size_t> unbounded; ///< Indices of fields without boundary, visited at points outside of the grid
+
+    /**
+     * Build the uniform grid after all fields were loaded
+     */
+    void BuildGrid();
+
+    /**
+     * Get list of fields that have to be visited at a point
+     *
+     * @param x Cartesian x coordinate
+     * @param y Cartesian y coordinate
+     * @param z Cartesian z coordinate
+     *
+     * @return Returns indices of fields
+     */
+    const std::vector<size_t>& FieldsAt(const double x, const double y, const double z) const;
+
+    /**
+     * Create field from its parameters in the [FIELDS] section of the configuration file
+     *
+     * @param params Field type followed by its parameters
+     * @param formulas [FORMULAS] section of the configuration file (null if not present)
+     * @param out Stream to which log messages are written
+     *
+     * @return Returns created field
+     */
+    static TFieldContainer LoadField(const std::string &params, const std::map<std::string, std::string> *formulas, std::ostream &out);
+
+    /**
+     * Create octree interpolation of the sum of several loaded fields from a BakedField entry in the [FIELDS] section
+     *
+     * The fields are sampled at t = 0 including their scaling formulas; time dependence has to be given in the scaling formula of the BakedField entry.
+     * The baked fields are removed from the list of loaded fields.
+     *
+     * @param params "BakedField", comma-separated list of field IDs, bounding box, tolerance, maximum depth, and scaling formula
+     * @param keys IDs of all fields in [FIELDS] section
+     * @param loaded Fields loaded from [FIELDS] section, in same order as keys
+     * @param out Stream to which log messages are written
+     *
+     * @return Returns created field
+     */
+    static TFieldContainer BakeFields(const std::string &params, const std::vector<std::string> &keys, std::vector<std::unique_ptr<TFieldContainer> > &loaded, std::ostream &out);
 		
 public:
 	TFieldManager(const TFieldManager &f) = delete; ///< TFieldManager is not copyable
@@ -26,7 +84,9 @@ public:
 	/**
 	 * Constructor.
 	 *
-	 * Reads [FIELDS] section of configuration file and loads all field maps/conductors given there
+	 * Reads [FIELDS] section of configuration file and loads all field maps/conductors given there.
+	 * Fields are loaded in parallel and their log messages are printed in the order of the configuration file.
+	 * Afterwards, fields listed in BakedField entries are replaced by their octree interpolation.
 	 *
 	 * @param conf TConfig map containing field options
 	 */
@@ -62,4 +122,71 @@ public:
 			double &V, double Ei[3]) const;
 };
 
+
+/**
+ * Cache of the most recent field samples along a particle track.
+ *
+ * The same points are evaluated several times per integration step: the integrator's last stage at the end of an accepted step (first same as last),
+ * the energy check, the spin integration, and the loggers. Samples are keyed by time and position, only exactly equal keys are reused.
+ * The cache holds a few samples, enough to keep the start and end points of a step while the integrator evaluates its intermediate stages.
+ * It is not thread-safe, each particle has its own cache.
+ */
+class TFieldCache{
+private:
+	/// Field values at one point
+	struct sample{
+		double t; ///< time
+		double x; ///< Cartesian x coordinate
+		double y; ///< Cartesian y coordinate
+		double z; ///< Cartesian z coordinate
+		bool hasB; ///< true if magnetic field was evaluated
+		bool hasdB; ///< true if magnetic-field derivatives were evaluated
+		bool hasE; ///< true if electric field was evaluated
+		double B[3]; ///< magnetic field
+		double dBidxj[3][3]; ///< spatial derivatives of magnetic field
+		double V; ///< electric potential
+		double Ei[3]; ///< electric field
+	};
+
+	static const unsigned size = 8; ///< number of cached samples, more than the six new stages of a dopri5 step
+	std::array<sample, size> samples; ///< cached samples
+	unsigned next; ///< index of oldest sample, overwritten by the next new point
+
+	/**
+	 * Find sample at a given point or replace oldest sample with an empty one
+	 *
+	 * @param x Cartesian x coordinate
+	 * @param y Cartesian y coordinate
+	 * @param z Cartesian z coordinate
+	 * @param t Time
+	 *
+	 * @return Returns sample at this point
+	 */
+	sample& Find(const double x, const double y, const double z, const double t);
+
+public:
+	/**
+	 * Constructor, creates empty cache
+	 */
+	TFieldCache();
+
+	/**
+	 * Get magnetic field from cache or from TFieldManager::BField
+	 *
+	 * For parameter doc see TFieldManager::BField.
+	 *
+	 * @param field Fields to evaluate on a cache miss
+	 */
+	void BField(const TFieldManager &field, const double x, const double y, const double z, const double t, double B[3], double dBidxj[3][3] = nullptr);
+
+	/**
+	 * Get electric field and potential from cache or from TFieldManager::EField
+	 *
+	 * For parameter doc see TFieldManager::EField.
+	 *
+	 * @param field Fields to evaluate on a cache miss
+	 */
+	void EField(const TFieldManager &field, const double x, const double y, const double z, const double t, double &V, double Ei[3]);
+};
+
 #endif // FIELDS_H_
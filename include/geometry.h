@@ -38,11 +38,14 @@ std::ostream& operator<<(std::ostream &str, const material &mat);
 
 /// Struct to store solid information (read from geometry.in)
 struct solid{
-	boost::filesystem::path filename; ///< name of file containing STL mesh
+	boost::filesystem::path filename; ///< name of file containing STL mesh, or type of analytic solid
 	std::string name; ///< name of solid
 	material mat; ///< material of solid
 	unsigned ID; ///< ID of solid
 	std::vector<std::pair<double, double> > ignoretimes; ///< pairs of times, between which the solid should be ignored
+	std::vector<double> primitive; ///< parameters of analytic solid (see CreatePrimitive), empty for STL meshes
+	std::vector<double> rotation; ///< optional rotation of the STL mesh around the origin, given as axis (x, y, z) and angle [degree]
+	std::vector<double> translation; ///< optional translation of the STL mesh, applied after rotation
 
 	/**
 	 * Comparison operator used to sort solids by priority (descending)
@@ -81,6 +84,20 @@ std::ostream& operator<<(std::ostream &str, const solid &sld);
 struct TGeometry{
 	private:
 		std::vector<solid> solids; ///< solids list
+		std::map<unsigned, size_t> solidindex; ///< index of each solid ID in solids list
+		std::vector<double> ignoretimesteps; ///< sorted list of all times at which any solid starts or stops being ignored
+		std::vector<std::vector<bool> > ignoredsolids; ///< for each interval between ignoretimesteps: ignore state of each solid in solids list
+
+		/**
+		 * Get index of time interval between ignoretimesteps containing time t
+		 *
+		 * @param t Time
+		 *
+		 * @return Index into ignoredsolids
+		 */
+		size_t GetTimeInterval(const double t) const{
+			return std::upper_bound(ignoretimesteps.begin(), ignoretimesteps.end(), t) - ignoretimesteps.begin();
+		}
 	public:
 		TTriangleMesh mesh; ///< kd-tree structure containing triangle meshes from STL-files
 		solid defaultsolid; ///< "vacuum", this solid's properties are used when the particle is not inside any other solid
@@ -109,18 +126,24 @@ struct TGeometry{
 		/**
 		 * Checks if line segment p1->p2 collides with a surface.
 		 *
-		 * Calls KDTree::Collision to check for collisions and removes all collisions
+		 * Calls TTriangleMesh::Collision to check for collisions and marks all collisions
 		 * which should be ignored (given by ignore times in geometry configuration file).
 		 *
+		 * If the list of solids the particle is currently inside is given, solids that are ignored during the whole segment
+		 * and that the particle is not inside of are skipped entirely. Their collisions would only be marked as ignored anyway.
+		 *
 		 * @param x1 Start time of line segment
 		 * @param p1 Start point of line segment
 		 * @param x2 End time of line segment
 		 * @param p2 End point of line segment
 		 * @param colls List of collisions, paired with bool indicator it it should be ignored
+		 * @param currentsolids Optional list of solids the particle is currently inside, enables skipping of ignored solids
+		 * @param cache Optional query cache of the particle's trajectory, see TMeshQueryCache
 		 *
 		 * @return Returns true if line segment collides with a surface
 		 */
-		bool GetCollisions(const double x1, const double p1[3], const double x2, const double p2[3], std::multimap<TCollision, bool> &colls) const;
+		bool GetCollisions(const double x1, const double p1[3], const double x2, const double p2[3], std::multimap<TCollision, bool> &colls,
+							const std::vector<std::pair<solid, bool> > *currentsolids = nullptr, TMeshQueryCache *cache = nullptr) const;
 		
 			
 		/**
@@ -7,6 +7,10 @@
 #include <string>
 #include <iostream>
 #include <atomic>
+#include <thread>
+#include <mutex>
+#include <exception>
+#include <algorithm>
 
 #include <boost/filesystem.hpp>
 
@@ -155,6 +159,50 @@ public:
     }
 };
 
+/**
+ * Call func(i) for all i in [0, n) distributed over several threads.
+ *
+ * Uses at most std::thread::hardware_concurrency() threads. If calls to func throw,
+ * the exception thrown for the lowest index is rethrown in the calling thread after all threads have finished.
+ *
+ * @param n Number of calls
+ * @param func Function object called with index i, calls for different indices have to be independent
+ */
+template<class Function> void parallel_for(const size_t n, Function func){
+    size_t nthreads = std::min<size_t>(std::max(std::thread::hardware_concurrency(), 1u), n);
+    if (nthreads <= 1){
+        for (size_t i = 0; i < n; ++i)
+            func(i);
+        return;
+    }
+    std::atomic<size_t> next(0);
+    std::mutex errmutex;
+    std::exception_ptr error;
+    size_t erroridx = n;
+    auto worker = [&](){
+        for (size_t i = next++; i < n; i = next++){
+            try{
+                func(i);
+            }
+            catch (...){
+                std::lock_guard<std::mutex> lock(errmutex);
+                if (i < erroridx){
+                    erroridx = i;
+                    error = std::current_exception();
+                }
+            }
+        }
+    };
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < nthreads; ++i)
+        threads.emplace_back(worker);
+    worker();
+    for (auto &t: threads)
+        t.join();
+    if (error)
+        std::rethrow_exception(error);
+}
+
 /**
  * Rotate a vector.
  *
@@ -1,70 +1,68 @@
 /**
  * \file
- * Header file for the implementation of a magnetic field determined by 
+ * Header file for the implementation of a magnetic field determined by
  * coefficients, provided as inputs by the user, of an expansion in
- * terms of harmonic polynomials. This implementation is based on the
- * work described in "Computation_summary.pdf" (!!! unfinished pls
- * update!)
+ * terms of harmonic polynomials, see https://arxiv.org/abs/1811.06085.
  */
 
 #ifndef HARMONICFIELD_H_
 #define HARMONICFIELD_H_
 
+#include <vector>
+#include <string>
+#include <array>
+#include <iostream>
+
 #include "field.h"
-#include <boost/math/special_functions/legendre.hpp>
-#include <boost/math/special_functions/factorials.hpp>
-#include <boost/math/tools/roots.hpp>
 
 /**
  * Nearly homogeneous magnetic field with small gradient.
  *
- * Typically used in nEDM experiments
+ * Typically used in nEDM experiments. The field is the gradient of the scalar potential
+ *
+ * Phi = sum_{l,m} G(l,m) C(l+1,|m|) r^(l+1) P_(l+1)^|m|(cos(theta)) cos(m phi) (m >= 0) or sin(|m| phi) (m < 0),
+ *
+ * with C(n,m) = (n-1)! (-2)^m/(n+m)!, which gives the harmonic polynomials of https://arxiv.org/abs/1811.06085 for any order l.
+ * The expansion is converted into polynomials in x, y, and z, including the rotation, when the field is created,
+ * so each evaluation only sums the precomputed monomials.
  */
 class HarmonicExpandedBField: public TField{
 private:
+	/// Monomial x^a y^b z^c with its coefficients in each field component or derivative
+	template<int N> struct term{
+		std::array<int, 3> exponents; ///< exponents a, b, c
+		std::array<double, N> coeff; ///< coefficient in each component
+	};
 
 	double xoff; ///< the x-coordinate offset from the origin
 	double yoff; ///< the y-coordinate offset from the origin
 	double zoff; ///< the z-coordinate offset from the origin
-	double Rot1[3][3]; ///< rotation matrix
-	double Rot2[3][3]; ///< rotation matrix
-	double Rot3[3][3]; ///< rotation matrix
-	double dB[9]; ///< Theory values for derivatives in the BField frame
-	double Bd[6][3]; ///< change in B field in this coordinate system to be transformed into original coordinate system
-
-	// the rotational axis does not have to be normalized for input, there is 
-	// a normalization to make it a unit vector within the program
-	double axis_x; // x-component of rotational axis
-	double axis_y; // y-component of rotational axis
-	double axis_z; // z-component of rotational axis
-	double angle;  // angle through which to rotate
-	double G[24]; ///< G parameters; coefficients of the harmonic expansion
+	int degree; ///< highest total degree of monomials in field components
+	std::vector<term<3> > Bterms; ///< monomials of magnetic-field components
+	std::vector<term<9> > dBterms; ///< monomials of spatial derivatives of magnetic-field components, index 3*i + j for dB_i/dx_j
 
 public:
+	static const int maxorder = 20; ///< highest supported order l of the expansion
+
 	/**
 	 * Magnetic field definition for the static B_0 field experienced by neutrons throughout the Ramsey cycle.
 	 *
-	 * Constructor requires:
+	 * The field is rotated as a whole, B'(x) = R B(R^T x), by a rotation R given by axis and angle.
 	 *
 	 * @param _xoff the x-coordinate offset from the origin
 	 * @param _yoff the y-coordinate offset from the origin
 	 * @param _zoff the z-coordinate offset from the origin
-	 * @param _axis_x the x-component of rotational axis
-	 * @param _axis_y the y-component of rotational axis
-	 * @param _axis_z the z-component of rotational axis
-	 * @param _angle the angle through which to rotate
-	 * @param G parameters; coefficients of the harmonic expansion
+	 * @param axis_x the x-component of rotational axis, it does not have to be normalized. If all components are zero, no rotation is performed
+	 * @param axis_y the y-component of rotational axis
+	 * @param axis_z the z-component of rotational axis
+	 * @param angle the angle through which to rotate
+	 * @param G coefficients of the harmonic expansion, ordered G(0,-1), G(0,0), G(0,1), G(1,-2), ..., G(l,l+1), missing coefficients of the highest order are zero
 	 */
-
 	HarmonicExpandedBField(const double _xoff, const double _yoff, const double _zoff,
-			const double _axis_x, const double _axis_y, const double _axis_z, const double _angle, 
-			const double G0, const double G1, const double G2, const double G3, const double G4, const double G5, const double G6, const double G7, const double G8, 
-			const double G9, const double G10, const double G11, const double G12, const double G13, const double G14, const double G15, const double G16, const double G17, 
-			const double G18, const double G19, const double G20, const double G21, const double G22, const double G23);
+			const double axis_x, const double axis_y, const double axis_z, const double angle, const std::vector<double> &G);
 
 	/**
-	 * The calculation for the B0 components are derived from a first order approximation of
-	 * an axially symmetric static magnetic field. See for example: http://physics.princeton.edu/~mcdonald/examples/axial.pdf
+	 * Sum precomputed monomials of magnetic field and its derivatives at a given point
 	 *
 	 * @param x the x-coordinate in the field's coordinate system
 	 * @param y the x-coordinate in the field's coordinate system
@@ -74,9 +72,9 @@ public:
 	 * @param dBidxj Returns spatial derivatives of magnetic-field components (optional)
 	**/
 	void BField(const double x, const double y, const double z, const double t, double B[3], double dBidxj[3][3]) const override;
-	
+
 	/**
-	 * Adds no electric field. 
+	 * Adds no electric field.
 	 * Required because we are inheriting from abstract class TField which has virtual void EField function.
 	 *
 	 * @param x Cartesian x coordinate
@@ -89,4 +87,16 @@ public:
 	void EField(const double x, const double y, const double z, const double t, double &V, double Ei[3]) const override {};
 };
 
-#endif /*HARMONICFIELD_H_*/
\ No newline at end of file
+
+/**
+ * Create HarmonicExpandedBField from parameters in configuration file
+ *
+ * @param params String containing parameters defined in config.in: field type "HarmonicExpandedBField", offsets, boundary width, bounding box, scaling formula,
+ * rotation axis and angle, followed by the list of coefficients G(l,m) or the name of a file containing them (whitespace-separated, lines starting with # are ignored)
+ * @param out Stream to which log messages are written
+ *
+ * @return Returns created field
+ */
+TFieldContainer ReadHarmonicExpandedBField(const std::string &params, std::ostream &out = std::cout);
+
+#endif /*HARMONICFIELD_H_*/
@@ -118,12 +118,13 @@ public:
      * Collects variables and passes them to the virtual Log function
      *
      * @param p Particle to be printed
+     * @param x1 Time of previous spin state, the spin state is only printed if x1 == x or if an integer multiple of spinloginterval lies between x1 and x
      * @param x Time to print the spin state at
-     * @param spinstepper Integration stepper used to interpolate spin trajectory
+     * @param spin Spin state at time x
      * @param trajectory_stepper Trajectory integrator used to calculate spin-precession axis at time t
      * @param field TFieldManager containing all electromagnetic fields
      */
-    void PrintSpin(const std::unique_ptr<TParticle>& p, const value_type x, const dense_stepper_type& spinstepper,
+    void PrintSpin(const std::unique_ptr<TParticle>& p, const value_type x1, const value_type x, const state_type &spin,
                    const dense_stepper_type &trajectory_stepper, const TFieldManager &field);
 
 };
@@ -18,6 +18,7 @@
 #include "fields.h"
 
 static const double MAX_TRACK_DEVIATION = 0.001; ///< max deviation of actual trajectory from straight line between start and end points of a step used for geometry-intersection test. If deviation is larger, the step will be split
+static const double MAX_SPIN_ROTATION_ERROR = 1e-10; ///< max estimated error of spin-rotation angle in each step of the spin integration [rad]
 static const int STATE_VARIABLES = 9; ///< number of variables in trajectory integration (position, velocity, proper time, polarization, path length)
 static const int SPIN_STATE_VARIABLES = 5; ///< number of variables in spin integration (spin vector, time, total phase)
 
@@ -61,6 +62,8 @@ private:
 	int Nstep; ///< number of integration steps
 
 	std::vector<std::unique_ptr<TParticle> > secondaries; ///< list of secondary particles
+
+	mutable TFieldCache fieldcache; ///< fields most recently sampled along the track, shared by integrator, energy calculation, spin tracking, and loggers
 public:
 	/**
 	 * Return name of particle
@@ -418,21 +421,6 @@ public:
 	 */
 	void SpinPrecessionAxis(const double t, const double B[3], const double E[3], const state_type &dydt, double &Omegax, double &Omegay, double &Omegaz) const;
 
-    /**
-	 * Equations of motion of spin vector.
-	 *
-	 * Calculates spin-precession axis either directly or from pre-calculated splines
-	 *
-	 * @param y Current spin vector
-	 * @param dydx Calculated time derivative of spin vector
-	 * @param x Current time
-	 * @param stepper Trajectory integrator used to calculate spin-precession axis
-	 * @param field TFieldManager used to calculate magnetic and electric fields
-	 * @param omega_int Vector of three splines used to interpolate spin-precession axis (can be empty)
-	 */
-	void SpinDerivs(const state_type &y, state_type &dydx, const value_type x,
-			const dense_stepper_type &stepper, const TFieldManager *field, const std::vector<alglib::spline1dinterpolant> &omega_int) const;
-
 	/**
 	 * Calculate kinetic energy.
 	 *
@@ -512,6 +500,32 @@ public:
 	 * @return Returns potential energy [eV]
 	 */
 	virtual double GetPotentialEnergy(const value_type t, const state_type &y, const TFieldManager &field, const solid &sld) const;
+
+	/**
+	 * Get magnetic field at the particle's position, reusing values already calculated at the same time and position
+	 *
+	 * @param t Time
+	 * @param y Coordinate vector
+	 * @param field TFieldManager used to calculate magnetic field
+	 * @param B Returns magnetic field
+	 * @param dBidxj Returns spatial derivatives of magnetic field (optional)
+	 */
+	void GetMagneticField(const value_type t, const state_type &y, const TFieldManager &field, double B[3], double dBidxj[3][3] = nullptr) const{
+		fieldcache.BField(field, y[0], y[1], y[2], t, B, dBidxj);
+	};
+
+	/**
+	 * Get electric field and potential at the particle's position, reusing values already calculated at the same time and position
+	 *
+	 * @param t Time
+	 * @param y Coordinate vector
+	 * @param field TFieldManager used to calculate electric field
+	 * @param V Returns electric potential
+	 * @param E Returns electric field
+	 */
+	void GetElectricField(const value_type t, const state_type &y, const TFieldManager &field, double &V, double E[3]) const{
+		fieldcache.EField(field, y[0], y[1], y[2], t, V, E);
+	};
 };
 
 #endif // PARTICLE_H__
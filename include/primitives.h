@@ -0,0 +1,205 @@
+/**
+ * \file
+ * Analytic solids (sphere, box, cylinder, tube, cone) that can be used instead of STL meshes.
+ *
+ * Intersections, point-inside tests and surface sampling are calculated in closed form,
+ * which is exact and much faster than testing a finely tessellated STL mesh.
+ */
+
+#ifndef PRIMITIVES_H_
+#define PRIMITIVES_H_
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <utility>
+
+#include "trianglemesh.h"
+
+/**
+ * Virtual base class of all analytic solids
+ */
+class TPrimitive{
+public:
+	/**
+	 * Destructor
+	 */
+	virtual ~TPrimitive(){ }
+
+	/**
+	 * Find all intersections of a segment with the surface of the solid
+	 *
+	 * @param segment Line segment
+	 * @param hits Intersection points, paired with outward normal (length = 1) of surface at that point, are appended to this list
+	 */
+	virtual void Intersections(const CSegment &segment, std::vector<std::pair<CPoint, CVector> > &hits) const = 0;
+
+	/**
+	 * Test if point is inside the solid
+	 *
+	 * @param p Point
+	 *
+	 * @return Returns true if point is inside
+	 */
+	virtual bool Inside(const CPoint &p) const = 0;
+
+	/**
+	 * Get bounding box of solid
+	 *
+	 * @return Returns bounding box
+	 */
+	virtual CCuboid BoundingBox() const = 0;
+
+	/**
+	 * Get surface area of solid
+	 *
+	 * @return Returns surface area
+	 */
+	virtual double Area() const = 0;
+
+	/**
+	 * Map three uniformly distributed random numbers to a point on the surface, uniformly distributed over the surface area
+	 *
+	 * @param u1 Uniformly distributed random number in [0, 1)
+	 * @param u2 Uniformly distributed random number in [0, 1)
+	 * @param u3 Uniformly distributed random number in [0, 1)
+	 * @param p Returns point on surface
+	 * @param n Returns outward normal (length = 1) of surface at p
+	 */
+	virtual void SurfacePoint(const double u1, const double u2, const double u3, CPoint &p, CVector &n) const = 0;
+};
+
+
+/**
+ * Sphere
+ */
+class TSpherePrimitive: public TPrimitive{
+private:
+	CPoint center; ///< Center of sphere
+	double radius; ///< Radius of sphere
+public:
+	/**
+	 * Constructor
+	 *
+	 * @param acenter Center of sphere
+	 * @param aradius Radius of sphere
+	 */
+	TSpherePrimitive(const CPoint &acenter, const double aradius);
+	void Intersections(const CSegment &segment, std::vector<std::pair<CPoint, CVector> > &hits) const override;
+	bool Inside(const CPoint &p) const override;
+	CCuboid BoundingBox() const override;
+	double Area() const override;
+	void SurfacePoint(const double u1, const double u2, const double u3, CPoint &p, CVector &n) const override;
+};
+
+
+/**
+ * Axis-aligned box
+ */
+class TBoxPrimitive: public TPrimitive{
+private:
+	CCuboid box; ///< Box
+public:
+	/**
+	 * Constructor
+	 *
+	 * @param abox Box
+	 */
+	TBoxPrimitive(const CCuboid &abox);
+	void Intersections(const CSegment &segment, std::vector<std::pair<CPoint, CVector> > &hits) const override;
+	bool Inside(const CPoint &p) const override;
+	CCuboid BoundingBox() const override;
+	double Area() const override;
+	void SurfacePoint(const double u1, const double u2, const double u3, CPoint &p, CVector &n) const override;
+};
+
+
+/**
+ * Solid of revolution bounded by an outer and an optional inner cone frustum between two parallel end caps.
+ *
+ * Covers cylinders, tubes and (truncated) cones.
+ */
+class TAxialPrimitive: public TPrimitive{
+private:
+	CPoint start; ///< Center of first end cap
+	CVector axis; ///< Unit vector pointing from first to second end cap
+	CVector e1; ///< Unit vector perpendicular to axis
+	CVector e2; ///< Unit vector perpendicular to axis and e1
+	double length; ///< Distance between end caps
+	double router[2]; ///< Outer radius at first and second end cap
+	double rinner[2]; ///< Inner radius at first and second end cap, zero for solid bodies
+
+	/**
+	 * Calculate intersections of segment with inner or outer lateral surface
+	 *
+	 * @param segment Line segment
+	 * @param r Radii of lateral surface at first and second end cap
+	 * @param outward Normal points away from axis if true, towards axis if false
+	 * @param hits Intersection points are appended to this list
+	 */
+	void LateralIntersections(const CSegment &segment, const double r[2], const bool outward, std::vector<std::pair<CPoint, CVector> > &hits) const;
+
+	/**
+	 * Get area of outer or inner lateral surface
+	 *
+	 * @param r Radii of lateral surface at first and second end cap
+	 *
+	 * @return Area
+	 */
+	double LateralArea(const double r[2]) const;
+
+	/**
+	 * Get area of end cap
+	 *
+	 * @param i Index of end cap (0 or 1)
+	 *
+	 * @return Area
+	 */
+	double CapArea(const int i) const;
+public:
+	/**
+	 * Constructor
+	 *
+	 * @param p1 Center of first end cap
+	 * @param p2 Center of second end cap
+	 * @param r1 Outer radius at first end cap
+	 * @param r2 Outer radius at second end cap
+	 * @param ri1 Inner radius at first end cap
+	 * @param ri2 Inner radius at second end cap
+	 */
+	TAxialPrimitive(const CPoint &p1, const CPoint &p2, const double r1, const double r2, const double ri1 = 0, const double ri2 = 0);
+	void Intersections(const CSegment &segment, std::vector<std::pair<CPoint, CVector> > &hits) const override;
+	bool Inside(const CPoint &p) const override;
+	CCuboid BoundingBox() const override;
+	double Area() const override;
+	void SurfacePoint(const double u1, const double u2, const double u3, CPoint &p, CVector &n) const override;
+};
+
+
+/**
+ * Get number of parameters of an analytic solid type
+ *
+ * @param type Name of solid type (sphere, box, cylinder, tube, cone)
+ *
+ * @return Returns number of parameters, or -1 if type is not an analytic solid
+ */
+int PrimitiveParameterCount(const std::string &type);
+
+
+/**
+ * Create analytic solid
+ *
+ * sphere: x y z r
+ * box: xmin xmax ymin ymax zmin zmax
+ * cylinder: x1 y1 z1 x2 y2 z2 r
+ * tube: x1 y1 z1 x2 y2 z2 rinner router
+ * cone: x1 y1 z1 x2 y2 z2 r1 r2
+ *
+ * @param type Name of solid type
+ * @param params List of parameters
+ *
+ * @return Returns analytic solid
+ */
+std::shared_ptr<TPrimitive> CreatePrimitive(const std::string &type, const std::vector<double> &params);
+
+#endif // PRIMITIVES_H_
@@ -317,9 +317,7 @@ public:
 	 */
 	TSTLVolumeSource(std::map<std::string, std::string> &sourceconf):
 			TVolumeSource(sourceconf){
-		boost::filesystem::path STLfile;
-		std::istringstream(sourceconf["STLfile"]) >> STLfile;
-		sourcevol.ReadFile(boost::filesystem::absolute(STLfile, configpath.parent_path()).native(), 0);
+		sourcevol.ReadSolid(sourceconf["STLfile"], 0, configpath.parent_path());
 	}
 };
 
@@ -374,9 +372,7 @@ public:
 	 * @param sourceconf Map of source options
 	 */
 	explicit TSTLSurfaceSource(std::map<std::string, std::string> &sourceconf): TSurfaceSource(sourceconf){
-	    boost::filesystem::path STLfile;
-	    std::istringstream(sourceconf["STLfile"]) >> STLfile;
-	    sourcevol.ReadFile(boost::filesystem::absolute(STLfile, configpath.parent_path()).native(), 0);
+	    sourcevol.ReadSolid(sourceconf["STLfile"], 0, configpath.parent_path());
 	}
 };
 
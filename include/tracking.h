@@ -17,6 +17,7 @@
 class TTracker {
 private:
     std::vector<std::pair<solid, bool> > currentsolids; ///< solids in which particle is currently inside
+    TMeshQueryCache querycache; ///< cache speeding up collision checks of consecutive trajectory segments
     std::unique_ptr<TLogger> logger; ///< class to log particle states
 public:
     /**
@@ -130,7 +131,8 @@ private:
     /**
      * Simulate spin precession
      *
-     * Integrates general BMT equation over one time step.
+     * Integrates general BMT equation over one time step with a fourth-order Magnus integrator.
+     * Each spin-integration step rotates the spin vector exactly, so its length is preserved, and the step size is limited by the change of the precession axis, see MAX_SPIN_ROTATION_ERROR.
      * If the conditions given by times and Bmax are not fulfilled, the spin vector will simply be rotated along the magnetic field, keeping the spin projection onto the magnetic field constant.
      *
      * @param p Particle
@@ -1,268 +1,433 @@
-/**
- * \file
- * This algorithm uses the CGAL AABB_tree structure to search
- * for collisions with a surface consisting of a list
- * of triangles.
- * Initially, the triangles are read from a set of STL-files
- * (http://www.ennex.com/~fabbers/StL.asp)	via
- * ReadFile(filename,surfacetype) and stored in the AABB_tree
- * via Init().
- * You can define a surfacetype for each file which is
- * returned on collision tests to identify different surfaces
- * during runtime.
- * During runtime segments point1->point2 can be checked for
- * intersection with the surface via
- * Collision(point1,point2,list of TCollision). Collision returns
- * true if an intersection occurred and gives the parametric
- * coordinate s of the intersection point (I=p1+s*(p2-p1)),
- * the normal n and the surfacetype of the intersected surface.
- *
- */
-
-#ifndef TRIANGLEMESH_H_
-#define TRIANGLEMESH_H_
-
-#include <vector>
-#include <memory>
-#include <random>
-
-#include <algorithm>
-
-#include <CGAL/Simple_cartesian.h>
-#include <CGAL/AABB_tree.h>
-#include <CGAL/AABB_traits.h>
-#include <CGAL/AABB_face_graph_triangle_primitive.h>
-#include <CGAL/Surface_mesh.h>
-#include <CGAL/Side_of_triangle_mesh.h>
-#include <CGAL/Polygon_mesh_processing/compute_normal.h>
-
-static const double REFLECT_TOLERANCE = 1e-8;  ///< max distance of reflection point to actual surface collision point
-
-typedef CGAL::Simple_cartesian<double> CKernel; ///< Geometric Kernel used for CGAL types
-typedef CKernel::Segment_3 CSegment; ///< CGAL segment type
-typedef CKernel::Point_3 CPoint; ///< CGAL point type
-typedef CKernel::Vector_3 CVector; ///< CGAL vector type
-typedef CKernel::Iso_cuboid_3 CCuboid; ///< CGAL cuboid type
-
-typedef CGAL::Surface_mesh<CPoint> CMesh; ///< CGAL triangle mesh type
-typedef CGAL::AABB_face_graph_triangle_primitive<CMesh> CPrimitive; ///< CGAL triangle type contained in AABB tree
-typedef CGAL::AABB_traits<CKernel, CPrimitive> CTraits; ///< CGAL triangle traits type
-typedef CGAL::AABB_tree<CTraits> CTree; ///< CGAL AABB tree type containing CPrimitives
-typedef boost::optional< CTree::Intersection_and_primitive_id<CSegment>::Type > CIntersection; ///< CGAL segment-triangle intersection type
-
-
-/**
- * Structure returned by TTriangleMesh::Collision.
- */
-struct TCollision{
-	double s; ///< parametric coordinate of intersection point (P = p1 + s*(p2 - p1))
-	double normal[3]; ///< normal (length = 1) of intersected surface
-	unsigned ID; ///< ID of solid the intersected surface belongs to
-	double distnormal; ///< distance between start- and endpoint of colliding segment, projected onto normal direction
-
-	/**
-	 * Create TCollision object
-	 *
-	 * @param segment Segment that collided with mesh
-	 * @param n Normal vector of hit surface
-	 * @param point Collision point
-	 * @param aID ID of hit surface
-	 */
-	TCollision(const CSegment &segment, const CVector &n, const CPoint &point, const unsigned aID){
-      s = /*std::min(1., std::max(0.,*/ (point - segment.start())*segment.to_vector()/segment.squared_length()/*))*/;
-      ID = aID;
-      normal[0] = n[0];
-      normal[1] = n[1];
-      normal[2] = n[2];
-      distnormal = segment.to_vector()*n;
-    };
-
-	/**
-	 * Overloaded operator, needed for sorting
-	 * 
-	 * Ascending distance along segment, descending ID if distance equal
-	 */
-	inline bool operator < (const TCollision c) const {
-		if (s == c.s)
-			return ID > c.ID;
-		else
-			return s < c.s;
-	};
-};
-
-
-
-/**
- * Class to hold your STL geometry and do intersection tests.
- */
-class TTriangleMesh{
-private:
-	/**
-	 * Class containing triangle mesh and AABB tree for each loaded StL file
-	 */
-    struct CTriangleMesh{
-        std::unique_ptr<CMesh> mesh; ///< Triangle mesh
-        std::unique_ptr<CTree> tree; ///< Axis-aligned bounding-box tree for fast intersection search
-        int ID; ///< unique ID for each StL file
-        std::discrete_distribution<size_t> triangle_sampler; ///< Probability distribution to randomly sample triangles from mesh weighted by their areas.
-    };
-	std::vector<CTriangleMesh> meshes; ///< List of triangle meshes from all loaded StL files
-	std::discrete_distribution<size_t> mesh_sampler; ///< Probability distribution to randomly sample meshes weighted by their areas
-
-public:
-	/**
-	 * Read STL-file.
-	 *
-	 * @param filename Filename of STL file
-	 * @param ID ID of solid assigned to this STL file
-	 *
-	 * @return Returns name of mesh in file
-	 */
-	std::string ReadFile(const std::string &filename, const int ID);
-
-	/**
-	 * Test line segment p1->p2 for collision with all triangles in previously read files.
-	 *
-	 * @param p1 Line start point
-	 * @param p2 Line end point
-	 *
-	 * @return Returns vector containing collisions
-	 */
-	std::vector<TCollision> Collision(const std::vector<double> &p1, const std::vector<double> &p2) const;
-
-	/**
-	 * Test if point is inside the mesh
-	 *
-	 * @param p Point
-	 *
-	 * @return Returns true if point is inside the mesh
-	 */
-	template<typename T> bool InSolid(const T p[3]) const{
-		return InSolid(p[0], p[1], p[2]);
-	}
-
-	/**
-	 * Get overall bounding box containing all meshes
-	 * 
-	 * @return Overall bounding box.
-	 */
-	CCuboid GetBoundingBox() const{
-	    std::vector<CCuboid> b;
-	    std::transform(meshes.begin(), meshes.end(), std::back_inserter(b), [](const CTriangleMesh &m){ return m.tree->bbox(); });
-	    return CGAL::bbox_3(b.begin(), b.end());
-	}
-
-	/**
-	 * Test if point is inside the mesh
-	 *
-	 * @param x X coordinate of point
-	 * @param y Y coordinate of point
-	 * @param z Z coordinate of point
-	 *
-	 * @return Returns true if point inside the mesh
-	 */
-	bool InSolid(const double x, const double y, const double z) const;
-	/**
-	  * Test if point is inside the mesh
-	  *
-	  * @param p Point
-	  *
-	  * @return Returns true if point is inside the mesh
-	  */
-	template<class Point> bool InSolid(Point p) const{
-		return InSolid(p[0], p[1], p[2]);
-	}
-
-	/**
-	 * Return list of solids the point is inside of
-	 * @param p Point
-	 * @return List of solid IDs
-	 */
-    template<class Point> std::vector<unsigned> GetSolids(Point p) const{
-        std::vector<unsigned> solids;
-        for (auto &m: meshes){
-            if (m.tree->number_of_intersected_primitives(CKernel::Ray_3(CPoint(p[0],p[1],p[2]), CVector(0., 0., 1.))) % 2 != 0)
-                solids.push_back(m.ID);
-        }
-        return solids;
-    }
-
-	/**
-	 * Check if point is contained in bounding box
-	 * 
-	 * @param p Point
-	 * 
-	 * @return Returns true if point is contained in bounding box
-	 */
-	template<class Object> bool InBoundingBox(Object p) const{
-        return std::any_of(meshes.begin(), meshes.end(), [&p](const CTriangleMesh &mesh){ return CGAL::do_intersect(p, mesh.tree->bbox()); });
-	}
-
-	/**
-	 * Return random point on surface
-	 * 
-	 * @param p Returned point
-	 * @param n Returned normal vector of surface at point
-	 * @param ID Returned ID of surface at point
-	 * @param rand Random number generator
-	 * @param bbox Bounding box that point should be contained in
-	 */
-	template<class Point, class Vector, class RandomGenerator, class BoundingBox> void RandomPointOnSurface(Point &p, Vector &n, unsigned &ID, RandomGenerator &rand, BoundingBox bbox){
-        size_t meshidx;
-        do{
-            meshidx = mesh_sampler(rand);
-        }while (not CGAL::do_intersect(meshes[meshidx].tree->bbox(), bbox));
-        ID = meshes[meshidx].ID;
-        CMesh::Face_index faceidx(meshes[meshidx].triangle_sampler(rand));
-        std::vector<CPoint> vertices;
-        for (auto v: meshes[meshidx].mesh->vertices_around_face(meshes[meshidx].mesh->halfedge(faceidx))) {
-            vertices.push_back(meshes[meshidx].mesh->point(v));
-        }
-        std::uniform_real_distribution<double> unidist(0, 1);
-        double a = unidist(rand); // generate random point on triangle (see Numerical Recipes 3rd ed., p. 1114)
-        double b = unidist(rand);
-        if (a+b > 1){
-            a = 1 - a;
-            b = 1 - b;
-        }
-        CPoint pp = vertices[0] + a*(vertices[1] - vertices[0]) + b*(vertices[2] - vertices[0]);
-        CVector nv = CGAL::Polygon_mesh_processing::compute_face_normal(faceidx, *meshes[meshidx].mesh);
-        p = {pp.x(), pp.y(), pp.z()};
-        n = {nv.x(), nv.y(), nv.z()};
-	}
-
-	/**
-	 * Return random point in volume bounded by mesh
-	 * 
-	 * @param rand Random number generator
-	 * 
-	 * @return Point
-	 */
-	template<class RandomGenerator> std::array<double, 3> RandomPointInVolume(RandomGenerator &rand) const{
-        std::array<double, 3> p;
-        do{
-            p = RandomPointInBoundingBox(rand);
-        }while (!InSolid(p));
-        return p;
-    }
-
-	/**
-	 * Return random point in bounding box
-	 * 
-	 * @param rand Random number generator
-	 * 
-	 * @return Point
-	 */
-    template<class RandomGenerator> std::array<double, 3> RandomPointInBoundingBox(RandomGenerator &rand) const{
-        std::vector<double> bvols;
-        std::transform(meshes.begin(), meshes.end(), std::back_inserter(bvols), [](const CTriangleMesh &mesh){ return CCuboid(mesh.tree->bbox()).volume(); });
-        std::discrete_distribution<unsigned> dist(bvols.begin(), bvols.end());
-        CCuboid bbox = meshes[dist(rand)].tree->bbox();
-        std::uniform_real_distribution<double> unidist(0, 1);
-        return {bbox.xmin() + unidist(rand)*(bbox.xmax() - bbox.xmin()),
-                bbox.ymin() + unidist(rand)*(bbox.ymax() - bbox.ymin()),
-                bbox.zmin() + unidist(rand)*(bbox.zmax() - bbox.zmin())};
-    }
-};
-
-#endif // TRIANGLEMESH_H_
+/**
+ * \file
+ * This algorithm uses the CGAL AABB_tree structure to search
+ * for collisions with a surface consisting of a list
+ * of triangles.
+ * Initially, the triangles are read from a set of STL-files
+ * (http://www.ennex.com/~fabbers/StL.asp)	via
+ * ReadFile(filename,surfacetype) and stored in the AABB_tree
+ * via Init().
+ * You can define a surfacetype for each file which is
+ * returned on collision tests to identify different surfaces
+ * during runtime.
+ * During runtime segments point1->point2 can be checked for
+ * intersection with the surface via
+ * Collision(point1,point2,list of TCollision). Collision returns
+ * true if an intersection occurred and gives the parametric
+ * coordinate s of the intersection point (I=p1+s*(p2-p1)),
+ * the normal n and the surfacetype of the intersected surface.
+ *
+ */
+
+#ifndef TRIANGLEMESH_H_
+#define TRIANGLEMESH_H_
+
+#include <vector>
+#include <memory>
+#include <random>
+
+#include <algorithm>
+
+#include <CGAL/Simple_cartesian.h>
+#include <CGAL/AABB_tree.h>
+#include <CGAL/AABB_traits.h>
+#include <CGAL/AABB_face_graph_triangle_primitive.h>
+#include <CGAL/Surface_mesh.h>
+#include <CGAL/Side_of_triangle_mesh.h>
+#include <CGAL/Polygon_mesh_processing/compute_normal.h>
+
+#include <boost/filesystem.hpp>
+
+static const double REFLECT_TOLERANCE = 1e-8;  ///< max distance of reflection point to actual surface collision point
+
+typedef CGAL::Simple_cartesian<double> CKernel; ///< Geometric Kernel used for CGAL types
+typedef CKernel::Segment_3 CSegment; ///< CGAL segment type
+typedef CKernel::Point_3 CPoint; ///< CGAL point type
+typedef CKernel::Vector_3 CVector; ///< CGAL vector type
+typedef CKernel::Iso_cuboid_3 CCuboid; ///< CGAL cuboid type
+typedef CKernel::Aff_transformation_3 CTransform; ///< CGAL affine transformation type
+
+typedef CGAL::Surface_mesh<CPoint> CMesh; ///< CGAL triangle mesh type
+typedef CGAL::AABB_face_graph_triangle_primitive<CMesh> CPrimitive; ///< CGAL triangle type contained in AABB tree
+typedef CGAL::AABB_traits<CKernel, CPrimitive> CTraits; ///< CGAL triangle traits type
+typedef CGAL::AABB_tree<CTraits> CTree; ///< CGAL AABB tree type containing CPrimitives
+typedef boost::optional< CTree::Intersection_and_primitive_id<CSegment>::Type > CIntersection; ///< CGAL segment-triangle intersection type
+
+
+/**
+ * Structure returned by TTriangleMesh::Collision.
+ */
+struct TCollision{
+	double s; ///< parametric coordinate of intersection point (P = p1 + s*(p2 - p1))
+	double normal[3]; ///< normal (length = 1) of intersected surface
+	unsigned ID; ///< ID of solid the intersected surface belongs to
+	double distnormal; ///< distance between start- and endpoint of colliding segment, projected onto normal direction
+
+	/**
+	 * Create TCollision object
+	 *
+	 * @param segment Segment that collided with mesh
+	 * @param n Normal vector of hit surface
+	 * @param point Collision point
+	 * @param aID ID of hit surface
+	 */
+	TCollision(const CSegment &segment, const CVector &n, const CPoint &point, const unsigned aID){
+      s = /*std::min(1., std::max(0.,*/ (point - segment.start())*segment.to_vector()/segment.squared_length()/*))*/;
+      ID = aID;
+      normal[0] = n[0];
+      normal[1] = n[1];
+      normal[2] = n[2];
+      distnormal = segment.to_vector()*n;
+    };
+
+	/**
+	 * Overloaded operator, needed for sorting
+	 * 
+	 * Ascending distance along segment, descending ID if distance equal
+	 */
+	inline bool operator < (const TCollision c) const {
+		if (s == c.s)
+			return ID > c.ID;
+		else
+			return s < c.s;
+	};
+};
+
+
+/**
+ * Per-trajectory cache speeding up TTriangleMesh::Collision for consecutive, spatially adjacent segments.
+ *
+ * For each mesh it remembers a box around a recent segment end that does not touch the surface,
+ * so segments inside it can skip the mesh entirely,
+ * and the triangles near the last segment that hit the mesh,
+ * so shorter segments inside that region (e.g. during collision-point iteration) do not have to descend the AABB tree.
+ * Segments leaving the cached regions fall back to a full query, which also refreshes the cache.
+ */
+struct TMeshQueryCache{
+	/**
+	 * Cached regions of a single mesh, in mesh coordinates
+	 */
+	struct Entry{
+		CCuboid freeregion; ///< Box around a recent segment end that does not touch the surface
+		bool hasfreeregion = false; ///< True if freeregion is valid
+		unsigned backoff = 0; ///< Number of queries to wait before freeregion is updated again, doubled each time an update failed to find a useful box
+		unsigned countdown = 0; ///< Remaining queries until freeregion may be updated again
+		CCuboid region; ///< Region around last segment that hit the surface
+		std::vector<CMesh::Face_index> candidates; ///< All triangles intersecting the region, empty if there is no region
+	};
+	std::vector<Entry> entries; ///< Cached regions of each mesh, in the order they were read
+};
+
+
+class TPrimitive;
+
+/**
+ * Class to hold your STL geometry and do intersection tests.
+ *
+ * Besides STL meshes it can also contain analytic solids (see primitives.h).
+ */
+class TTriangleMesh{
+private:
+	/**
+	 * Class containing triangle mesh and AABB tree for each loaded StL file, or an analytic solid
+	 */
+    struct CTriangleMesh{
+        std::shared_ptr<const CMesh> mesh; ///< Triangle mesh, shared between solids loaded from identical files
+        std::shared_ptr<const CTree> tree; ///< Axis-aligned bounding-box tree for fast intersection search, shared like mesh
+        std::shared_ptr<const TPrimitive> primitive; ///< Analytic solid, used instead of mesh and tree if set
+        int ID; ///< unique ID for each StL file
+        std::discrete_distribution<size_t> triangle_sampler; ///< Probability distribution to randomly sample triangles from mesh weighted by their areas.
+        bool transformed; ///< True if mesh is placed with a rigid transformation
+        CTransform transform; ///< Rigid transformation from mesh coordinates to global coordinates
+        CTransform inverse; ///< Inverse of transform
+    };
+	std::vector<CTriangleMesh> meshes; ///< List of triangle meshes from all loaded StL files
+	std::discrete_distribution<size_t> mesh_sampler; ///< Probability distribution to randomly sample meshes weighted by their areas
+
+	/**
+	 * Read STL-file, repair and validate the mesh and build its AABB tree.
+	 *
+	 * Does not touch any member, so several files can be loaded concurrently.
+	 *
+	 * @param filename Filename of STL file
+	 * @param ID ID of solid assigned to this STL file
+	 * @param mergecoplanar Merge adjacent coplanar triangles and retriangulate each planar region with as few triangles as possible
+	 * @param sldname Returns name of mesh in file
+	 * @param out Stream receiving log output
+	 * @param err Stream receiving warnings
+	 *
+	 * @return Returns loaded mesh
+	 */
+	static CTriangleMesh LoadFile(const std::string &filename, const int ID, const bool mergecoplanar, std::string &sldname, std::ostream &out, std::ostream &err);
+
+	/**
+	 * Get bounding box of mesh in global coordinates
+	 *
+	 * @param m Mesh
+	 *
+	 * @return Bounding box of mesh, including its transformation
+	 */
+	static CCuboid MeshBoundingBox(const CTriangleMesh &m);
+
+	/**
+	 * Test if point is inside mesh by counting intersections of a ray starting at the point
+	 *
+	 * @param m Mesh
+	 * @param p Point in global coordinates
+	 *
+	 * @return Returns true if point is inside mesh
+	 */
+	static bool InMesh(const CTriangleMesh &m, const CPoint &p);
+
+	/**
+	 * Get surface area of mesh
+	 *
+	 * @param m Mesh
+	 *
+	 * @return Surface area
+	 */
+	static double MeshArea(const CTriangleMesh &m);
+
+	/**
+	 * Map three uniformly distributed random numbers to a point on the surface of an analytic solid, in global coordinates
+	 *
+	 * @param m Mesh containing analytic solid
+	 * @param u1 Uniformly distributed random number
+	 * @param u2 Uniformly distributed random number
+	 * @param u3 Uniformly distributed random number
+	 * @param p Returns point on surface
+	 * @param n Returns normal of surface at p
+	 */
+	static void PrimitiveSurfacePoint(const CTriangleMesh &m, const double u1, const double u2, const double u3, CPoint &p, CVector &n);
+
+	/**
+	 * Find intersections of segment with a mesh, using and updating a query cache
+	 *
+	 * @param m Mesh
+	 * @param segment Segment in mesh coordinates
+	 * @param cache Cached regions of this mesh
+	 * @param out Intersections are appended to this list
+	 */
+	static void CachedIntersections(const CTriangleMesh &m, const CSegment &segment, TMeshQueryCache::Entry &cache, std::vector<CIntersection> &out);
+
+	/**
+	 * Update mesh_sampler after meshes were added
+	 */
+	void UpdateMeshSampler();
+
+public:
+	/**
+	 * Read STL-file.
+	 *
+	 * @param filename Filename of STL file
+	 * @param ID ID of solid assigned to this STL file
+	 * @param mergecoplanar Merge adjacent coplanar triangles and retriangulate each planar region with as few triangles as possible
+	 *
+	 * @return Returns name of mesh in file
+	 */
+	std::string ReadFile(const std::string &filename, const int ID, const bool mergecoplanar = false);
+
+	/**
+	 * Read several STL-files in parallel.
+	 *
+	 * Log output of each file is buffered and printed in the order of the list, followed by its load time.
+	 * Files with identical canonical path or identical content are loaded only once and share mesh and AABB tree.
+	 *
+	 * @param files List of STL filenames paired with the IDs of the solids assigned to them
+	 * @param mergecoplanar Merge adjacent coplanar triangles and retriangulate each planar region with as few triangles as possible
+	 *
+	 * @return Returns names of meshes in files, in the same order as files
+	 */
+	std::vector<std::string> ReadFiles(const std::vector<std::pair<std::string, int> > &files, const bool mergecoplanar = false);
+
+	/**
+	 * Place all meshes with given ID with a rigid transformation
+	 *
+	 * @param ID ID of solid
+	 * @param transform Rigid transformation (rotation and translation) from mesh coordinates to global coordinates
+	 */
+	void SetTransform(const int ID, const CTransform &transform);
+
+	/**
+	 * Add analytic solid
+	 *
+	 * @param primitive Analytic solid
+	 * @param ID ID of solid
+	 */
+	void AddPrimitive(const std::shared_ptr<const TPrimitive> &primitive, const int ID);
+
+	/**
+	 * Read STL-file or create analytic solid from description
+	 *
+	 * @param description Either filename of STL-file or type of analytic solid followed by its parameters (see CreatePrimitive)
+	 * @param ID ID of solid
+	 * @param basepath Relative filenames are interpreted relative to this path
+	 *
+	 * @return Returns name of mesh in file or type of analytic solid
+	 */
+	std::string ReadSolid(const std::string &description, const int ID, const boost::filesystem::path &basepath);
+
+	/**
+	 * Test line segment p1->p2 for collision with all triangles in previously read files.
+	 *
+	 * @param p1 Line start point
+	 * @param p2 Line end point
+	 * @param skip Optional mask, meshes with skip[i] == true (in the order they were read) are not tested
+	 * @param cache Optional query cache of the trajectory the segment belongs to, is updated by the query
+	 *
+	 * @return Returns vector containing collisions
+	 */
+	std::vector<TCollision> Collision(const std::vector<double> &p1, const std::vector<double> &p2, const std::vector<bool> &skip = std::vector<bool>(),
+										TMeshQueryCache *cache = nullptr) const;
+
+	/**
+	 * Test if point is inside the mesh
+	 *
+	 * @param p Point
+	 *
+	 * @return Returns true if point is inside the mesh
+	 */
+	template<typename T> bool InSolid(const T p[3]) const{
+		return InSolid(p[0], p[1], p[2]);
+	}
+
+	/**
+	 * Get overall bounding box containing all meshes
+	 * 
+	 * @return Overall bounding box.
+	 */
+	CCuboid GetBoundingBox() const{
+	    std::vector<CCuboid> b;
+	    std::transform(meshes.begin(), meshes.end(), std::back_inserter(b), [](const CTriangleMesh &m){ return MeshBoundingBox(m); });
+	    return CGAL::bbox_3(b.begin(), b.end());
+	}
+
+	/**
+	 * Test if point is inside the mesh
+	 *
+	 * @param x X coordinate of point
+	 * @param y Y coordinate of point
+	 * @param z Z coordinate of point
+	 *
+	 * @return Returns true if point inside the mesh
+	 */
+	bool InSolid(const double x, const double y, const double z) const;
+	/**
+	  * Test if point is inside the mesh
+	  *
+	  * @param p Point
+	  *
+	  * @return Returns true if point is inside the mesh
+	  */
+	template<class Point> bool InSolid(Point p) const{
+		return InSolid(p[0], p[1], p[2]);
+	}
+
+	/**
+	 * Return list of solids the point is inside of
+	 * @param p Point
+	 * @return List of solid IDs
+	 */
+    template<class Point> std::vector<unsigned> GetSolids(Point p) const{
+        std::vector<unsigned> solids;
+        for (auto &m: meshes){
+            if (InMesh(m, CPoint(p[0],p[1],p[2])))
+                solids.push_back(m.ID);
+        }
+        return solids;
+    }
+
+	/**
+	 * Check if point is contained in bounding box
+	 * 
+	 * @param p Point
+	 * 
+	 * @return Returns true if point is contained in bounding box
+	 */
+	template<class Object> bool InBoundingBox(Object p) const{
+        return std::any_of(meshes.begin(), meshes.end(), [&p](const CTriangleMesh &mesh){ return CGAL::do_intersect(p, MeshBoundingBox(mesh)); });
+	}
+
+	/**
+	 * Return random point on surface
+	 * 
+	 * @param p Returned point
+	 * @param n Returned normal vector of surface at point
+	 * @param ID Returned ID of surface at point
+	 * @param rand Random number generator
+	 * @param bbox Bounding box that point should be contained in
+	 */
+	template<class Point, class Vector, class RandomGenerator, class BoundingBox> void RandomPointOnSurface(Point &p, Vector &n, unsigned &ID, RandomGenerator &rand, BoundingBox bbox){
+        size_t meshidx;
+        do{
+            meshidx = mesh_sampler(rand);
+        }while (not CGAL::do_intersect(MeshBoundingBox(meshes[meshidx]), bbox));
+        ID = meshes[meshidx].ID;
+        std::uniform_real_distribution<double> unidist(0, 1);
+        if (meshes[meshidx].primitive){
+            double u1 = unidist(rand);
+            double u2 = unidist(rand);
+            double u3 = unidist(rand);
+            CPoint pp;
+            CVector nv;
+            PrimitiveSurfacePoint(meshes[meshidx], u1, u2, u3, pp, nv);
+            p = {pp.x(), pp.y(), pp.z()};
+            n = {nv.x(), nv.y(), nv.z()};
+            return;
+        }
+        CMesh::Face_index faceidx(meshes[meshidx].triangle_sampler(rand));
+        std::vector<CPoint> vertices;
+        for (auto v: meshes[meshidx].mesh->vertices_around_face(meshes[meshidx].mesh->halfedge(faceidx))) {
+            vertices.push_back(meshes[meshidx].mesh->point(v));
+        }
+        double a = unidist(rand); // generate random point on triangle (see Numerical Recipes 3rd ed., p. 1114)
+        double b = unidist(rand);
+        if (a+b > 1){
+            a = 1 - a;
+            b = 1 - b;
+        }
+        CPoint pp = vertices[0] + a*(vertices[1] - vertices[0]) + b*(vertices[2] - vertices[0]);
+        CVector nv = CGAL::Polygon_mesh_processing::compute_face_normal(faceidx, *meshes[meshidx].mesh);
+        if (meshes[meshidx].transformed){
+            pp = meshes[meshidx].transform(pp);
+            nv = meshes[meshidx].transform(nv);
+        }
+        p = {pp.x(), pp.y(), pp.z()};
+        n = {nv.x(), nv.y(), nv.z()};
+	}
+
+	/**
+	 * Return random point in volume bounded by mesh
+	 * 
+	 * @param rand Random number generator
+	 * 
+	 * @return Point
+	 */
+	template<class RandomGenerator> std::array<double, 3> RandomPointInVolume(RandomGenerator &rand) const{
+        std::array<double, 3> p;
+        do{
+            p = RandomPointInBoundingBox(rand);
+        }while (!InSolid(p));
+        return p;
+    }
+
+	/**
+	 * Return random point in bounding box
+	 * 
+	 * @param rand Random number generator
+	 * 
+	 * @return Point
+	 */
+    template<class RandomGenerator> std::array<double, 3> RandomPointInBoundingBox(RandomGenerator &rand) const{
+        std::vector<double> bvols;
+        std::transform(meshes.begin(), meshes.end(), std::back_inserter(bvols), [](const CTriangleMesh &mesh){ return MeshBoundingBox(mesh).volume(); });
+        std::discrete_distribution<unsigned> dist(bvols.begin(), bvols.end());
+        CCuboid bbox = MeshBoundingBox(meshes[dist(rand)]);
+        std::uniform_real_distribution<double> unidist(0, 1);
+        return {bbox.xmin() + unidist(rand)*(bbox.xmax() - bbox.xmin()),
+                bbox.ymin() + unidist(rand)*(bbox.ymax() - bbox.ymin()),
+                bbox.zmin() + unidist(rand)*(bbox.zmax() - bbox.zmin())};
+    }
+};
+
+#endif // TRIANGLEMESH_H_
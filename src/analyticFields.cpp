@@ -6,6 +6,14 @@
 
 #include "analyticFields.h"
 
+#include <map>
+#include <cctype>
+#include <cstdlib>
+#include <stdexcept>
+#include <algorithm>
+
+#include "globals.h"
+
 using namespace std;
 
 //TExponentialBFieldX constructor
@@ -166,6 +174,234 @@ TCustomBField::TCustomBField(const std::string &_Bx, const std::string &_By, con
 		if (not parser.compile(expr[i], Bexpr[i])){
 			throw std::runtime_error(exprtk::parser_error::to_str(parser.get_error(0).mode) + " while parsing CustomBField formula '" + expr[i] + "': " + parser.get_error(0).diagnostic);
 		}
+		Compile(expr[i], Btape[i]);
+	}
+}
+
+
+/**
+ * Recursive-descent parser compiling a formula into postfix instructions
+ *
+ * Throws std::invalid_argument if the formula contains anything the compiler does not support.
+ */
+struct TCustomBField::parser{
+	const std::string &formula; ///< formula to compile
+	std::size_t pos; ///< current position in formula
+	std::vector<instruction> &tape; ///< compiled instructions
+	unsigned depth, maxdepth; ///< current and maximum stack depth
+
+	/// Append instruction, keeping track of the stack depth it needs
+	void emit(const opcode op, const unsigned nargs, const double value = 0){
+		tape.push_back({op, value});
+		depth = depth + 1 - nargs;
+		maxdepth = std::max(maxdepth, depth);
+	}
+
+	/// Skip whitespace and check if next character is c, consuming it if it is
+	bool next(const char c){
+		while (pos < formula.size() && std::isspace(static_cast<unsigned char>(formula[pos])))
+			++pos;
+		if (pos < formula.size() && formula[pos] == c){
+			++pos;
+			return true;
+		}
+		return false;
+	}
+
+	/// expression := term (('+' | '-') term)*
+	void expression(){
+		term();
+		while (true){
+			if (next('+')){
+				term();
+				emit(ADD, 2);
+			}
+			else if (next('-')){
+				term();
+				emit(SUB, 2);
+			}
+			else
+				return;
+		}
+	}
+
+	/// term := unary (('*' | '/') unary)*
+	void term(){
+		unary();
+		while (true){
+			if (next('*')){
+				unary();
+				emit(MUL, 2);
+			}
+			else if (next('/')){
+				unary();
+				emit(DIV, 2);
+			}
+			else
+				return;
+		}
+	}
+
+	/// unary := ('-' | '+') unary | primary ('^' unary)?, so powers bind stronger than signs and are right-associative
+	void unary(){
+		if (next('-')){
+			unary();
+			emit(NEG, 1);
+		}
+		else if (next('+'))
+			unary();
+		else{
+			primary();
+			if (next('^')){
+				unary();
+				emit(POW, 2);
+			}
+		}
+	}
+
+	/// primary := number | variable | constant | function '(' arguments ')' | '(' expression ')'
+	void primary(){
+		if (next('(')){
+			expression();
+			if (!next(')'))
+				throw std::invalid_argument("missing bracket");
+			return;
+		}
+		if (pos < formula.size() && (std::isdigit(static_cast<unsigned char>(formula[pos])) || formula[pos] == '.')){
+			const char *begin = formula.c_str() + pos;
+			char *end;
+			double value = std::strtod(begin, &end);
+			pos += end - begin;
+			emit(CONSTANT, 0, value);
+			return;
+		}
+		std::string name;
+		while (pos < formula.size() && (std::isalnum(static_cast<unsigned char>(formula[pos])) || formula[pos] == '_'))
+			name += std::tolower(static_cast<unsigned char>(formula[pos++]));
+		static const std::map<std::string, opcode> variables = {{"x", VAR_X}, {"y", VAR_Y}, {"z", VAR_Z}, {"t", VAR_T}};
+		static const std::map<std::string, std::pair<opcode, unsigned> > functions = {
+				{"sin", {SIN, 1}}, {"cos", {COS, 1}}, {"tan", {TAN, 1}}, {"exp", {EXP, 1}}, {"log", {LOG, 1}}, {"log10", {LOG10, 1}},
+				{"sqrt", {SQRT, 1}}, {"abs", {ABS, 1}}, {"asin", {ASIN, 1}}, {"acos", {ACOS, 1}}, {"atan", {ATAN, 1}},
+				{"sinh", {SINH, 1}}, {"cosh", {COSH, 1}}, {"tanh", {TANH, 1}},
+				{"pow", {POW, 2}}, {"atan2", {ATAN2, 2}}, {"min", {MIN, 2}}, {"max", {MAX, 2}}};
+		auto var = variables.find(name);
+		auto func = functions.find(name);
+		if (var != variables.end())
+			emit(var->second, 0);
+		else if (name == "pi")
+			emit(CONSTANT, 0, pi);
+		else if (func != functions.end() && next('(')){
+			for (unsigned i = 0; i < func->second.second; ++i){
+				if (i > 0 && !next(','))
+					throw std::invalid_argument("wrong number of arguments");
+				expression();
+			}
+			if (!next(')'))
+				throw std::invalid_argument("wrong number of arguments");
+			emit(func->second.first, func->second.second);
+		}
+		else
+			throw std::invalid_argument("unsupported symbol " + name);
+	}
+};
+
+
+void TCustomBField::Compile(const std::string &formula, std::vector<instruction> &tape){
+	tape.clear();
+	parser p{formula, 0, tape, 0, 0};
+	try{
+		p.expression();
+		p.next(' '); // skip trailing whitespace
+		if (p.pos != formula.size() || p.maxdepth > maxstack) // anything left over, e.g. implicit multiplications, or formula too deeply nested
+			tape.clear();
+	}
+	catch (std::invalid_argument &e){
+		tape.clear();
+	}
+}
+
+
+void TCustomBField::Evaluate(const std::vector<instruction> &tape, const double x, const double y, const double z, const double t, double &F, double dFdxi[3]){
+	struct dual{
+		double v; ///< value
+		double d[3]; ///< derivatives with respect to x, y, z
+	};
+	dual stack[maxstack + 2]; // formula's stack starts at stack[2], so operands of binary operations can always be referenced
+	dual *top = stack + 1;
+	for (auto &ins: tape){
+		dual &a = top[-1], &b = *top; // operands of binary operations
+		double f = 1; // derivative of unary function
+		switch (ins.op){
+			case CONSTANT: *++top = {ins.value, {0, 0, 0}}; continue;
+			case VAR_X: *++top = {x, {1, 0, 0}}; continue;
+			case VAR_Y: *++top = {y, {0, 1, 0}}; continue;
+			case VAR_Z: *++top = {z, {0, 0, 1}}; continue;
+			case VAR_T: *++top = {t, {0, 0, 0}}; continue;
+			case ADD:
+				a.v += b.v;
+				for (int i = 0; i < 3; ++i) a.d[i] += b.d[i];
+				--top;
+				continue;
+			case SUB:
+				a.v -= b.v;
+				for (int i = 0; i < 3; ++i) a.d[i] -= b.d[i];
+				--top;
+				continue;
+			case MUL:
+				for (int i = 0; i < 3; ++i) a.d[i] = a.d[i]*b.v + a.v*b.d[i];
+				a.v *= b.v;
+				--top;
+				continue;
+			case DIV:
+				a.v /= b.v;
+				for (int i = 0; i < 3; ++i) a.d[i] = (a.d[i] - a.v*b.d[i])/b.v;
+				--top;
+				continue;
+			case POW:{
+				double v = std::pow(a.v, b.v), da = b.v*std::pow(a.v, b.v - 1);
+				for (int i = 0; i < 3; ++i) a.d[i] = da*a.d[i] + (b.d[i] == 0 ? 0 : v*std::log(a.v)*b.d[i]); // skip logarithm for constant exponents, so negative bases work
+				a.v = v;
+				--top;
+				continue;
+			}
+			case ATAN2:{
+				double r2 = a.v*a.v + b.v*b.v;
+				for (int i = 0; i < 3; ++i) a.d[i] = (b.v*a.d[i] - a.v*b.d[i])/r2;
+				a.v = std::atan2(a.v, b.v);
+				--top;
+				continue;
+			}
+			case MIN:
+				if (b.v < a.v) a = b;
+				--top;
+				continue;
+			case MAX:
+				if (b.v > a.v) a = b;
+				--top;
+				continue;
+			case NEG: b.v = -b.v; f = -1; break;
+			case SIN: f = std::cos(b.v); b.v = std::sin(b.v); break;
+			case COS: f = -std::sin(b.v); b.v = std::cos(b.v); break;
+			case TAN: b.v = std::tan(b.v); f = 1 + b.v*b.v; break;
+			case EXP: b.v = std::exp(b.v); f = b.v; break;
+			case LOG: f = 1/b.v; b.v = std::log(b.v); break;
+			case LOG10: f = 1/(b.v*std::log(10.)); b.v = std::log10(b.v); break;
+			case SQRT: b.v = std::sqrt(b.v); f = 0.5/b.v; break;
+			case ABS: f = b.v < 0 ? -1 : 1; b.v = std::abs(b.v); break;
+			case ASIN: f = 1/std::sqrt(1 - b.v*b.v); b.v = std::asin(b.v); break;
+			case ACOS: f = -1/std::sqrt(1 - b.v*b.v); b.v = std::acos(b.v); break;
+			case ATAN: f = 1/(1 + b.v*b.v); b.v = std::atan(b.v); break;
+			case SINH: f = std::cosh(b.v); b.v = std::sinh(b.v); break;
+			case COSH: f = std::sinh(b.v); b.v = std::cosh(b.v); break;
+			case TANH: b.v = std::tanh(b.v); f = 1 - b.v*b.v; break;
+		}
+		for (int i = 0; i < 3; ++i)
+			b.d[i] *= f;
+	}
+	F = stack[2].v;
+	if (dFdxi != nullptr){
+		for (int i = 0; i < 3; ++i)
+			dFdxi[i] = stack[2].d[i];
 	}
 }
 
@@ -174,23 +410,18 @@ void TCustomBField::BField(const double x, const double y, const double z, const
 	*yvar = y;
 	*zvar = z;
 	*tvar = t;
-	B[0] = Bexpr[0].value();
-	B[1] = Bexpr[1].value();
-	B[2] = Bexpr[2].value();
-//	std::cout << B[0] << " " << B[1] << " " << B[2] << " ";
-	
-	if (dBidxj != nullptr){
-		dBidxj[0][0] = exprtk::derivative(Bexpr[0], *xvar);
-		dBidxj[0][1] = exprtk::derivative(Bexpr[0], *yvar);
-		dBidxj[0][2] = exprtk::derivative(Bexpr[0], *zvar);
-		dBidxj[1][0] = exprtk::derivative(Bexpr[1], *xvar);
-		dBidxj[1][1] = exprtk::derivative(Bexpr[1], *yvar);
-		dBidxj[1][2] = exprtk::derivative(Bexpr[1], *zvar);
-		dBidxj[2][0] = exprtk::derivative(Bexpr[2], *xvar);
-		dBidxj[2][1] = exprtk::derivative(Bexpr[2], *yvar);
-		dBidxj[2][2] = exprtk::derivative(Bexpr[2], *zvar);
-//		std::cout << dBidxj[0][0] << " " << dBidxj[0][1] << " " << dBidxj[0][2] << std::endl;
-	}
-//	std::cout << std::endl;
-
-}
\ No newline at end of file
+	for (int i = 0; i < 3; ++i){
+		if (dBidxj == nullptr){ // exprtk's optimized expression tree is faster when no derivatives are needed
+			B[i] = Bexpr[i].value();
+		}
+		else if (!Btape[i].empty()){
+			Evaluate(Btape[i], x, y, z, t, B[i], dBidxj[i]);
+		}
+		else{
+			B[i] = Bexpr[i].value();
+			dBidxj[i][0] = exprtk::derivative(Bexpr[i], *xvar);
+			dBidxj[i][1] = exprtk::derivative(Bexpr[i], *yvar);
+			dBidxj[i][2] = exprtk::derivative(Bexpr[i], *zvar);
+		}
+	}
+}
@@ -5,6 +5,13 @@
 
 #include "conductor.h"
 
+#include <fstream>
+#include <sstream>
+#include <cmath>
+#include <algorithm>
+
+#include <boost/format.hpp>
+
 #include "globals.h"
 
 TConductorField::TConductorField(const double SW1xx, const double SW1yy, const double SW1zz,
@@ -154,3 +161,119 @@ void TConductorField::BField(const double x, const double y, const double z, con
 	}
 }
 
+
+
+TConductorSetField::TConductorSetField(const std::vector<std::array<double, 7> > &wires){
+	for (auto &w: wires){
+		prefactor.push_back(mu0*w[0]/(4*pi));
+		x1.push_back(w[1]);
+		y1.push_back(w[2]);
+		z1.push_back(w[3]);
+		lx.push_back(w[4] - w[1]);
+		ly.push_back(w[5] - w[2]);
+		lz.push_back(w[6] - w[3]);
+	}
+}
+
+void TConductorSetField::BField(const double x, const double y, const double z, const double t,
+		double B[3], double dBidxj[3][3]) const{
+	// wires are processed in blocks. The first loop over each block calculates the expensive, wire-independent terms and can be vectorized,
+	// the second loop sums up the contributions of each wire in order
+	const std::size_t N = prefactor.size(), block = 64;
+	double f[3][block], g[block], inv1[block], inv2[block], invD[block], dg[3][block];
+	double Bsum[3] = {0, 0, 0}, dBsum[3][3] = {{0, 0, 0}, {0, 0, 0}, {0, 0, 0}};
+	for (std::size_t b = 0; b < N; b += block){
+		const std::size_t n = std::min(block, N - b);
+		const double *x1b = &x1[b], *y1b = &y1[b], *z1b = &z1[b], *lxb = &lx[b], *lyb = &ly[b], *lzb = &lz[b], *pb = &prefactor[b];
+		for (std::size_t i = 0; i < n; ++i){
+			double r1x = x - x1b[i], r1y = y - y1b[i], r1z = z - z1b[i]; // vectors from start and end point to field point
+			double r2x = r1x - lxb[i], r2y = r1y - lyb[i], r2z = r1z - lzb[i];
+			double n1 = std::sqrt(r1x*r1x + r1y*r1y + r1z*r1z), n2 = std::sqrt(r2x*r2x + r2y*r2y + r2z*r2z);
+			double D = n1*n2*(n1*n2 + r1x*r2x + r1y*r2y + r1z*r2z); // zero only on the wire
+			double offwire = D > 0; // branchless masking of wires that contain the field point
+			invD[i] = offwire/(D + 1. - offwire);
+			inv1[i] = offwire/(n1 + 1. - offwire);
+			inv2[i] = offwire/(n2 + 1. - offwire);
+			f[0][i] = lyb[i]*r1z - lzb[i]*r1y; // r1 x r2 = l x r1
+			f[1][i] = lzb[i]*r1x - lxb[i]*r1z;
+			f[2][i] = lxb[i]*r1y - lyb[i]*r1x;
+			g[i] = pb[i]*(n1 + n2)*invD[i];
+		}
+		if (dBidxj != nullptr){
+			for (std::size_t i = 0; i < n; ++i){
+				double r1[3] = {x - x1b[i], y - y1b[i], z - z1b[i]};
+				double r2[3] = {r1[0] - lxb[i], r1[1] - lyb[i], r1[2] - lzb[i]};
+				double n1 = std::sqrt(r1[0]*r1[0] + r1[1]*r1[1] + r1[2]*r1[2]), n2 = std::sqrt(r2[0]*r2[0] + r2[1]*r2[1] + r2[2]*r2[2]);
+				double n12 = n1*n2, s = n12 + r1[0]*r2[0] + r1[1]*r2[1] + r1[2]*r2[2];
+				for (int j = 0; j < 3; ++j){
+					double dn12 = n2*r1[j]*inv1[i] + n1*r2[j]*inv2[i];
+					double dD = dn12*s + n12*(dn12 + r1[j] + r2[j]);
+					dg[j][i] = (pb[i]*(r1[j]*inv1[i] + r2[j]*inv2[i]) - g[i]*dD)*invD[i];
+				}
+			}
+		}
+		for (std::size_t i = 0; i < n; ++i){
+			for (int k = 0; k < 3; ++k)
+				Bsum[k] += f[k][i]*g[i];
+		}
+		if (dBidxj != nullptr){
+			for (std::size_t i = 0; i < n; ++i){
+				for (int k = 0; k < 3; ++k){
+					for (int j = 0; j < 3; ++j)
+						dBsum[k][j] += f[k][i]*dg[j][i];
+				}
+				// derivatives of l x r1
+				dBsum[0][1] -= lzb[i]*g[i];
+				dBsum[0][2] += lyb[i]*g[i];
+				dBsum[1][0] += lzb[i]*g[i];
+				dBsum[1][2] -= lxb[i]*g[i];
+				dBsum[2][0] -= lyb[i]*g[i];
+				dBsum[2][1] += lxb[i]*g[i];
+			}
+		}
+	}
+	for (int i = 0; i < 3; ++i){
+		B[i] = Bsum[i];
+		if (dBidxj != nullptr){
+			for (int j = 0; j < 3; ++j)
+				dBidxj[i][j] = dBsum[i][j];
+		}
+	}
+}
+
+
+TFieldContainer ReadConductorSet(const std::string &params, std::ostream &out){
+	std::istringstream ss(params);
+	boost::filesystem::path ft;
+	std::string fieldtype, Bscale;
+	ss >> fieldtype >> ft >> Bscale;
+	if (!ss){
+		throw std::runtime_error((boost::format("Could not read all required parameters for field %1%!") % fieldtype).str());
+	}
+	std::ifstream FIN(boost::filesystem::absolute(ft, configpath.parent_path()).string());
+	if (!FIN.is_open()){
+		throw std::runtime_error("Could not open " + ft.string());
+	}
+	std::vector<std::array<double, 7> > wires;
+	std::string line;
+	for (int lineNum = 1; getline(FIN, line); ++lineNum){
+		std::istringstream ls(line);
+		std::string first;
+		if (!(ls >> first) || first[0] == '#') // skip empty and commented lines
+			continue;
+		ls.str(line);
+		ls.clear();
+		std::array<double, 7> w;
+		for (auto &v: w)
+			ls >> v;
+		if (!ls || !(ls >> std::ws).eof()){
+			throw std::runtime_error((boost::format("Error reading line %1% of file %2%") % lineNum % ft.string()).str());
+		}
+		wires.push_back(w);
+	}
+	if (wires.empty()){
+		throw std::runtime_error("No conductors read from " + ft.string());
+	}
+	out << "\nRead " << wires.size() << " conductors from " << ft << "\n";
+	return TFieldContainer(std::unique_ptr<TField>(new TConductorSetField(wires)), Bscale);
+}
@@ -6,6 +6,7 @@
 #include <fstream>
 #include <sstream>
 #include <algorithm>
+#include <array>
 
 #include <boost/format.hpp>
 #include <boost/filesystem.hpp>
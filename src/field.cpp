@@ -1,12 +1,74 @@
 #include <cmath>
+#include <limits>
+#include <algorithm>
+#include <sstream>
+#include <cctype>
 
 #include "field.h"
 
 using namespace std;
 
+namespace{
+/**
+ * exprtk function wrapping TFieldScaler::piecewise, expects the function argument followed by a list of points
+ */
+class TPiecewiseFunction: public exprtk::ivararg_function<double>{
+private:
+    bool linear; ///< Interpolate linearly between points
+public:
+    /**
+     * Constructor
+     *
+     * @param alinear Interpolate linearly between points if true, else keep values constant between points
+     */
+    TPiecewiseFunction(const bool alinear): linear(alinear){ }
+
+    double operator()(const std::vector<double> &args) override{
+        if (args.size() < 3 or args.size() % 2 == 0)
+            return std::numeric_limits<double>::quiet_NaN();
+        return TFieldScaler::piecewise(args[0], &args[1], args.size()/2, linear);
+    }
+};
+
+TPiecewiseFunction pwlinear(true), pwconst(false);
+}
+
+
+double TFieldScaler::piecewise(const double x, const double *points, const size_t n, const bool linear){
+    if (x <= points[0])
+        return points[1];
+    if (x >= points[2*n - 2])
+        return points[2*n - 1];
+    size_t lo = 0, hi = n - 1; // binary search for interval x_lo <= x < x_hi
+    while (hi - lo > 1){
+        size_t mid = (lo + hi)/2;
+        if (x < points[2*mid])
+            hi = mid;
+        else
+            lo = mid;
+    }
+    if (not linear)
+        return points[2*lo + 1];
+    return points[2*lo + 1] + (points[2*hi + 1] - points[2*lo + 1])*(x - points[2*lo])/(points[2*hi] - points[2*lo]);
+}
+
+
 double TFieldScaler::scalingFactor(const double t) const{
-    *tvar = t;
-    return scaler.value();
+    if (t == lastt)
+        return lastfactor;
+    switch (type){
+        case CONSTANT:
+            return points[0];
+        case PIECEWISE_LINEAR:
+        case PIECEWISE_CONSTANT:
+            lastfactor = piecewise(t, points.data(), points.size()/2, type == PIECEWISE_LINEAR);
+            break;
+        default:
+            *tvar = t;
+            lastfactor = scaler.value();
+    }
+    lastt = t;
+    return lastfactor;
 }
 
 void TFieldScaler::scaleScalarField(const double t, double &F, double dFdxi[3]) const{
@@ -21,27 +83,58 @@ void TFieldScaler::scaleScalarField(const double t, double &F, double dFdxi[3])
 
 
 void TFieldScaler::scaleVectorField(const double t, double F[3], double dFidxj[3][3]) const{
+    double scaling = scalingFactor(t);
     for (int i = 0; i < 3; ++i){
-        if (dFidxj == nullptr){
-            scaleScalarField(t, F[i], nullptr);
-        }
-        else{
-            scaleScalarField(t, F[i], dFidxj[i]);
+        F[i] *= scaling;
+        if (dFidxj != nullptr){
+            dFidxj[i][0] *= scaling;
+            dFidxj[i][1] *= scaling;
+            dFidxj[i][2] *= scaling;
         }
     }
 }
 
 
-TFieldScaler::TFieldScaler(const std::string &scalingFormula){
+TFieldScaler::TFieldScaler(const std::string &scalingFormula): type(FORMULA), lastt(std::numeric_limits<double>::quiet_NaN()), lastfactor(0){
     tvar = unique_ptr<double>(new double(0.0));
     exprtk::symbol_table<double> symbol_table;
     symbol_table.add_variable("t",*tvar);
     symbol_table.add_constants();
+    symbol_table.add_function("pwlinear", pwlinear);
+    symbol_table.add_function("pwconst", pwconst);
     scaler.register_symbol_table(symbol_table);
     exprtk::parser<double> parser;
+    parser.dec().collect_variables() = true;
     if (not parser.compile(scalingFormula, scaler)){
         throw std::runtime_error(exprtk::parser_error::to_str(parser.get_error(0).mode) + " while parsing formula '" + scalingFormula + "': " + parser.get_error(0).diagnostic);
     }
+
+    std::vector<std::pair<std::string, exprtk::parser<double>::symbol_type> > variables;
+    parser.dec().symbols(variables);
+    std::string formula = scalingFormula;
+    formula.erase(std::remove_if(formula.begin(), formula.end(), [](const char c){ return std::isspace(c); }), formula.end());
+    if (variables.empty()){
+        type = CONSTANT;
+        points.push_back(scaler.value());
+    }
+    else if ((formula.compare(0, 11, "pwlinear(t,") == 0 or formula.compare(0, 10, "pwconst(t,") == 0) and formula.back() == ')'){
+        // single piecewise function of time, read its points directly if they are plain numbers
+        std::string args = formula.substr(formula.find(',') + 1, formula.size() - formula.find(',') - 2);
+        std::replace(args.begin(), args.end(), ',', ' ');
+        std::istringstream ss(args);
+        double p;
+        while (ss >> p)
+            points.push_back(p);
+        bool ascending = true;
+        for (size_t i = 2; i < points.size(); i += 2)
+            ascending = ascending and points[i] > points[i - 2];
+        if (not ss.eof()) // arguments are not plain numbers, leave evaluation to exprtk
+            points.clear();
+        else if (points.size() < 2 or points.size() % 2 != 0 or not ascending)
+            throw std::runtime_error("Formula '" + scalingFormula + "' has to contain pairs of points with ascending x coordinates");
+        else
+            type = formula[2] == 'l' ? PIECEWISE_LINEAR : PIECEWISE_CONSTANT;
+    }
 }
 
 
@@ -68,6 +161,16 @@ bool TFieldBoundaryBox::inBounds(const double x, const double y, const double z)
 }
 
 
+void TFieldBoundaryBox::getBoundingBox(double min[3], double max[3]) const{
+    min[0] = xmin;
+    min[1] = ymin;
+    min[2] = zmin;
+    max[0] = xmax;
+    max[1] = ymax;
+    max[2] = zmax;
+}
+
+
 void TFieldBoundaryBox::scaleScalarFieldAtBounds(const double x, const double y, const double z, double &F, double dFdxi[3]) const{
     if (not hasBounds() or (F == 0 and dFdxi == nullptr) or (F == 0 and dFdxi[0] == 0 and dFdxi[1] == 0 and dFdxi[2] == 0)){ // skip if no boundary is set or field is zero
         return;
@@ -167,3 +270,10 @@ void TFieldContainer::EField(const double x, const double y, const double z, con
         boundary->scaleScalarFieldAtBounds(x, y, z, V, Ei);
     }
 }
+
+bool TFieldContainer::GetBoundingBox(double min[3], double max[3]) const{
+    if (not boundary->hasBounds())
+        return false;
+    boundary->getBoundingBox(min, max);
+    return true;
+}
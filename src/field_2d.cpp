@@ -8,6 +8,9 @@
 #include <string>
 #include <iostream>
 #include <fstream>
+#include <vector>
+#include <tuple>
+#include <algorithm>
 
 #include "boost/format.hpp"
 
@@ -21,17 +24,18 @@ using namespace std;
  *
  * @param v_r Radial component of vector
  * @param v_phi Azimuthal component of vector
- * @param phi Azimuth of vector origin
+ * @param cosphi Cosine of azimuth of vector origin
+ * @param sinphi Sine of azimuth of vector origin
  * @param v_x Returns x component of vector
  * @param v_y Returns y component of vector
  */
-void CylToCart(const double v_r, const double v_phi, const double phi, double &v_x, double &v_y){
-	v_x = v_r*cos(phi) - v_phi*sin(phi);
-	v_y = v_r*sin(phi) + v_phi*cos(phi);
+void CylToCart(const double v_r, const double v_phi, const double cosphi, const double sinphi, double &v_x, double &v_y){
+	v_x = v_r*cosphi - v_phi*sinphi;
+	v_y = v_r*sinphi + v_phi*cosphi;
 }
 
 
-TFieldContainer ReadOperaField2(const std::string &params){
+TFieldContainer ReadOperaField2(const std::string &params, std::ostream &out){
     std::istringstream ss(params);
     boost::filesystem::path ft;
     std::string fieldtype, Bscale, Escale;
@@ -39,7 +43,7 @@ TFieldContainer ReadOperaField2(const std::string &params){
     ss >> fieldtype;
     if (fieldtype == "2Dtable"){
         ss >> ft >> Bscale >> Escale;
-        std::cout << "Field type " << fieldtype << " is deprecated. Consider using the new OPERA2D format. I'm assuming that file " << ft << " is using centimeters, Gauss, Volt/centimeter, and Volts as units.\n";
+        out << "Field type " << fieldtype << " is deprecated. Consider using the new OPERA2D format. I'm assuming that file " << ft << " is using centimeters, Gauss, Volt/centimeter, and Volts as units.\n";
         Bscale = "(" + Bscale + ")*0.0001"; // scale magnetic field to Tesla
         Escale = "(" + Escale + ")*100"; // scale electric field to Volt/meter
         lengthconv = 0.01;
@@ -54,18 +58,17 @@ TFieldContainer ReadOperaField2(const std::string &params){
         throw std::runtime_error((boost::format("Could not read all required parameters for field %1%!") % fieldtype).str());
     }
 
-    return TFieldContainer(std::unique_ptr<TabField>(new TabField(boost::filesystem::absolute(ft, configpath.parent_path()).string(), lengthconv)), Bscale, Escale);
+    return TFieldContainer(std::unique_ptr<TabField>(new TabField(boost::filesystem::absolute(ft, configpath.parent_path()).string(), lengthconv, out)), Bscale, Escale);
 }
 
 
 void TabField::ReadTabFile(const std::string &tabfile, const double lengthconv, alglib::real_1d_array &rind, alglib::real_1d_array &zind,
-		alglib::real_1d_array BTabs[3], alglib::real_1d_array ETabs[3], alglib::real_1d_array &VTab){
+		alglib::real_1d_array BTabs[3], alglib::real_1d_array ETabs[3], alglib::real_1d_array &VTab, std::ostream &out){
 	ifstream FIN(tabfile, ifstream::in);
 	if (!FIN.is_open()){
-		cout << "\nCould not open " << tabfile << "!\n";
-		exit(-1);
+		throw std::runtime_error("Could not open " + tabfile + "!");
 	}
-	cout << "\nReading " << tabfile << "!\n";
+	out << "\nReading " << tabfile << "!\n";
 	int intval;
 	string line;
 	FIN >> m >> intval >> n;
@@ -112,13 +115,12 @@ void TabField::ReadTabFile(const std::string &tabfile, const double lengthconv,
 	}
 
 	if (!FIN || line.substr(0,2) != " 0"){
-		std::cout << tabfile << " not found or corrupt! Exiting...\n";
-		exit(-1);
+		throw std::runtime_error(tabfile + " not found or corrupt!");
 	}
 
 	int ri = 0,zi = -1;
 	double r, z, val;
-	progress_display progress(n*m, std::cout);
+	progress_display progress(n*m, out);
 	while (FIN.good()){
 		FIN >> r;
 		if (!skipy) FIN >> val;
@@ -170,26 +172,25 @@ void TabField::ReadTabFile(const std::string &tabfile, const double lengthconv,
 		FIN >> ws;
 	}
 
-	std::cout << "\n";
+	out << "\n";
 	if (ri+1 != (int)m || zi+1 != (int)n){
-		std::cout << "The header says the size is " << m << " by " << n << ", actually it is " << ri+1 << " by " << zi+1 << "! Exiting...\n";
-		exit(-1);
+		throw std::runtime_error((boost::format("The header says the size is %1% by %2%, actually it is %3% by %4%!") % m % n % (ri+1) % (zi+1)).str());
 	}
 	FIN.close();
 }
 
 
 void TabField::CheckTab(const alglib::real_1d_array &rind, const alglib::real_1d_array &zind,
-		const alglib::real_1d_array BTabs[3], const alglib::real_1d_array ETabs[3], const alglib::real_1d_array &VTab){
+		const alglib::real_1d_array BTabs[3], const alglib::real_1d_array ETabs[3], const alglib::real_1d_array &VTab, std::ostream &out){
 	//  calculate factors for conversion of coordinates to indexes  r = conv_rA + index * conv_rB
 	r_mi = rind[0];
 	z_mi = zind[0];
 	rdist = rind[1] - rind[0];
 	zdist = zind[1] - zind[0];
-	std::cout << "The arrays are " << m << " by " << n << "\n";
-	std::cout << "The r values go from " << rind[0] << " to " << rind[m-1] << "\n";
-	std::cout << "The z values go from " << zind[0] << " to " << zind[n-1] << ".\n";
-	std::cout << "rdist = " << rdist << " zdist = " << zdist << "\n";
+	out << "The arrays are " << m << " by " << n << "\n";
+	out << "The r values go from " << rind[0] << " to " << rind[m-1] << "\n";
+	out << "The z values go from " << zind[0] << " to " << zind[n-1] << ".\n";
+	out << "rdist = " << rdist << " zdist = " << zdist << "\n";
 
 	double Babsmax = 0, Babsmin = 9e99, Babs;
 	double Vmax = 0, Vmin = 9e99;
@@ -213,109 +214,126 @@ void TabField::CheckTab(const alglib::real_1d_array &rind, const alglib::real_1d
 		}
 	}
 
-	std::cout << "The input table file has values of magnetic field |B| from " << Babsmin << " to " << Babsmax << " and values of electric potential from " << Vmin << " to " << Vmax << "\n";
+	out << "The input table file has values of magnetic field |B| from " << Babsmin << " to " << Babsmax << " and values of electric potential from " << Vmin << " to " << Vmax << "\n";
 }
 
-TabField::TabField(const std::string &tabfile, const double alengthconv){
+TabField::TabField(const std::string &tabfile, const double alengthconv, std::ostream &out){
 	alglib::real_1d_array rind, zind, BTabs[3], ETabs[3], VTab;
 
-	ReadTabFile(tabfile, alengthconv, rind, zind, BTabs, ETabs, VTab); // open tabfile and read values into arrays
+	ReadTabFile(tabfile, alengthconv, rind, zind, BTabs, ETabs, VTab, out); // open tabfile and read values into arrays
+
+	CheckTab(rind, zind, BTabs, ETabs, VTab, out); // print some info
+
+	out << "Starting Preinterpolation ... ";
+	rgrid.assign(rind.getcontent(), rind.getcontent() + m);
+	zgrid.assign(zind.getcontent(), zind.getcontent() + n);
+	if (ETabs[0].length() > 0 || ETabs[1].length() > 0 || ETabs[2].length() > 0)
+		VTab.setlength(0); // ignore potential if electric field map found
+	// collect all columns found in table file and calculate their coefficients in parallel
+	std::vector<std::tuple<const char*, const alglib::real_1d_array*, std::vector<double>*> > columns{
+		std::make_tuple("Br ... ", &BTabs[0], &Brc), std::make_tuple("Bphi ... ", &BTabs[1], &Bphic), std::make_tuple("Bz ... ", &BTabs[2], &Bzc),
+		std::make_tuple("Er ... ", &ETabs[0], &Erc), std::make_tuple("Ephi ... ", &ETabs[1], &Ephic), std::make_tuple("Ez ... ", &ETabs[2], &Ezc),
+		std::make_tuple("V ... ", &VTab, &Vc)};
+	columns.erase(std::remove_if(columns.begin(), columns.end(), [](const decltype(columns)::value_type &c){ return std::get<1>(c)->length() == 0; }), columns.end());
+	for (auto &c: columns)
+		out << std::get<0>(c);
+	out.flush();
+	parallel_for(columns.size(), [&](const size_t i){
+		PreInterpol(rind, zind, *std::get<1>(columns[i]), *std::get<2>(columns[i]));
+	});
+	out << "Done\n";
+}
 
-	CheckTab(rind, zind, BTabs, ETabs, VTab); // print some info
 
-	std::cout << "Starting Preinterpolation ... ";
-	fBrc = fBphic = fBzc = fErc = fEphic = fEzc = fVc = false;
-	if (BTabs[0].length() > 0){
-		cout << "Br ... ";
-		cout.flush();
-		alglib::spline2dbuildbicubicv(rind, m, zind, n, BTabs[0], 1, Brc);
-		fBrc = true;
-	}
-	if (BTabs[1].length() > 0){
-		cout << "Bhi ... ";
-		cout.flush();
-		alglib::spline2dbuildbicubicv(rind, m, zind, n, BTabs[1], 1, Bphic);
-		fBphic = true;
-	}
-	if (BTabs[2].length() > 0){
-		cout << "Bz ... ";
-		cout.flush();
-		alglib::spline2dbuildbicubicv(rind, m, zind, n, BTabs[2], 1, Bzc);
-		fBzc = true;
-	}
-	if (ETabs[0].length() > 0){
-		cout << "Er ... ";
-		cout.flush();
-		alglib::spline2dbuildbicubicv(rind, m, zind, n, ETabs[0], 1, Erc);
-        VTab.setlength(0); // ignore potential if electric field map found
-		fErc = true;
+void TabField::PreInterpol(const alglib::real_1d_array &rind, const alglib::real_1d_array &zind, const alglib::real_1d_array &Tab, std::vector<double> &coeff) const{
+	alglib::spline2dinterpolant spline;
+	alglib::spline2dbuildbicubicv(rind, m, zind, n, Tab, 1, spline);
+	alglib::ae_int_t M, N, D;
+	alglib::real_2d_array tbl;
+	alglib::spline2dunpackv(spline, M, N, D, tbl); // row zi*(m - 1) + ri contains cell bounds and coefficients c_ij of (r - r_ri)^i*(z - z_zi)^j at column 4 + 4*i + j
+	coeff.resize(16*(m - 1)*(n - 1));
+	for (int cell = 0; cell < (m - 1)*(n - 1); ++cell){
+		for (int k = 0; k < 16; ++k)
+			coeff[16*cell + k] = tbl[cell][4 + k];
 	}
-	if (ETabs[1].length() > 0){
-		cout << "Ephi ... ";
-		cout.flush();
-		alglib::spline2dbuildbicubicv(rind, m, zind, n, ETabs[1], 1, Ephic);
-        VTab.setlength(0); // ignore potential if electric field map found
-		fEphic = true;
-	}
-	if (ETabs[2].length() > 0){
-		cout << "Ez ... ";
-		cout.flush();
-		alglib::spline2dbuildbicubicv(rind, m, zind, n, ETabs[2], 1, Ezc);
-        VTab.setlength(0); // ignore potential if electric field map found
-		fEzc = true;
+}
+
+
+int TabField::FindCell(const double r, const double z, double &dr, double &dz) const{
+	int ri = std::min(std::max(static_cast<int>((r - r_mi)/rdist), 0), m - 2);
+	if (ri > 0 && r < rgrid[ri])
+		--ri;
+	else if (ri < m - 2 && r >= rgrid[ri + 1])
+		++ri;
+	int zi = std::min(std::max(static_cast<int>((z - z_mi)/zdist), 0), n - 2);
+	if (zi > 0 && z < zgrid[zi])
+		--zi;
+	else if (zi < n - 2 && z >= zgrid[zi + 1])
+		++zi;
+	dr = r - rgrid[ri];
+	dz = z - zgrid[zi];
+	return zi*(m - 1) + ri;
+}
+
+
+double TabField::Interpolate(const std::vector<double> &coeff, const int cell, const double dr, const double dz, double *dfdr, double *dfdz) const{
+	const double *c = &coeff[16*cell];
+	double row[4]; // polynomials in z for each power of r
+	for (int i = 0; i < 4; ++i)
+		row[i] = c[4*i] + dz*(c[4*i + 1] + dz*(c[4*i + 2] + dz*c[4*i + 3]));
+	if (dfdr != nullptr)
+		*dfdr = row[1] + dr*(2*row[2] + dr*3*row[3]);
+	if (dfdz != nullptr){
+		double drow[4];
+		for (int i = 0; i < 4; ++i)
+			drow[i] = c[4*i + 1] + dz*(2*c[4*i + 2] + dz*3*c[4*i + 3]);
+		*dfdz = drow[0] + dr*(drow[1] + dr*(drow[2] + dr*drow[3]));
 	}
-    if (VTab.length() > 0){
-        cout << "V ... ";
-        cout.flush();
-        alglib::spline2dbuildbicubicv(rind, m, zind, n, VTab, 1, Vc);
-        fVc = true;
-    }
-	cout << "Done\n";
+	return row[0] + dr*(row[1] + dr*(row[2] + dr*row[3]));
 }
 
+
 void TabField::BField(const double x, const double y, const double z, const double t, double B[3], double dBidxj[3][3]) const{
 	double r = sqrt(x*x+y*y);
 	if (r >= r_mi && r <= r_mi + rdist*(m - 1) && z >= z_mi && z <= z_mi + zdist*(n - 1)){
 		// bicubic interpolation
-		double Br = 0, Bphi = 0;
-		double Bx = 0, By = 0, Bz = 0;
-		double phi = atan2(y,x);
+		double dr, dz;
+		int cell = FindCell(r, z, dr, dz);
+		double cosphi = 1, sinphi = 0; // azimuth is zero on axis, like atan2(0, 0)
+		if (r > 0){
+			cosphi = x/r;
+			sinphi = y/r;
+		}
+		double Br = 0, Bphi = 0, Bz = 0;
 		if (dBidxj != NULL){
-			double dBrdr = 0, dBrdz = 0, dBphidr = 0, dBphidz = 0, dBzdr = 0, dBxdz = 0, dBydz = 0, dBzdz = 0;
-			double dummy;
-			if (fBrc){
-				alglib::spline2ddiff(Brc, r, z, Br, dBrdr, dBrdz, dummy);
-			}
-			if (fBphic){
-				alglib::spline2ddiff(Bphic, r, z, Bphi, dBphidr, dBphidz, dummy);
-			}
+			double dBrdr = 0, dBrdz = 0, dBphidr = 0, dBphidz = 0, dBzdr = 0, dBzdz = 0;
+			if (!Brc.empty())
+				Br = Interpolate(Brc, cell, dr, dz, &dBrdr, &dBrdz);
+			if (!Bphic.empty())
+				Bphi = Interpolate(Bphic, cell, dr, dz, &dBphidr, &dBphidz);
 			if (r > 0){
-				dBidxj[0][0] = dBrdr*cos(phi)*cos(phi) - dBphidr*cos(phi)*sin(phi) + (Br*sin(phi)*sin(phi) + Bphi*cos(phi)*sin(phi))/r;
-				dBidxj[0][1] = dBrdr*cos(phi)*sin(phi) - dBphidr*sin(phi)*sin(phi) - (Br*cos(phi)*sin(phi) + Bphi*cos(phi)*cos(phi))/r;
-				dBidxj[1][0] = dBrdr*cos(phi)*sin(phi) + dBphidr*cos(phi)*cos(phi) - (Br*cos(phi)*sin(phi) - Bphi*sin(phi)*sin(phi))/r;
-				dBidxj[1][1] = dBrdr*sin(phi)*sin(phi) + dBphidr*cos(phi)*sin(phi) + (Br*cos(phi)*cos(phi) - Bphi*cos(phi)*sin(phi))/r;
+				dBidxj[0][0] = dBrdr*cosphi*cosphi - dBphidr*cosphi*sinphi + (Br*sinphi*sinphi + Bphi*cosphi*sinphi)/r;
+				dBidxj[0][1] = dBrdr*cosphi*sinphi - dBphidr*sinphi*sinphi - (Br*cosphi*sinphi + Bphi*cosphi*cosphi)/r;
+				dBidxj[1][0] = dBrdr*cosphi*sinphi + dBphidr*cosphi*cosphi - (Br*cosphi*sinphi - Bphi*sinphi*sinphi)/r;
+				dBidxj[1][1] = dBrdr*sinphi*sinphi + dBphidr*cosphi*sinphi + (Br*cosphi*cosphi - Bphi*cosphi*sinphi)/r;
 			}
-			CylToCart(dBrdz,dBphidz,phi,dBxdz,dBydz);
-			dBidxj[0][2] = dBxdz;
-			dBidxj[1][2] = dBydz;
-			if (fBzc){
-				alglib::spline2ddiff(Bzc, r, z, Bz, dBzdr, dBzdz, dummy);
-				dBidxj[2][0] = dBzdr*cos(phi);
-				dBidxj[2][1] = dBzdr*sin(phi);
+			CylToCart(dBrdz, dBphidz, cosphi, sinphi, dBidxj[0][2], dBidxj[1][2]);
+			if (!Bzc.empty()){
+				Bz = Interpolate(Bzc, cell, dr, dz, &dBzdr, &dBzdz);
+				dBidxj[2][0] = dBzdr*cosphi;
+				dBidxj[2][1] = dBzdr*sinphi;
 				dBidxj[2][2] = dBzdz;
 			}
 		}
 		else{
-			if (fBrc)
-				Br = alglib::spline2dcalc(Brc, r, z);
-			if (fBphic)
-				Bphi = alglib::spline2dcalc(Bphic, r, z);
-			if (fBzc)
-				Bz = alglib::spline2dcalc(Bzc, r, z);
+			if (!Brc.empty())
+				Br = Interpolate(Brc, cell, dr, dz);
+			if (!Bphic.empty())
+				Bphi = Interpolate(Bphic, cell, dr, dz);
+			if (!Bzc.empty())
+				Bz = Interpolate(Bzc, cell, dr, dz);
 		}
-		CylToCart(Br,Bphi,phi,Bx,By);
-		B[0] = Bx;
-		B[1] = By;
+		CylToCart(Br, Bphi, cosphi, sinphi, B[0], B[1]);
 		B[2] = Bz;
 	}
 }
@@ -325,62 +343,31 @@ void TabField::EField(const double x, const double y, const double z, const doub
 		double &V, double Ei[3]) const{
 	double r = sqrt(x*x+y*y);
 	if (r >= r_mi && r <= r_mi + rdist*(m - 1) && z >= z_mi && z <= z_mi + zdist*(n - 1)){
-		if (fErc || fEphic || fEzc){ // prefer E-field interpolation over potential interpolation
-			double phi = atan2(y,x);
-//			if (dEidxj == nullptr){
-				alglib::real_1d_array Er("[0]"), Ephi("[0]"), Ez("[0]");
-				double Ex, Ey;
-				if (fErc)
-					alglib::spline2dcalcvbuf(Erc, r, z, Er); // use cheaper interpolation if derivatives not required
-				if (fEphic)
-					alglib::spline2dcalcvbuf(Ephic, r, z, Ephi);
-				if (fEzc)
-					alglib::spline2dcalcvbuf(Ezc, r, z, Ez);
-				CylToCart(Er[0], Ephi[0], phi, Ex, Ey); // convert r,phi components to x,y components
-				Ei[0] = Ex; // set electric field
-				Ei[1] = Ey;
-				Ei[2] = Ez[0];
-/*			}
-			else{
-				double Er = 0, Ephi = 0, Ex = 0, Ey = 0, Ez = 0, dummy;
-				double dErdr, dErdz, dEphidr, dEphidz, dEzdr, dEzdz, dExdz, dEydz;
-				//bicubic interpolation
-				if (fErc)
-					alglib::spline2ddiff(Erc, r, z, Er, dErdr, dErdz, dummy);
-				if (fEphic)
-					alglib::spline2ddiff(Ephic, r, z, Ephi, dEphidr, dEphidz, dummy);
-				if (fEzc)
-					alglib::spline2ddiff(Ezc, r, z, Ez, dEzdr, dEzdz, dummy);
-				CylToCart(Er,Ephi,phi,Ex,Ey); // convert r,phi components to x,y components
-				Ei[0] = Ex*Escale; // set electric field
-				Ei[1] = Ey*Escale;
-				Ei[2] = Ez*Escale;
-				if (r > 0){ // convert r,phi derivatives to x,y derivatives
-					dEidxj[0][0] = Escale*(dErdr*cos(phi)*cos(phi) - dEphidr*cos(phi)*sin(phi) + (Er*sin(phi)*sin(phi) + Ephi*cos(phi)*sin(phi))/r);
-					dEidxj[0][1] = Escale*(dErdr*cos(phi)*sin(phi) - dEphidr*sin(phi)*sin(phi) - (Er*cos(phi)*sin(phi) + Ephi*cos(phi)*cos(phi))/r);
-					dEidxj[1][0] = Escale*(dErdr*cos(phi)*sin(phi) + dEphidr*cos(phi)*cos(phi) - (Er*cos(phi)*sin(phi) - Ephi*sin(phi)*sin(phi))/r);
-					dEidxj[1][1] = Escale*(dErdr*sin(phi)*sin(phi) + dEphidr*cos(phi)*sin(phi) + (Er*cos(phi)*cos(phi) - Ephi*cos(phi)*sin(phi))/r);
-				}
-				CylToCart(dErdz,dEphidz,phi,dExdz,dEydz); // convert z-derivatives of r,phi components into z-derivatives of x,y components
-				dEidxj[0][2] = dExdz*Escale;
-				dEidxj[1][2] = dEydz*Escale;
-				dEidxj[2][0] = dEzdr*cos(phi)*Escale;
-				dEidxj[2][1] = dEzdr*sin(phi)*Escale;
-				dEidxj[2][2] = dEzdz*Escale;
-			}*/
+		// bicubic interpolation
+		double dr, dz;
+		int cell = FindCell(r, z, dr, dz);
+		double cosphi = 1, sinphi = 0; // azimuth is zero on axis, like atan2(0, 0)
+		if (r > 0){
+			cosphi = x/r;
+			sinphi = y/r;
 		}
-
-        else if (fVc){
-            double dVdrj[3], dummy;
-            // bicubic interpolation
-            alglib::spline2ddiff(Vc, r, z, V, dVdrj[0], dVdrj[2], dummy);
-            double phi = atan2(y,x);
-            Ei[0] = -dVdrj[0]*cos(phi);
-            Ei[1] = -dVdrj[0]*sin(phi);
-            Ei[2] = -dVdrj[2];
-        }
-
-
-
-    }
+		if (!Erc.empty() || !Ephic.empty() || !Ezc.empty()){ // prefer E-field interpolation over potential interpolation
+			double Er = 0, Ephi = 0, Ez = 0;
+			if (!Erc.empty())
+				Er = Interpolate(Erc, cell, dr, dz);
+			if (!Ephic.empty())
+				Ephi = Interpolate(Ephic, cell, dr, dz);
+			if (!Ezc.empty())
+				Ez = Interpolate(Ezc, cell, dr, dz);
+			CylToCart(Er, Ephi, cosphi, sinphi, Ei[0], Ei[1]); // convert r,phi components to x,y components
+			Ei[2] = Ez;
+		}
+		else if (!Vc.empty()){
+			double dVdr, dVdz;
+			V = Interpolate(Vc, cell, dr, dz, &dVdr, &dVdz);
+			Ei[0] = -dVdr*cosphi;
+			Ei[1] = -dVdr*sinphi;
+			Ei[2] = -dVdz;
+		}
+	}
 }
@@ -9,116 +9,194 @@
 #include <cmath>
 #include <fstream>
 #include <iostream>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
 
 #include "interpolation.h"
 #include "boost/format.hpp"
 #include <boost/iterator/zip_iterator.hpp>
-#include <boost/algorithm/string.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
 
 #include "tricubic.h"
 #include "globals.h"
+#include "field_octree.h"
 
 /**
- * A faster implementation of the tricubic_eval function from libtricubic.
- * 
- * Uses Horner's scheme.
- * 
- * @param a Interpolation parameters (64 doubles)
- * @param x X coordinate of point field should be evaluated at
- * @param y Y coordinate
- * @param z Z coordinate
- * 
- * @return Interpolated value at point
+ * Optional parameters following the parameters of a 3D table in config.in
  */
-inline double tricubic_eval_fast(double a[64], double x, double y, double z) {
-/*	double result = 0.0;
-	for (int i = 0; i < 4; ++i) {
-		for (int j = 0; j < 4; ++j) {
-			for (int k = 0; k < 4; ++k) {
-				result += a[i + 4 * j + 16 * k] * std::pow(x, i) * std::pow(y, j) * std::pow(z, k);
-			}
-		}
-	}
-    return result;
-*/
-	double rx = 0.;
-	for (int i = 3; i >= 0; --i){
-	    double ry = 0.;
-	    for (int j = 3; j >= 0; --j){
-	        double rz = 0.;
-	        for (int k = 3; k >= 0; --k){
-                rz += a[i + 4*j + 16*k];
-                if (k > 0) rz *= z;
-	        }
-	        ry += rz;
-	        if (j > 0) ry *= y;
-	    }
-	    rx += ry;
-	    if (i > 0) rx *= x;
-	}
+struct TTableOptions{
+    bool compact; ///< true if the parameter "compact" was given
+    bool convert; ///< true if the parameter "convert" was given
+    int octreedepth; ///< maximum depth of octree the table is resampled to, negative if parameter "octree" was not given
+    double Btolerance; ///< tolerance of magnetic field in octree
+    double Vtolerance; ///< tolerance of electric potential in octree
+};
+
 
-	return rx;
+/**
+ * Read optional parameters following the parameters of a 3D table in config.in
+ *
+ * @param ss Stream containing the remaining parameters
+ * @param fieldtype Field type, used in error message
+ * @return Returns options
+ */
+static TTableOptions ReadTableOptions(std::istream &ss, const std::string &fieldtype){
+    TTableOptions options = {false, false, -1, 0, 0};
+    std::string option;
+    while (ss >> option){
+        if (option == "compact")
+            options.compact = true;
+        else if (option == "convert")
+            options.convert = true;
+        else if (option == "octree"){
+            if (!(ss >> options.Btolerance >> options.Vtolerance >> options.octreedepth) || options.octreedepth < 0)
+                throw std::runtime_error((boost::format("Option octree for field %1% requires magnetic-field tolerance, potential tolerance, and maximum depth!") % fieldtype).str());
+        }
+        else
+            throw std::runtime_error((boost::format("Unknown option %1% for field %2%!") % option % fieldtype).str());
+    }
+    return options;
 }
 
 
 /**
- * A faster implementation of the tricubic_eval function from libtricubic.
- * 
- * Uses Horner's scheme.
- * 
- * @param a Interpolation parameters (64 doubles)
- * @param x X coordinate of point field should be evaluated at
- * @param y Y coordinate
- * @param z Z coordinate
- * @param derx Return derx-th derivative with respect to x
- * @param dery Return dery-th derivative with respect to y
- * @param derz Return derz-th derivative with respect to z
- * 
- * @return Interpolated value at point
+ * Resample table on an octree and save table or octree to a binary file next to the table file if requested
+ *
+ * @param table Field table
+ * @param ft Path of table file, relative to config file
+ * @param options Table is resampled if options.octreedepth is not negative, and saved if options.convert is true
+ * @param out Stream to which log messages are written
+ * @return Returns table or octree
  */
-inline double tricubic_eval_fast(double a[64], double x, double y, double z, int derx, int dery, int derz) {
-	// fact[i][n] is the coefficient in front of the nth derivative of x^i.
-	// For instance, d2/dx2 x^3 = 6 x, so fact[3][2] = 6.
-	static double fact[4][4] {
-		{ 1.0, 0.0, 0.0, 0.0 },
-		{ 1.0, 1.0, 0.0, 0.0 },
-		{ 1.0, 2.0, 2.0, 0.0 },
-		{ 1.0, 3.0, 6.0, 6.0 },
-	};
-/*
-	double result = 0.0;
-	for (int i = derx; i <= 3; ++i) {
-		for (int j = dery; j <= 3; ++j) {
-			for (int k = derz; k <= 3; ++k) {
-				double deriv_factor = fact[i][derx] * fact[j][dery] * fact[k][derz];
-				double pow_factor = std::pow(x, i - derx) * std::pow(y, j - dery) * std::pow(z, k - derz);
-				result += a[i + 4 * j + 16 * k] * pow_factor * deriv_factor;
-			}
-		}
-	}
-    return result;
-*/
-    double rx = 0.;
-    for (int i = 3; i >= derx; --i){
-        double ry = 0.;
-        for (int j = 3; j >= dery; --j){
-            double rz = 0.;
-            for (int k = 3; k >= derz; --k){
-                rz += fact[k][derz] * a[i + 4*j + 16*k];
-                if (k > derz) rz *= z;
+static std::unique_ptr<TField> ConvertTable(std::unique_ptr<TabField3> table, const boost::filesystem::path &ft, const TTableOptions &options, std::ostream &out){
+    boost::filesystem::path binfile = boost::filesystem::absolute(ft, configpath.parent_path());
+    if (options.octreedepth >= 0){
+        double min[3], max[3];
+        bool hasB, hasV;
+        table->GetGridBounds(min, max);
+        table->GetComponents(hasB, hasV);
+        const TabField3 &t = *table;
+        double upper[3]; // table excludes its upper bounds, so sample just below them
+        for (int i = 0; i < 3; ++i)
+            upper[i] = std::nextafter(max[i], min[i]);
+        auto sampler = [&t, &upper](const double x, const double y, const double z, double F[4], double dFidxj[4][3]){
+            double E[3] = {0, 0, 0};
+            for (int i = 0; i < 4; ++i){
+                F[i] = 0;
+                for (int j = 0; j < 3; ++j)
+                    dFidxj[i][j] = 0;
             }
-            ry += fact[j][dery] * rz;
-            if (j > dery) ry *= y;
+            double p[3] = {std::min(x, upper[0]), std::min(y, upper[1]), std::min(z, upper[2])};
+            t.BField(p[0], p[1], p[2], 0, F, dFidxj);
+            t.EField(p[0], p[1], p[2], 0, F[3], E);
+            for (int j = 0; j < 3; ++j)
+                dFidxj[3][j] = -E[j];
+        };
+        out << "Resampling table on octree with tolerances " << options.Btolerance << " and " << options.Vtolerance << " and maximum depth " << options.octreedepth << "\n";
+        std::unique_ptr<TOctreeField> octree(new TOctreeField({{min[0], min[1], min[2]}}, {{max[0], max[1], max[2]}}, sampler,
+                                                              hasB, hasV, options.Btolerance, options.Vtolerance, options.octreedepth, out));
+        if (options.convert){
+            binfile += ".octree";
+            octree->Save(binfile.string());
+            out << "Saved octree to " << binfile << ", it can be loaded with field type BINARYOCTREE\n";
         }
-        rx += fact[i][derx] * ry;
-        if (i > derx) rx *= x;
+        return std::move(octree);
     }
+    if (options.convert){
+        binfile += ".bin";
+        table->Save(binfile.string());
+        out << "Saved table to " << binfile << ", it can be loaded with field type BINARY3D\n";
+    }
+    return std::move(table);
+}
 
-	return rx;
+
+/**
+ * Read numeric columns of a text table.
+ *
+ * Maps the file into memory and parses its lines with std::strtod, distributing chunks of lines over several threads.
+ * Empty lines and lines starting with one of the comment characters are skipped, all other lines have to contain exactly ncols numbers.
+ *
+ * @param filename Path of table file
+ * @param offset Position in file where the table starts
+ * @param ncols Number of columns
+ * @param delimiters Characters separating numbers
+ * @param comments Characters marking comment lines
+ * @return Returns list of values in each column
+ */
+static std::vector<std::vector<double> > ReadColumns(const std::string &filename, const std::size_t offset, const std::size_t ncols,
+                                                     const char *delimiters, const char *comments){
+    std::vector<std::vector<double> > columns(ncols);
+    if (boost::filesystem::file_size(filename) <= offset)
+        return columns;
+    boost::interprocess::mapped_region region;
+    try{
+        boost::interprocess::file_mapping file(filename.c_str(), boost::interprocess::read_only);
+        boost::interprocess::mapped_region(file, boost::interprocess::read_only).swap(region);
+    }
+    catch (boost::interprocess::interprocess_exception &e){
+        throw std::runtime_error((boost::format("Could not open %1%: %2%") % filename % e.what()).str());
+    }
+    const char *data = static_cast<const char*>(region.get_address());
+    const char *begin = data + offset, *end = data + region.get_size();
+
+    // split table into chunks of about 4MB at line ends
+    std::size_t nchunks = std::max<std::size_t>(1, (end - begin) >> 22);
+    std::vector<const char*> bounds(1, begin);
+    for (std::size_t c = 1; c < nchunks; ++c){
+        const char *b = std::find(std::max(begin + (end - begin)*c/nchunks, bounds.back()), end, '\n');
+        bounds.push_back(b == end ? end : b + 1);
+    }
+    bounds.push_back(end);
+
+    std::vector<std::vector<std::vector<double> > > chunks(nchunks, std::vector<std::vector<double> >(ncols));
+    parallel_for(nchunks, [&](const std::size_t c){
+        std::string line;
+        std::vector<double> values;
+        for (const char *p = bounds[c]; p < bounds[c + 1]; ){
+            const char *eol = std::find(p, bounds[c + 1], '\n');
+            line.assign(p, eol); // copy line to get a null-terminated string for strtod
+            const char *linestart = p;
+            p = eol == bounds[c + 1] ? eol : eol + 1;
+
+            const char *s = line.c_str();
+            s += std::strspn(s, delimiters);
+            if (*s == 0 || std::strchr(comments, *s) != nullptr) // skip empty and commented lines
+                continue;
+            values.clear();
+            while (*s != 0){
+                char *e;
+                double v = std::strtod(s, &e);
+                if (e == s || (*e != 0 && std::strchr(delimiters, *e) == nullptr))
+                    break;
+                values.push_back(v);
+                s = e + std::strspn(e, delimiters);
+            }
+            if (*s != 0 || values.size() != ncols)
+                throw std::runtime_error((boost::format("Error reading line %1% of file %2%") % (std::count(data, linestart, '\n') + 1) % filename).str());
+            for (std::size_t i = 0; i < ncols; ++i)
+                chunks[c][i].push_back(values[i]);
+        }
+    });
+
+    for (std::size_t i = 0; i < ncols; ++i){
+        std::size_t n = 0;
+        for (auto &chunk: chunks)
+            n += chunk[i].size();
+        columns[i].reserve(n);
+        for (auto &chunk: chunks){
+            columns[i].insert(columns[i].end(), chunk[i].begin(), chunk[i].end());
+            std::vector<double>().swap(chunk[i]);
+        }
+    }
+    return columns;
 }
 
 
-TFieldContainer ReadComsolField(const std::string &params){
+TFieldContainer ReadComsolField(const std::string &params, std::ostream &out){
   std::istringstream ss(params);
   boost::filesystem::path ft;
   std::string fieldtype, Bscale;
@@ -127,50 +205,48 @@ TFieldContainer ReadComsolField(const std::string &params){
   if (!ss){
       throw std::runtime_error((boost::format("Could not read all required parameters for field %1%!") % fieldtype).str());
   }
+  TTableOptions options = ReadTableOptions(ss, fieldtype);
 
-  std::string line;
-  std::vector<std::string> line_parts;
-  std::vector<double> x, y, z;
-  std::vector<double> bx, by, bz;
-
-  std::ifstream FIN(boost::filesystem::absolute(ft, configpath.parent_path()).string(), std::ifstream::in);
-	if (!FIN.is_open()){
+  boost::filesystem::path filename = boost::filesystem::absolute(ft, configpath.parent_path());
+  if (!std::ifstream(filename.string()).is_open()){
     throw std::runtime_error("Could not open " + ft.string());
   }
-  std::cout << "\nReading " << ft << "\n";
-
-  // Read in file data
-  int lineNum = 0;
-
-  while (getline(FIN,line)){
-    lineNum++;
-    if (line.substr(0,1) == "%" || line.substr(0,1) == "#") continue;     // Skip commented lines
-    boost::split(line_parts, line, boost::is_any_of("\t, "), boost::token_compress_on); //Delineate tab, space, commas
-
-    if (line_parts.size() != 6){
-      throw std::runtime_error((boost::format("Error reading line %1% of file %2%") % lineNum % ft.string()).str());
-    }
-
-    x.push_back( std::stod(line_parts[0], nullptr) * lengthconv);
-    y.push_back( std::stod(line_parts[1], nullptr) * lengthconv);
-    z.push_back( std::stod(line_parts[2], nullptr) * lengthconv);
-    bx.push_back( std::stod(line_parts[3], nullptr));
-    by.push_back( std::stod(line_parts[4], nullptr));
-    bz.push_back( std::stod(line_parts[5], nullptr));
-  }
+  out << "\nReading " << ft << "\n";
 
-  FIN.close();
-  if (x.empty() || y.empty() || z.empty() || bx.empty() || by.empty()|| bz.empty() ) {
+  std::vector<std::vector<double> > columns = ReadColumns(filename.string(), 0, 6, "\t, \r", "%#"); // values are delimited by tabs, spaces, or commas, % and # mark comments
+  std::vector<double> &x = columns[0], &y = columns[1], &z = columns[2];
+  std::vector<double> &bx = columns[3], &by = columns[4], &bz = columns[5];
+  if (x.empty()) {
     throw std::runtime_error("No data read from " + ft.string());
   }
+  for (unsigned i = 0; i < 3; ++i){
+    for (auto &c: columns[i])
+      c *= lengthconv;
+  }
 
   auto xminmax = std::minmax_element(x.begin(), x.end());
   auto yminmax = std::minmax_element(y.begin(), y.end());
   auto zminmax = std::minmax_element(z.begin(), z.end());
-  return TFieldContainer(std::unique_ptr<TabField3>(new TabField3({x,y,z}, {bx,by,bz}, std::vector<double>())), Bscale, "0", *xminmax.second, *xminmax.first, *yminmax.second, *yminmax.first, *zminmax.second, *zminmax.first, BoundaryWidth);
+  return TFieldContainer(ConvertTable(std::unique_ptr<TabField3>(new TabField3({{x,y,z}}, {{bx,by,bz}}, std::vector<double>(), options.compact, out)), ft, options, out), Bscale, "0", *xminmax.second, *xminmax.first, *yminmax.second, *yminmax.first, *zminmax.second, *zminmax.first, BoundaryWidth);
+}
+
+TFieldContainer ReadBinaryField3(const std::string &params, std::ostream &out){
+    std::istringstream ss(params);
+    boost::filesystem::path ft;
+    std::string fieldtype, Bscale, Escale;
+    double BoundaryWidth;
+    ss >> fieldtype >> ft >> Bscale >> Escale >> BoundaryWidth;
+    if (!ss){
+        throw std::runtime_error((boost::format("Could not read all required parameters for field %1%!") % fieldtype).str());
+    }
+    std::unique_ptr<TabField3> table(new TabField3(boost::filesystem::absolute(ft, configpath.parent_path()).string(), out));
+    double min[3], max[3];
+    table->GetGridBounds(min, max);
+    return TFieldContainer(std::move(table), Bscale, Escale, max[0], min[0], max[1], min[1], max[2], min[2], BoundaryWidth);
 }
 
-TFieldContainer ReadOperaField3(const std::string &params){
+
+TFieldContainer ReadOperaField3(const std::string &params, std::ostream &out){
     std::istringstream ss(params);
     boost::filesystem::path ft;
     std::string fieldtype, Bscale, Escale;
@@ -178,7 +254,7 @@ TFieldContainer ReadOperaField3(const std::string &params){
     ss >> fieldtype;
     if (fieldtype == "3Dtable"){
         ss >> ft >> Bscale >> Escale >> BoundaryWidth; // read fieldtype, tablefilename, and rest of parameters
-        std::cout << "Field type " << fieldtype << " is deprecated. Consider using the new OPERA3D format. I'm assuming that file " << ft << " is using centimeters, Gauss, Volt/centimeter, and Volts as units.\n";
+        out << "Field type " << fieldtype << " is deprecated. Consider using the new OPERA3D format. I'm assuming that file " << ft << " is using centimeters, Gauss, Volt/centimeter, and Volts as units.\n";
         Bscale = "(" + Bscale + ")*0.0001"; // scale magnetic field to Tesla
         Escale = "(" + Escale + ")*100"; // scale electric field to Volt/meter
         lengthconv = 0.01;
@@ -192,11 +268,12 @@ TFieldContainer ReadOperaField3(const std::string &params){
     if (!ss){
         throw std::runtime_error((boost::format("Could not read all required parameters for field %1%!") % fieldtype).str());
     }
+    TTableOptions options = ReadTableOptions(ss, fieldtype);
 
     std::ifstream FIN(boost::filesystem::absolute(ft, configpath.parent_path()).string(), std::ifstream::in);
     if (!FIN.is_open())
         throw std::runtime_error((boost::format("\nCould not open %1%!\n") % ft).str());
-    std::cout << "\nReading " << ft << " ";
+    out << "\nReading " << ft << " ";
 	std::string line;
     int xl, yl, zl;
 	FIN >> xl >> yl >> zl;
@@ -209,9 +286,6 @@ TFieldContainer ReadOperaField3(const std::string &params){
 
     std::array<std::vector<double>, 3> xyzTab, BTab;
     std::vector<double> VTab;
-    for (auto &xi: xyzTab){
-        xi.resize(xl * yl * zl);
-    }
 	if (line.find("BX") != std::string::npos){
         BTab[0].resize(xl*yl*zl);
 		getline(FIN,line);
@@ -231,122 +305,91 @@ TFieldContainer ReadOperaField3(const std::string &params){
 	}
 
 	if (!FIN || line.substr(0,2) != " 0"){
-        std::cout << ft << " not found or corrupt! Exiting...\n";
-		exit(-1);
+        throw std::runtime_error((boost::format("%1% not found or corrupt!") % ft).str());
 	}
 
-	std::vector<double> xind(xl), yind(yl), zind(zl);
-	progress_display progress(xl*yl*zl, std::cout);
-    int i = 0;
-	while (FIN.good()){
-        double x, y, z, val;
-		FIN >> x;
-		FIN >> y;
-		FIN >> z;
-		if (!FIN) break;
-		x *= lengthconv;
-		y *= lengthconv;
-		z *= lengthconv;
-
-		// status if read is displayed
-		++progress;
-
-        xyzTab[0][i] = x;
-        xyzTab[1][i] = y;
-        xyzTab[2][i] = z;
-        if (not BTab[0].empty()){
-			FIN >> val;
-            BTab[0][i] = val;
-		}
-        if (not BTab[1].empty()){
-			FIN >> val;
-            BTab[1][i] = val;
-		}
-        if (not BTab[2].empty()){
-			FIN >> val;
-            BTab[2][i] = val;
-		}
-		if (not VTab.empty()){
-			FIN >> val;
-            VTab[i] = val;
-		}
-		FIN >> std::ws;
-        ++i;
-	}
+	std::size_t offset = FIN.tellg();
+	FIN.close();
 
-	std::cout << "\n";
-    if (i != xl*yl*zl){
-        throw std::runtime_error((boost::format("The header says the size is %1%, actually it is %2%! Exiting...\n") % (xl*yl*zl) % i).str());
+	std::vector<std::vector<double>*> columns = {&xyzTab[0], &xyzTab[1], &xyzTab[2]}; // collect columns found in header
+	for (auto &B: BTab){
+		if (not B.empty())
+			columns.push_back(&B);
 	}
-	FIN.close();
+	if (not VTab.empty())
+		columns.push_back(&VTab);
+	std::vector<std::vector<double> > values = ReadColumns(boost::filesystem::absolute(ft, configpath.parent_path()).string(), offset, columns.size(), " \t\r", "");
+	if (values[0].size() != static_cast<std::size_t>(xl*yl*zl)){
+        throw std::runtime_error((boost::format("The header says the size is %1%, actually it is %2%! Exiting...\n") % (xl*yl*zl) % values[0].size()).str());
+	}
+	for (std::size_t i = 0; i < columns.size(); ++i)
+		columns[i]->swap(values[i]);
+	for (unsigned i = 0; i < 3; ++i){
+		for (auto &c: xyzTab[i])
+			c *= lengthconv;
+	}
+	out << "read " << xyzTab[0].size() << " points\n";
 
     auto xminmax = std::minmax_element(xyzTab[0].begin(), xyzTab[0].end());
     auto yminmax = std::minmax_element(xyzTab[1].begin(), xyzTab[1].end());
     auto zminmax = std::minmax_element(xyzTab[2].begin(), xyzTab[2].end());
-    return TFieldContainer(std::unique_ptr<TabField3>(new TabField3(xyzTab, BTab, VTab)), Bscale, Escale, *xminmax.second, *xminmax.first, *yminmax.second, *yminmax.first, *zminmax.second, *zminmax.first, BoundaryWidth);
+    return TFieldContainer(ConvertTable(std::unique_ptr<TabField3>(new TabField3(xyzTab, BTab, VTab, options.compact, out)), ft, options, out), Bscale, Escale, *xminmax.second, *xminmax.first, *yminmax.second, *yminmax.first, *zminmax.second, *zminmax.first, BoundaryWidth);
 }
 
 
-void TabField3::CheckTab(const std::array<std::vector<double>, 3> &B, const std::vector<double> &V){
+void TabField3::CheckTab(const std::array<std::vector<double>, 3> &B, const std::vector<double> &V, std::ostream &out){
 	//  calculate factors for conversion of coordinates to indexes  r = conv_rA + index * conv_rB
-    std::cout << "The arrays are " << xyz[0].size() << " by " << xyz[1].size() << " by " << xyz[2].size()
+    out << "The arrays are " << xyz[0].size() << " by " << xyz[1].size() << " by " << xyz[2].size()
               << " (" << B[0].size() << ", " << B[1].size() << ", " << B[2].size() << ", " << V.size() << " field components).\n";
-    std::cout << "The x values go from " << xyz[0].front() << " to " << xyz[0].back() << "\n";
-    std::cout << "The y values go from " << xyz[1].front() << " to " << xyz[1].back() << "\n";
-    std::cout << "The z values go from " << xyz[2].front() << " to " << xyz[2].back() << ".\n";
+    out << "The x values go from " << xyz[0].front() << " to " << xyz[0].back() << "\n";
+    out << "The y values go from " << xyz[1].front() << " to " << xyz[1].back() << "\n";
+    out << "The z values go from " << xyz[2].front() << " to " << xyz[2].back() << ".\n";
 
     std::vector<double> Babs;
     std::transform( boost::make_zip_iterator(boost::make_tuple(B[0].begin(), B[1].begin(), B[2].begin())),
                     boost::make_zip_iterator(boost::make_tuple(B[0].end(), B[1].end(), B[2].end())), std::back_inserter(Babs),
                     [](const boost::tuple<double,double,double> &Bs){ return std::sqrt(std::pow(Bs.get<0>(), 2) + std::pow(Bs.get<1>(), 2) + std::pow(Bs.get<2>(), 2)); });
-    std::cout << "The input table file has values of magnetic field |B| from " << *std::min_element(Babs.begin(), Babs.end()) << " to " << *std::max_element(Babs.begin(), Babs.end());
+    out << "The input table file has values of magnetic field |B| from " << *std::min_element(Babs.begin(), Babs.end()) << " to " << *std::max_element(Babs.begin(), Babs.end());
     if (not V.empty())
-        std::cout << " and values of electric potential from " << *std::min_element(V.begin(), V.end()) << " to " << *std::max_element(V.begin(), V.end());
-    std::cout << std::endl;
+        out << " and values of electric potential from " << *std::min_element(V.begin(), V.end()) << " to " << *std::max_element(V.begin(), V.end());
+    out << std::endl;
 
     unsigned long l = xyz[0].size() * xyz[1].size() * xyz[2].size();
     if ((not B[0].empty() && B[0].size() != l) || (not B[1].empty() && B[1].size() != l) || (not B[2].empty() && B[2].size() != l) || (not V.empty() && V.size() != l))
-        std::cout << "Warning: Number of field samples does not match number of grid points! Missing points will default to zero field\n";
+        out << "Warning: Number of field samples does not match number of grid points! Missing points will default to zero field\n";
 }
 
 
 void TabField3::CalcDerivs(const array3D &Tab, const unsigned long diff_dim, array3D &DiffTab) const
 {
-	alglib::real_1d_array x, y, diff;
-    std::array<unsigned long, 3> index;
+	alglib::real_1d_array x;
     DiffTab.resize(boost::extents[Tab.shape()[0]][Tab.shape()[1]][Tab.shape()[2]]);
     unsigned long len = xyz[diff_dim].size();
     x.setcontent(len, &xyz[diff_dim][0]);
-    y.setlength(len);
-    diff.setlength(len);
-//    std::cout << "x: " << x.tostring(2) << std::endl;
 
     unsigned long dim1 = (diff_dim + 1) % 3;
     unsigned long dim2 = (diff_dim + 2) % 3;
-    for (index[dim1] = 0; index[dim1] < xyz[dim1].size(); index[dim1] = index[dim1] + 1){ // iterate over all indices in both other dimensions
-        for (index[dim2] = 0; index[dim2] < xyz[dim2].size(); index[dim2] = index[dim2] + 1){
-//            std::copy(index.begin(), index.end(), std::ostream_iterator<unsigned long>(std::cout, " "));
+    parallel_for(xyz[dim1].size(), [&](const size_t i1){ // grid lines are independent, distribute them over several threads
+        alglib::real_1d_array y, diff;
+        y.setlength(len);
+        diff.setlength(len);
+        std::array<unsigned long, 3> index;
+        index[dim1] = i1;
+        for (index[dim2] = 0; index[dim2] < xyz[dim2].size(); index[dim2] = index[dim2] + 1){ // iterate over all indices in both other dimensions
             for (index[diff_dim] = 0; index[diff_dim] < len; index[diff_dim] = index[diff_dim] + 1){
                 y[index[diff_dim]] = Tab(index);
             }
-//            std::cout << "y: " << y.tostring(2) << std::endl;
             alglib::spline1dgriddiffcubic(x,y,diff); // get derivatives with respect to coordinate dimension diff_dim
-//            std::cout << " diff: " << diff.tostring(2) << std::endl;
             for (index[diff_dim] = 0; index[diff_dim] < len; index[diff_dim] = index[diff_dim] + 1){
                 DiffTab(index) = diff[index[diff_dim]];
             }
-//            std::cout << " diff: " << diff.tostring(2) << std::endl;
 		}
-	}
+	});
 }
 
 
-void TabField3::PreInterpol(const array3D &Tab, field_type &coeff) const{
-    std::array<unsigned long, 3> len;
-    for (unsigned long i = 0; i < 3; ++i){
-        len[i] = xyz[i].size() - 1;
-    }
-    coeff.resize(len);
+void TabField3::CalcNodes(const array3D &Tab, node_type &nodes) const{
+    nodes.resize(boost::extents[xyz[0].size()][xyz[1].size()][xyz[2].size()]);
 
     array3D dFdx, dFdy, dFdz, dFdxdy, dFdxdz, dFdydz, dFdxdydz; // derivatives with respect to x, y, z, xy, xz, yz, xyz
     CalcDerivs(Tab, 0, dFdx); // dF/dx
@@ -357,7 +400,24 @@ void TabField3::PreInterpol(const array3D &Tab, field_type &coeff) const{
     CalcDerivs(dFdy, 2, dFdydz); // d2F/dydz
     CalcDerivs(dFdxdy, 2, dFdxdydz); // d3F/dxdydz
 
-    for (unsigned long ix = 0; ix < len[0]; ++ix){
+    std::array<const array3D*, 8> derivs = {&Tab, &dFdx, &dFdy, &dFdxdy, &dFdz, &dFdxdz, &dFdydz, &dFdxdydz}; // order according to bits in node_derivs
+    for (unsigned i = 0; i < 8; ++i){
+        const double *d = derivs[i]->data();
+        node_derivs *n = nodes.data();
+        for (unsigned long j = 0; j < nodes.num_elements(); ++j)
+            n[j][i] = d[j];
+    }
+}
+
+
+void TabField3::PreInterpol(const node_type &nodes, field_type &coeff) const{
+    std::array<unsigned long, 3> len;
+    for (unsigned long i = 0; i < 3; ++i){
+        len[i] = xyz[i].size() - 1;
+    }
+    coeff.resize(len);
+
+    parallel_for(len[0], [&](const size_t ix){ // grid cells are independent, distribute them over several threads
         for (unsigned long iy = 0; iy < len[1]; ++iy){
             for (unsigned long iz = 0; iz < len[2]; ++iz){
                 std::array<std::array<unsigned long, 3>, 8> indices;
@@ -375,23 +435,25 @@ void TabField3::PreInterpol(const array3D &Tab, field_type &coeff) const{
                 double cellz = xyz[2][iz+1] - xyz[2][iz];
                 std::array<std::array<double, 8>, 8> yyy;
                 for (unsigned i = 0; i < 8; ++i){
-                    yyy[0][i] = Tab(indices[i]); // get values and derivatives at each corner of grid cell
-                    yyy[1][i] = dFdx(indices[i])*cellx;
-                    yyy[2][i] = dFdy(indices[i])*celly;
-                    yyy[3][i] = dFdz(indices[i])*cellz;
-                    yyy[4][i] = dFdxdy(indices[i])*cellx*celly;
-                    yyy[5][i] = dFdxdz(indices[i])*cellx*cellz;
-                    yyy[6][i] = dFdydz(indices[i])*celly*cellz;
-                    yyy[7][i] = dFdxdydz(indices[i])*cellx*celly*cellz;
+                    const node_derivs &n = nodes(indices[i]);
+                    yyy[0][i] = n[0]; // get values and derivatives at each corner of grid cell
+                    yyy[1][i] = n[1]*cellx;
+                    yyy[2][i] = n[2]*celly;
+                    yyy[3][i] = n[4]*cellz;
+                    yyy[4][i] = n[3]*cellx*celly;
+                    yyy[5][i] = n[5]*cellx*cellz;
+                    yyy[6][i] = n[6]*celly*cellz;
+                    yyy[7][i] = n[7]*cellx*celly*cellz;
                 }
                 tricubic_get_coeff(&coeff(indices[0])[0], &yyy[0][0], &yyy[1][0], &yyy[2][0], &yyy[3][0], &yyy[4][0], &yyy[5][0], &yyy[6][0], &yyy[7][0]); // calculate tricubic interpolation coefficients and store in coeff
 			}
 		}
-	}
+	});
 }
 
 
-TabField3::TabField3(const std::array<std::vector<double>, 3> &xyzTab, const std::array<std::vector<double>, 3> &BTab, const std::vector<double> &VTab){
+TabField3::TabField3(const std::array<std::vector<double>, 3> &xyzTab, const std::array<std::vector<double>, 3> &BTab, const std::vector<double> &VTab,
+                     const bool compact, std::ostream &out): compact(compact){
 
     for (unsigned i = 0; i < 3; ++i){
         std::unique_copy(xyzTab[i].begin(), xyzTab[i].end(), std::back_inserter(xyz[i])); // get list of unique x, y, and z coordinates
@@ -399,7 +461,8 @@ TabField3::TabField3(const std::array<std::vector<double>, 3> &xyzTab, const std
         auto last = std::unique(xyz[i].begin(), xyz[i].end());
         xyz[i].erase(last, xyz[i].end());
 	}
-    CheckTab(BTab,VTab); // print some info
+    CheckGridSpacing();
+    CheckTab(BTab, VTab, out); // print some info
 
 
     std::array<array3D, 3> B;
@@ -431,75 +494,319 @@ TabField3::TabField3(const std::array<std::vector<double>, 3> &xyzTab, const std
             V(index) = VTab[i];
 	}
 
-	std::cout << "Starting Preinterpolation ... ";
+	out << "Starting Preinterpolation ... ";
 	float size = 0;
-    if (not BTab[0].empty()){
-		std::cout << "Bx ... ";
-		std::cout.flush();
-        PreInterpol(B[0], Bc[0]); // precalculate interpolation coefficients for B field
-        size += float(Bc[0].num_elements()*64*sizeof(double)/1024/1024);
-	}
-    if (not BTab[1].empty()){
-		std::cout << "By ... ";
-		std::cout.flush();
-        PreInterpol(B[1], Bc[1]);
-        size += float(Bc[1].num_elements()*64*sizeof(double)/1024/1024);
-	}
-    if (not BTab[2].empty()){
-		std::cout << "Bz ... ";
-		std::cout.flush();
-        PreInterpol(B[2], Bc[2]);
-        size += float(Bc[2].num_elements()*64*sizeof(double)/1024/1024);
+    const char *names[3] = {"Bx ... ", "By ... ", "Bz ... "};
+    for (unsigned i = 0; i < 3; ++i){
+        if (not BTab[i].empty()){
+            out << names[i];
+            out.flush();
+            CalcNodes(B[i], Bn[i]); // calculate derivatives of B field on grid points
+            if (compact)
+                size += float(Bn[i].num_elements()*sizeof(node_derivs))/1024/1024;
+            else{
+                PreInterpol(Bn[i], Bc[i]); // precalculate interpolation coefficients for B field
+                Bn[i].resize(boost::extents[0][0][0]);
+                size += float(Bc[i].num_elements()*sizeof(tricubic_coeff))/1024/1024;
+            }
+        }
 	}
 	if (not VTab.empty()){
-		std::cout << "V ... ";
-		std::cout.flush();
-        PreInterpol(V, Vc);
-        size += float(Vc.num_elements()*64*sizeof(double)/1024/1024);
+		out << "V ... ";
+		out.flush();
+        CalcNodes(V, Vn);
+        if (compact)
+            size += float(Vn.num_elements()*sizeof(node_derivs))/1024/1024;
+        else{
+            PreInterpol(Vn, Vc);
+            Vn.resize(boost::extents[0][0][0]);
+            size += float(Vc.num_elements()*sizeof(tricubic_coeff))/1024/1024;
+        }
 	}
-	std::cout << "Done (" << size << " MB)\n";
+	out << "Done (" << size << " MB" << (compact ? " in compact mode" : "") << ")\n";
+
+    for (unsigned i = 0; i < 3; ++i){
+        Bdata[i] = nullptr;
+        if (not BTab[i].empty())
+            Bdata[i] = compact ? &Bn[i].data()[0][0] : &Bc[i].data()[0][0];
+    }
+    Vdata = nullptr;
+    if (not VTab.empty())
+        Vdata = compact ? &Vn.data()[0][0] : &Vc.data()[0][0];
 }
 
 
-void TabField3::Interpolate(const double x, const double y, const double z,
-                            const field_type& coeffs, double &F, double dFdxi[3]) const {
-    std::array<double, 3> r = {x, y, z}, dist;
-	// get coordinate index
-    std::array<long, 3> index;
+namespace{
+const char binary_id[16] = "PENTrackTable3D"; ///< identifier at start of binary table files
+const uint32_t binary_version = 1; ///< version of binary table format
+
+/**
+ * Header of binary table file, see TabField3::Save
+ */
+struct TBinaryTableHeader{
+    char id[16];
+    uint32_t version, compact, components, reserved;
+    uint64_t size[3];
+};
+}
+
+
+TabField3::TabField3(const std::string &filename, std::ostream &out){
+    out << "\nMapping " << filename << " ... ";
+    std::shared_ptr<boost::interprocess::mapped_region> region;
+    try{
+        boost::interprocess::file_mapping file(filename.c_str(), boost::interprocess::read_only);
+        region = std::make_shared<boost::interprocess::mapped_region>(file, boost::interprocess::read_only);
+    }
+    catch (boost::interprocess::interprocess_exception &e){
+        throw std::runtime_error((boost::format("Could not open %1%: %2%") % filename % e.what()).str());
+    }
+    mapping = region;
+
+    const char *begin = static_cast<const char*>(region->get_address());
+    std::size_t filesize = region->get_size();
+    TBinaryTableHeader header;
+    if (filesize < sizeof(header))
+        throw std::runtime_error(filename + " is not a binary table file!");
+    std::copy(begin, begin + sizeof(header), reinterpret_cast<char*>(&header));
+    if (not std::equal(header.id, header.id + sizeof(header.id), binary_id))
+        throw std::runtime_error(filename + " is not a binary table file!");
+    if (header.version != binary_version)
+        throw std::runtime_error((boost::format("%1% has unsupported version %2% (expected %3%)") % filename % header.version % binary_version).str());
+    compact = header.compact != 0;
+
+    const double *data = reinterpret_cast<const double*>(begin + sizeof(header));
+    uint64_t npoints = header.size[0] + header.size[1] + header.size[2];
+    uint64_t ncells = 1, nnodes = 1;
+    for (unsigned i = 0; i < 3; ++i){
+        if (header.size[i] < 2)
+            throw std::runtime_error(filename + " contains a grid with less than two points along an axis!");
+        ncells *= header.size[i] - 1;
+        nnodes *= header.size[i];
+    }
+    uint64_t blocksize = compact ? nnodes*std::tuple_size<node_derivs>::value : ncells*std::tuple_size<tricubic_coeff>::value;
+    uint64_t ndata = npoints;
+    for (unsigned i = 0; i < 4; ++i){
+        if (header.components & (1u << i))
+            ndata += blocksize;
+    }
+    if (filesize != sizeof(header) + ndata*sizeof(double))
+        throw std::runtime_error((boost::format("%1% should contain %2% bytes, but contains %3%!") % filename % (sizeof(header) + ndata*sizeof(double)) % filesize).str());
+
+    for (unsigned i = 0; i < 3; ++i){
+        xyz[i].assign(data, data + header.size[i]);
+        data += header.size[i];
+    }
+    CheckGridSpacing();
+    for (unsigned i = 0; i < 3; ++i){
+        Bdata[i] = nullptr;
+        if (header.components & (1u << i)){
+            Bdata[i] = data;
+            data += blocksize;
+        }
+    }
+    Vdata = nullptr;
+    if (header.components & (1u << 3))
+        Vdata = data;
+
+    out << "The arrays are " << xyz[0].size() << " by " << xyz[1].size() << " by " << xyz[2].size() << (compact ? " in compact mode" : "") << ".\n";
+    out << "The x values go from " << xyz[0].front() << " to " << xyz[0].back() << "\n";
+    out << "The y values go from " << xyz[1].front() << " to " << xyz[1].back() << "\n";
+    out << "The z values go from " << xyz[2].front() << " to " << xyz[2].back() << ".\n";
+}
+
+
+void TabField3::Save(const std::string &filename) const{
+    TBinaryTableHeader header;
+    std::copy(binary_id, binary_id + sizeof(binary_id), header.id);
+    header.version = binary_version;
+    header.compact = compact;
+    header.components = 0;
+    header.reserved = 0;
+    uint64_t ncells = 1, nnodes = 1;
+    for (unsigned i = 0; i < 3; ++i){
+        header.size[i] = xyz[i].size();
+        ncells *= xyz[i].size() - 1;
+        nnodes *= xyz[i].size();
+        if (Bdata[i] != nullptr)
+            header.components |= 1u << i;
+    }
+    if (Vdata != nullptr)
+        header.components |= 1u << 3;
+    uint64_t blocksize = compact ? nnodes*std::tuple_size<node_derivs>::value : ncells*std::tuple_size<tricubic_coeff>::value;
+
+    std::ofstream f(filename, std::ios::binary);
+    f.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    for (unsigned i = 0; i < 3; ++i)
+        f.write(reinterpret_cast<const char*>(&xyz[i][0]), xyz[i].size()*sizeof(double));
+    for (const double *d: {Bdata[0], Bdata[1], Bdata[2], Vdata}){
+        if (d != nullptr)
+            f.write(reinterpret_cast<const char*>(d), blocksize*sizeof(double));
+    }
+    if (!f)
+        throw std::runtime_error("Could not write " + filename);
+}
+
+
+void TabField3::GetGridBounds(double min[3], double max[3]) const{
+    for (unsigned i = 0; i < 3; ++i){
+        min[i] = xyz[i].front();
+        max[i] = xyz[i].back();
+    }
+}
+
+
+void TabField3::GetComponents(bool &B, bool &V) const{
+    B = Bdata[0] != nullptr || Bdata[1] != nullptr || Bdata[2] != nullptr;
+    V = Vdata != nullptr;
+}
+
+
+void TabField3::CheckGridSpacing(){
+    for (unsigned i = 0; i < 3; ++i){
+        // check if grid is evenly spaced along this axis, allowing cells to be found without binary search
+        gridstep[i] = (xyz[i].back() - xyz[i].front())/(xyz[i].size() - 1);
+        for (unsigned long j = 0; j < xyz[i].size(); ++j){
+            if (std::abs(xyz[i][j] - (xyz[i].front() + j*gridstep[i])) > 1e-6*gridstep[i]){
+                gridstep[i] = 0;
+                break;
+            }
+        }
+    }
+}
+
+
+bool TabField3::FindCell(const double x, const double y, const double z,
+                            std::array<long, 3> &index, std::array<double, 3> &r, std::array<double, 3> &dist) const{
+    r = {x, y, z};
+    for (unsigned i = 0; i < 3; ++i){
+        const std::vector<double> &c = xyz[i];
+        if (not (r[i] >= c.front() && r[i] < c.back())) // if x,y,z are outside bounds of field
+            return false;
+        long low;
+        if (gridstep[i] > 0){
+            low = std::min(static_cast<long>((r[i] - c.front())/gridstep[i]), static_cast<long>(c.size()) - 2);
+            if (r[i] < c[low]) // correct rounding errors and small deviations from even spacing
+                --low;
+            else if (r[i] >= c[low + 1])
+                ++low;
+        }
+        else
+            low = std::distance(c.begin(), std::upper_bound(c.begin(), c.end(), r[i])) - 1; // find first coordinate larger than x/y/z
+        index[i] = low;
+        dist[i] = c[low + 1] - c[low];
+        r[i] = (r[i] - c[low])/dist[i]; // scale coordinates to unit cube
+    }
+    return true;
+}
+
+
+void TabField3::CalcBasis(const std::array<double, 3> &r, const std::array<double, 3> &dist, basis_type &b) const{
     for (unsigned i = 0; i < 3; ++i){
-      auto it = std::upper_bound(xyz[i].begin(), xyz[i].end(), r[i]); // find first coordinate larger than x/y/z
-      if (it == xyz[i].end() || it == xyz[i].begin()){ // if x,y,z are outside bounds of field
-          return;
-      }
-      auto low = it - 1;
-      index[i] = std::distance(xyz[i].begin(), low);
-      dist[i] = *it - *low;
-      r[i] = (r[i] - *low)/dist[i]; // scale coordinates to unit cube
-    }
-
-    // tricubic interpolation
-    if (not coeffs.empty()){
-        double *coeff = const_cast<double*>(&coeffs(index)[0]);
-        F = tricubic_eval_fast(coeff, r[0], r[1], r[2]);
+        double t = r[i], t2 = t*t, t3 = t2*t;
+        if (compact){
+            // cubic Hermite polynomials for value and derivative on lower corner and value and derivative on upper corner
+            b.p[i][0] = 2*t3 - 3*t2 + 1;
+            b.p[i][1] = (t3 - 2*t2 + t)*dist[i]; // derivatives on grid points are given in unscaled coordinates
+            b.p[i][2] = 3*t2 - 2*t3;
+            b.p[i][3] = (t3 - t2)*dist[i];
+            b.dp[i][0] = (6*t2 - 6*t)/dist[i];
+            b.dp[i][1] = 3*t2 - 4*t + 1;
+            b.dp[i][2] = -b.dp[i][0];
+            b.dp[i][3] = 3*t2 - 2*t;
+        }
+        else{
+            b.p[i][0] = 1.;
+            b.p[i][1] = t;
+            b.p[i][2] = t2;
+            b.p[i][3] = t3;
+            b.dp[i][0] = 0.;
+            b.dp[i][1] = 1./dist[i];
+            b.dp[i][2] = 2.*t/dist[i];
+            b.dp[i][3] = 3.*t2/dist[i];
+        }
+    }
+    for (unsigned k = 0; k < 4; ++k){
+        for (unsigned j = 0; j < 4; ++j){
+            b.yz[j + 4*k] = b.p[1][j]*b.p[2][k];
+            b.dyz[j + 4*k] = b.dp[1][j]*b.p[2][k];
+            b.ydz[j + 4*k] = b.p[1][j]*b.dp[2][k];
+        }
+    }
+}
+
+
+/**
+ * Contract interpolation basis with the 4x4x4 coefficients of a grid cell
+ *
+ * @param b Interpolation basis
+ * @param a Coefficients of grid cell, a[i + 4*j + 16*k] belongs to the i-th x, j-th y, and k-th z basis function
+ * @param F Returns interpolated value
+ * @param dFdxi Returns spatial derivatives (can be null)
+ */
+template<class basis_type>
+static inline void contract_basis(const basis_type &b, const double *a, double &F, double dFdxi[3]){
+    double f = 0., fx = 0., fy = 0., fz = 0.;
+    for (unsigned jk = 0; jk < 16; ++jk){
+        const double *row = a + 4*jk;
+        double v = (row[0]*b.p[0][0] + row[1]*b.p[0][1]) + (row[2]*b.p[0][2] + row[3]*b.p[0][3]);
+        f += v*b.yz[jk];
         if (dFdxi != nullptr){
-            dFdxi[0] = tricubic_eval_fast(coeff, r[0], r[1], r[2], 1, 0, 0)/dist[0];
-            dFdxi[1] = tricubic_eval_fast(coeff, r[0], r[1], r[2], 0, 1, 0)/dist[1];
-            dFdxi[2] = tricubic_eval_fast(coeff, r[0], r[1], r[2], 0, 0, 1)/dist[2];
+            double dv = (row[0]*b.dp[0][0] + row[1]*b.dp[0][1]) + (row[2]*b.dp[0][2] + row[3]*b.dp[0][3]);
+            fx += dv*b.yz[jk];
+            fy += v*b.dyz[jk];
+            fz += v*b.ydz[jk];
         }
     }
+    F = f;
+    if (dFdxi != nullptr){
+        dFdxi[0] = fx;
+        dFdxi[1] = fy;
+        dFdxi[2] = fz;
+    }
+}
+
+
+void TabField3::Interpolate(const std::array<long, 3> &index, const basis_type &b, const double *data, double &F, double dFdxi[3]) const {
+    if (data == nullptr)
+        return;
+    if (compact){
+        std::array<double, 64> a; // sort values and derivatives on corners of grid cell into order of Hermite basis functions
+        for (unsigned c = 0; c < 8; ++c){
+            unsigned cx = c & 1, cy = (c >> 1) & 1, cz = c >> 2;
+            const double *n = data + (((index[0] + cx)*xyz[1].size() + index[1] + cy)*xyz[2].size() + index[2] + cz)*8;
+            for (unsigned k = 0; k < 8; ++k)
+                a[(2*cx + (k & 1)) + 4*(2*cy + ((k >> 1) & 1)) + 16*(2*cz + (k >> 2))] = n[k];
+        }
+        contract_basis(b, &a[0], F, dFdxi);
+    }
+    else
+        contract_basis(b, data + ((index[0]*(xyz[1].size() - 1) + index[1])*(xyz[2].size() - 1) + index[2])*64, F, dFdxi);
 }
 
 
 void TabField3::BField(const double x, const double y, const double z, const double t, double B[3], double dBidxj[3][3]) const{
+    std::array<long, 3> index;
+    std::array<double, 3> r, dist;
+    if (not FindCell(x, y, z, index, r, dist))
+        return;
+    basis_type b;
+    CalcBasis(r, dist, b);
     for (unsigned i = 0; i < 3; ++i){
-        Interpolate(x, y, z, Bc[i], B[i], dBidxj == nullptr ? nullptr : dBidxj[i]);
+        Interpolate(index, b, Bdata[i], B[i], dBidxj == nullptr ? nullptr : dBidxj[i]);
     }
 }
 
 void TabField3::EField(const double x, const double y, const double z, const double t,
 		double &V, double Ei[3]) const{
+    std::array<long, 3> index;
+    std::array<double, 3> r, dist;
+    if (Vdata == nullptr || not FindCell(x, y, z, index, r, dist))
+        return;
+    basis_type b;
+    CalcBasis(r, dist, b);
     double dVdxi[3];
-    Interpolate(x, y, z, Vc, V, dVdxi);
+    Interpolate(index, b, Vdata, V, dVdxi);
     for (int i = 0; i < 3; i++){
         Ei[i] = -dVdxi[i]; // Ei = -dV/dxi
     }
@@ -0,0 +1,550 @@
+/**
+ * \file
+ * Tricubic interpolation of fields on adaptively refined octrees.
+ */
+
+#include "field_octree.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <unordered_map>
+#include <random>
+#include <cmath>
+
+#include <boost/format.hpp>
+#include <boost/filesystem.hpp>
+
+#include "globals.h"
+
+
+/**
+ * Calculate cubic Hermite basis functions and their derivatives
+ *
+ * @param t Position in cell, between 0 and 1
+ * @param L Size of cell
+ * @param b Returns weights of value (index 2*corner) and derivative (index 2*corner + 1) at lower (corner 0) and upper (corner 1) end of cell
+ * @param db Returns derivatives of weights
+ */
+static void HermiteBasis(const double t, const double L, double b[4], double db[4]){
+	double t2 = t*t, t3 = t2*t;
+	b[0] = 2*t3 - 3*t2 + 1;
+	b[1] = (t3 - 2*t2 + t)*L;
+	b[2] = -2*t3 + 3*t2;
+	b[3] = (t3 - t2)*L;
+	db[0] = (6*t2 - 6*t)/L;
+	db[1] = 3*t2 - 4*t + 1;
+	db[2] = (6*t - 6*t2)/L;
+	db[3] = 3*t2 - 2*t;
+}
+
+
+/**
+ * Contract 4x4x4 coefficients with basis functions in each direction
+ *
+ * @param c Coefficients, index i + 4*j + 16*k
+ * @param bx Basis functions in x direction
+ * @param by Basis functions in y direction
+ * @param bz Basis functions in z direction
+ *
+ * @return Returns sum of c[i + 4*j + 16*k]*bx[i]*by[j]*bz[k]
+ */
+static double Contract(const double c[64], const double bx[4], const double by[4], const double bz[4]){
+	double sum = 0;
+	for (int k = 0; k < 4; ++k){
+		double sk = 0;
+		for (int j = 0; j < 4; ++j){
+			const double *row = &c[4*j + 16*k];
+			sk += (row[0]*bx[0] + row[1]*bx[1] + row[2]*bx[2] + row[3]*bx[3])*by[j];
+		}
+		sum += sk*bz[k];
+	}
+	return sum;
+}
+
+
+/**
+ * Combine integer node coordinates into unique key, each coordinate has to fit into 21 bits
+ */
+static uint64_t NodeKey(const long x, const long y, const long z){
+	return (static_cast<uint64_t>(x) << 42) | (static_cast<uint64_t>(y) << 21) | static_cast<uint64_t>(z);
+}
+
+
+namespace{
+const char octree_id[16] = "PENTrackOctree"; ///< identifier at start of binary octree files
+const uint32_t octree_version = 1; ///< version of binary octree format
+
+/**
+ * Header of binary octree file, see TOctreeField::Save
+ */
+struct TBinaryOctreeHeader{
+	char id[16];
+	uint32_t version, components, maxdepth, reserved;
+	double boxmin[3], boxsize[3];
+	uint64_t ntree, nleaves, nnodes;
+};
+}
+
+
+void TOctreeField::SampleNode(const node_index &n, const sampler_type &sampler, double *data) const{
+	double p[3], lo[3], hi[3];
+	const double R = 1L << maxdepth;
+	for (int i = 0; i < 3; ++i){
+		p[i] = boxmin[i] + boxsize[i]*n[i]/R;
+		double h = 0.01*boxsize[i]/R; // step for finite differences, use one-sided differences at the bounding box
+		lo[i] = std::max(p[i] - h, boxmin[i]);
+		hi[i] = std::min(p[i] + h, boxmin[i] + boxsize[i]);
+	}
+	double F[maxcomp], dF[maxcomp][3];
+	auto sample = [&](const double x, const double y, const double z){
+		sampler(x, y, z, F, dF);
+		if (!hasB){ // move potential to first component
+			F[0] = F[3];
+			std::copy(dF[3], dF[3] + 3, dF[0]);
+		}
+	};
+	sample(p[0], p[1], p[2]);
+	for (unsigned c = 0; c < ncomp; ++c){
+		data[8*c] = F[c];
+		data[8*c + 1] = dF[c][0];
+		data[8*c + 2] = dF[c][1];
+		data[8*c + 4] = dF[c][2];
+		data[8*c + 3] = data[8*c + 5] = data[8*c + 6] = data[8*c + 7] = 0;
+	}
+	// mixed derivatives from differences of first derivatives, (y, z) at lo/hi corners and x-derivative/y-derivative at z = lo/hi
+	for (int iy = 0; iy < 2; ++iy){
+		for (int iz = 0; iz < 2; ++iz){
+			sample(p[0], iy ? hi[1] : lo[1], iz ? hi[2] : lo[2]);
+			double sign = (iy ? 1 : -1)*(iz ? 1 : -1);
+			for (unsigned c = 0; c < ncomp; ++c)
+				data[8*c + 7] += sign*dF[c][0]/(hi[1] - lo[1])/(hi[2] - lo[2]);
+		}
+		sample(p[0], iy ? hi[1] : lo[1], p[2]);
+		for (unsigned c = 0; c < ncomp; ++c)
+			data[8*c + 3] += (iy ? 1 : -1)*dF[c][0]/(hi[1] - lo[1]);
+	}
+	for (int iz = 0; iz < 2; ++iz){
+		sample(p[0], p[1], iz ? hi[2] : lo[2]);
+		for (unsigned c = 0; c < ncomp; ++c){
+			data[8*c + 5] += (iz ? 1 : -1)*dF[c][0]/(hi[2] - lo[2]);
+			data[8*c + 6] += (iz ? 1 : -1)*dF[c][1]/(hi[2] - lo[2]);
+		}
+	}
+}
+
+
+void TOctreeField::Coefficients(const std::array<const double*, 8> &corners, const unsigned comp, double c[64]) const{
+	for (unsigned k = 0; k < 4; ++k){
+		for (unsigned j = 0; j < 4; ++j){
+			for (unsigned i = 0; i < 4; ++i){
+				unsigned corner = (i >> 1) | (j >> 1) << 1 | (k >> 1) << 2;
+				unsigned deriv = (i & 1) | (j & 1) << 1 | (k & 1) << 2;
+				c[i + 4*j + 16*k] = corners[corner][8*comp + deriv];
+			}
+		}
+	}
+}
+
+
+long TOctreeField::FindLeaf(const double x, const double y, const double z, std::array<double, 3> &t, std::array<double, 3> &size) const{
+	const double R = 1L << maxdepth;
+	double u[3] = {(x - boxmin[0])/boxsize[0]*R, (y - boxmin[1])/boxsize[1]*R, (z - boxmin[2])/boxsize[2]*R}; // coordinates in units of smallest cells
+	for (int i = 0; i < 3; ++i){
+		if (!(u[i] >= 0 && u[i] <= R))
+			return -1;
+	}
+	std::size_t n = 0;
+	double lo[3] = {0, 0, 0}, s = R;
+	while (tree[n] >= 0){
+		s *= 0.5;
+		unsigned octant = 0;
+		for (int i = 0; i < 3; ++i){
+			if (u[i] >= lo[i] + s){
+				octant |= 1u << i;
+				lo[i] += s;
+			}
+		}
+		n = tree[n] + octant;
+	}
+	for (int i = 0; i < 3; ++i){
+		t[i] = std::min((u[i] - lo[i])/s, 1.);
+		size[i] = boxsize[i]*s/R;
+	}
+	return -1 - tree[n];
+}
+
+
+void TOctreeField::Interpolate(const long leaf, const std::array<double, 3> &t, const std::array<double, 3> &size, const unsigned first, const unsigned count,
+							double F[], double dFidxj[][3]) const{
+	std::array<const double*, 8> corners;
+	for (unsigned i = 0; i < 8; ++i)
+		corners[i] = &nodes[ncomp*8*leafcorners[leaf][i]];
+	double b[3][4], db[3][4];
+	for (int i = 0; i < 3; ++i)
+		HermiteBasis(t[i], size[i], b[i], db[i]);
+	for (unsigned i = 0; i < count; ++i){
+		double c[64];
+		Coefficients(corners, first + i, c);
+		F[i] = Contract(c, b[0], b[1], b[2]);
+		if (dFidxj != nullptr){
+			dFidxj[i][0] = Contract(c, db[0], b[1], b[2]);
+			dFidxj[i][1] = Contract(c, b[0], db[1], b[2]);
+			dFidxj[i][2] = Contract(c, b[0], b[1], db[2]);
+		}
+	}
+}
+
+
+TOctreeField::TOctreeField(const std::array<double, 3> &min, const std::array<double, 3> &max, const sampler_type &sampler, const bool withB, const bool withV,
+						const double Btolerance, const double Vtolerance, const int amaxdepth, std::ostream &out):
+						hasB(withB), hasV(withV), ncomp(3*withB + withV), maxdepth(amaxdepth){
+	if (ncomp == 0)
+		throw std::runtime_error("Octree field has to contain magnetic field or electric potential!");
+	if (maxdepth < 0 || maxdepth > 16){
+		throw std::runtime_error((boost::format("Octree depth %1% is out of range 0 to 16!") % maxdepth).str());
+	}
+	for (int i = 0; i < 3; ++i){
+		boxmin[i] = min[i];
+		boxsize[i] = max[i] - min[i];
+		if (!(boxsize[i] > 0))
+			throw std::runtime_error("Bounding box of octree field is empty!");
+	}
+	const long R = 1L << maxdepth;
+	const int mindepth = std::min(2, maxdepth); // always refine first levels, so features between sampling points are not missed
+	out << "Building octree ... ";
+	out.flush();
+
+	// refine octree level by level, sampling all required nodes of a level in parallel
+	std::unordered_map<uint64_t, std::size_t> sampled; // index of each sampled node in samples
+	std::vector<double> samples;
+	std::vector<cell_type> cells(1, cell_type{{{0, 0, 0}}, 0}), leaves;
+	std::vector<std::size_t> cellnodes(1, 0); // tree node of each cell in current level
+	tree.push_back(0);
+	while (!cells.empty()){
+		std::vector<node_index> newnodes;
+		for (auto &c: cells){
+			if (c.depth < mindepth)
+				continue;
+			long step = c.depth < maxdepth ? (R >> c.depth)/2 : R >> c.depth; // sample edge, face, and volume centers to check cell, only corners of smallest cells
+			for (long i = 0; i <= R >> c.depth; i += step){
+				for (long j = 0; j <= R >> c.depth; j += step){
+					for (long k = 0; k <= R >> c.depth; k += step){
+						node_index n = {{c.corner[0] + i, c.corner[1] + j, c.corner[2] + k}};
+						if (sampled.emplace(NodeKey(n[0], n[1], n[2]), sampled.size()).second)
+							newnodes.push_back(n);
+					}
+				}
+			}
+		}
+		std::size_t first = samples.size()/(ncomp*8);
+		samples.resize(sampled.size()*ncomp*8);
+		parallel_for(newnodes.size(), [&](const std::size_t i){
+			SampleNode(newnodes[i], sampler, &samples[(first + i)*ncomp*8]);
+		});
+
+		std::vector<char> refine(cells.size());
+		parallel_for(cells.size(), [&](const std::size_t i){
+			const cell_type &c = cells[i];
+			if (c.depth >= maxdepth || c.depth < mindepth){
+				refine[i] = c.depth < maxdepth;
+				return;
+			}
+			long s = R >> c.depth;
+			auto data = [&](const long x, const long y, const long z){
+				return &samples[ncomp*8*sampled.at(NodeKey(c.corner[0] + x, c.corner[1] + y, c.corner[2] + z))];
+			};
+			std::array<const double*, 8> corners;
+			for (unsigned k = 0; k < 8; ++k)
+				corners[k] = data((k & 1)*s, (k >> 1 & 1)*s, (k >> 2 & 1)*s);
+			double b[3][3][4], db[4]; // basis functions at lower end, center, and upper end of cell
+			for (int d = 0; d < 3; ++d){
+				for (int p = 0; p < 3; ++p)
+					HermiteBasis(0.5*p, boxsize[d]*s/R, b[d][p], db);
+			}
+			refine[i] = false;
+			for (unsigned comp = 0; comp < ncomp; ++comp){
+				double error = 0;
+				double coeff[64];
+				Coefficients(corners, comp, coeff);
+				for (int x = 0; x < 3; ++x){
+					for (int y = 0; y < 3; ++y){
+						for (int z = 0; z < 3; ++z){
+							if (x != 1 && y != 1 && z != 1)
+								continue; // skip corners
+							double exact = data(x*s/2, y*s/2, z*s/2)[8*comp];
+							error = std::max(error, std::abs(Contract(coeff, b[0][x], b[1][y], b[2][z]) - exact));
+						}
+					}
+				}
+				refine[i] = refine[i] || error > (hasB && comp < 3 ? Btolerance : Vtolerance);
+			}
+		});
+
+		std::vector<cell_type> next;
+		std::vector<std::size_t> nextnodes;
+		for (std::size_t i = 0; i < cells.size(); ++i){
+			const cell_type &c = cells[i];
+			if (refine[i]){
+				tree[cellnodes[i]] = tree.size();
+				long half = (R >> c.depth)/2;
+				for (unsigned o = 0; o < 8; ++o){
+					nextnodes.push_back(tree.size());
+					tree.push_back(0);
+					next.push_back(cell_type{{{c.corner[0] + (o & 1)*half, c.corner[1] + (o >> 1 & 1)*half, c.corner[2] + (o >> 2 & 1)*half}}, c.depth + 1});
+				}
+			}
+			else{
+				tree[cellnodes[i]] = -1 - static_cast<int32_t>(leaves.size());
+				leaves.push_back(c);
+			}
+		}
+		cells.swap(next);
+		cellnodes.swap(nextnodes);
+	}
+
+	// number corners of all leaves in order of the depth at which they first appear
+	std::unordered_map<uint64_t, int> firstdepth;
+	for (auto &l: leaves){
+		long s = R >> l.depth;
+		for (unsigned k = 0; k < 8; ++k){
+			auto n = firstdepth.emplace(NodeKey(l.corner[0] + (k & 1)*s, l.corner[1] + (k >> 1 & 1)*s, l.corner[2] + (k >> 2 & 1)*s), l.depth);
+			n.first->second = std::min(n.first->second, l.depth);
+		}
+	}
+	std::vector<std::pair<int, uint64_t> > order;
+	for (auto &n: firstdepth)
+		order.push_back(std::make_pair(n.second, n.first));
+	std::sort(order.begin(), order.end());
+	std::unordered_map<uint64_t, uint32_t> nodeindex;
+	for (std::size_t i = 0; i < order.size(); ++i)
+		nodeindex[order[i].second] = i;
+	leafcorners.resize(leaves.size());
+	for (std::size_t l = 0; l < leaves.size(); ++l){
+		long s = R >> leaves[l].depth;
+		for (unsigned k = 0; k < 8; ++k)
+			leafcorners[l][k] = nodeindex.at(NodeKey(leaves[l].corner[0] + (k & 1)*s, leaves[l].corner[1] + (k >> 1 & 1)*s, leaves[l].corner[2] + (k >> 2 & 1)*s));
+	}
+
+	// copy sampled values to nodes, nodes lying on a face or edge of a larger leaf take the values of its interpolation instead.
+	// Those leaves are larger, so their corners appear at a lower depth and have been set before
+	nodes.resize(order.size()*ncomp*8);
+	auto setnode = [&](const std::size_t i){
+		uint64_t key = order[i].second;
+		const long mask = (1L << 21) - 1;
+		node_index n = {{static_cast<long>(key >> 42), static_cast<long>(key >> 21) & mask, static_cast<long>(key) & mask}};
+		long coarsest = -1, coarsestsize = 0;
+		node_index coarsestcorner;
+		for (unsigned dir = 0; dir < 8; ++dir){ // find leaves around node, using coordinates in units of half the smallest cell size
+			node_index q;
+			bool inside = true;
+			for (int d = 0; d < 3; ++d){
+				q[d] = 2*n[d] + ((dir >> d & 1) ? 1 : -1);
+				inside = inside && q[d] > 0 && q[d] < 2*R;
+			}
+			if (!inside)
+				continue;
+			std::size_t t = 0;
+			node_index lo = {{0, 0, 0}};
+			long s = R;
+			while (tree[t] >= 0){
+				s /= 2;
+				unsigned octant = 0;
+				for (int d = 0; d < 3; ++d){
+					if (q[d] >= 2*(lo[d] + s)){
+						octant |= 1u << d;
+						lo[d] += s;
+					}
+				}
+				t = tree[t] + octant;
+			}
+			bool corner = true;
+			for (int d = 0; d < 3; ++d)
+				corner = corner && (n[d] == lo[d] || n[d] == lo[d] + s);
+			if (!corner && s > coarsestsize){
+				coarsest = -1 - tree[t];
+				coarsestsize = s;
+				coarsestcorner = lo;
+			}
+		}
+		double *data = &nodes[ncomp*8*i];
+		if (coarsest < 0){
+			const double *exact = &samples[ncomp*8*sampled.at(key)];
+			std::copy(exact, exact + ncomp*8, data);
+			return;
+		}
+		std::array<const double*, 8> corners;
+		for (unsigned k = 0; k < 8; ++k)
+			corners[k] = &nodes[ncomp*8*leafcorners[coarsest][k]];
+		double b[3][2][4];
+		for (int d = 0; d < 3; ++d)
+			HermiteBasis(static_cast<double>(n[d] - coarsestcorner[d])/coarsestsize, boxsize[d]*coarsestsize/R, b[d][0], b[d][1]);
+		for (unsigned comp = 0; comp < ncomp; ++comp){
+			double coeff[64];
+			Coefficients(corners, comp, coeff);
+			for (unsigned deriv = 0; deriv < 8; ++deriv)
+				data[8*comp + deriv] = Contract(coeff, b[0][deriv & 1], b[1][deriv >> 1 & 1], b[2][deriv >> 2 & 1]);
+		}
+	};
+	for (std::size_t begin = 0; begin < order.size(); ){ // nodes first appearing at the same depth are independent
+		std::size_t end = begin;
+		while (end < order.size() && order[end].first == order[begin].first)
+			++end;
+		parallel_for(end - begin, [&](const std::size_t i){ setnode(begin + i); });
+		begin = end;
+	}
+	out << "Done\n";
+
+	PrintStatistics(out);
+
+	// compare interpolation to sampled field at random points
+	const std::size_t ntest = 10000;
+	std::vector<std::array<double, 3> > points(ntest);
+	std::mt19937 rng(12345);
+	std::uniform_real_distribution<double> unif(0., 1.);
+	for (auto &p: points){
+		for (int i = 0; i < 3; ++i)
+			p[i] = boxmin[i] + unif(rng)*boxsize[i];
+	}
+	std::vector<std::array<double, 2> > errors(ntest); // maximum error of magnetic-field components and error of potential
+	parallel_for(ntest, [&](const std::size_t i){
+		double B[3] = {0, 0, 0}, V = 0, E[3], exact[maxcomp], dF[maxcomp][3];
+		BField(points[i][0], points[i][1], points[i][2], 0, B, nullptr);
+		EField(points[i][0], points[i][1], points[i][2], 0, V, E);
+		sampler(points[i][0], points[i][1], points[i][2], exact, dF);
+		errors[i][0] = std::max(std::abs(B[0] - exact[0]), std::max(std::abs(B[1] - exact[1]), std::abs(B[2] - exact[2])));
+		errors[i][1] = std::abs(V - exact[3]);
+	});
+	for (unsigned j = 0; j < 2; ++j){
+		if (j == 0 ? !hasB : !hasV)
+			continue;
+		double max = 0, rms = 0;
+		for (auto &e: errors){
+			max = std::max(max, e[j]);
+			rms += e[j]*e[j];
+		}
+		out << boost::format("%1% interpolation error at %2% random points: max. %3$.3g, rms %4$.3g\n") % (j == 0 ? "Magnetic-field" : "Potential") % ntest % max % std::sqrt(rms/ntest);
+	}
+}
+
+
+TOctreeField::TOctreeField(const std::string &filename, std::ostream &out){
+	out << "\nReading " << filename << " ... ";
+	std::ifstream f(filename, std::ios::binary);
+	if (!f.is_open())
+		throw std::runtime_error("Could not open " + filename);
+	TBinaryOctreeHeader header;
+	f.read(reinterpret_cast<char*>(&header), sizeof(header));
+	if (!f || !std::equal(header.id, header.id + sizeof(header.id), octree_id))
+		throw std::runtime_error(filename + " is not a binary octree file!");
+	if (header.version != octree_version)
+		throw std::runtime_error((boost::format("%1% has unsupported version %2% (expected %3%)") % filename % header.version % octree_version).str());
+	hasB = header.components & 1u;
+	hasV = header.components & 2u;
+	ncomp = 3*hasB + hasV;
+	maxdepth = header.maxdepth;
+	std::copy(header.boxmin, header.boxmin + 3, boxmin.begin());
+	std::copy(header.boxsize, header.boxsize + 3, boxsize.begin());
+	tree.resize(header.ntree);
+	leafcorners.resize(header.nleaves);
+	nodes.resize(header.nnodes*ncomp*8);
+	f.read(reinterpret_cast<char*>(tree.data()), tree.size()*sizeof(tree[0]));
+	f.read(reinterpret_cast<char*>(leafcorners.data()), leafcorners.size()*sizeof(leafcorners[0]));
+	f.read(reinterpret_cast<char*>(nodes.data()), nodes.size()*sizeof(nodes[0]));
+	if (!f || f.peek() != std::ifstream::traits_type::eof() || ncomp == 0 || maxdepth > 16 || tree.empty())
+		throw std::runtime_error(filename + " is corrupt!");
+	for (auto &l: leafcorners){
+		for (auto n: l){
+			if (n >= header.nnodes)
+				throw std::runtime_error(filename + " is corrupt!");
+		}
+	}
+	for (std::size_t i = 0; i < tree.size(); ++i){ // children have to come after their parent, so the tree contains no loops
+		if ((tree[i] >= 0 && (static_cast<std::size_t>(tree[i]) <= i || tree[i] + 8u > tree.size())) || (tree[i] < 0 && -1 - static_cast<int64_t>(tree[i]) >= static_cast<int64_t>(leafcorners.size())))
+			throw std::runtime_error(filename + " is corrupt!");
+	}
+	PrintStatistics(out);
+}
+
+
+void TOctreeField::Save(const std::string &filename) const{
+	TBinaryOctreeHeader header;
+	std::copy(octree_id, octree_id + sizeof(octree_id), header.id);
+	header.version = octree_version;
+	header.components = hasB | hasV << 1;
+	header.maxdepth = maxdepth;
+	header.reserved = 0;
+	std::copy(boxmin.begin(), boxmin.end(), header.boxmin);
+	std::copy(boxsize.begin(), boxsize.end(), header.boxsize);
+	header.ntree = tree.size();
+	header.nleaves = leafcorners.size();
+	header.nnodes = nodes.size()/(ncomp*8);
+
+	std::ofstream f(filename, std::ios::binary);
+	f.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	f.write(reinterpret_cast<const char*>(tree.data()), tree.size()*sizeof(tree[0]));
+	f.write(reinterpret_cast<const char*>(leafcorners.data()), leafcorners.size()*sizeof(leafcorners[0]));
+	f.write(reinterpret_cast<const char*>(nodes.data()), nodes.size()*sizeof(nodes[0]));
+	if (!f)
+		throw std::runtime_error("Could not write " + filename);
+}
+
+
+void TOctreeField::PrintStatistics(std::ostream &out) const{
+	double memory = (nodes.size()*sizeof(nodes[0]) + leafcorners.size()*sizeof(leafcorners[0]) + tree.size()*sizeof(tree[0]))/1024./1024.;
+	out << boost::format("Octree with%1%%2%%3% has %4% leaves and %5% nodes using %6$.3g MB\n")
+			% (hasB ? " magnetic field" : "") % (hasB && hasV ? " and" : "") % (hasV ? " potential" : "")
+			% leafcorners.size() % (nodes.size()/(ncomp*8)) % memory;
+	out << "The x values go from " << boxmin[0] << " to " << boxmin[0] + boxsize[0] << "\n";
+	out << "The y values go from " << boxmin[1] << " to " << boxmin[1] + boxsize[1] << "\n";
+	out << "The z values go from " << boxmin[2] << " to " << boxmin[2] + boxsize[2] << ".\n";
+}
+
+
+void TOctreeField::GetBounds(double min[3], double max[3]) const{
+	for (unsigned i = 0; i < 3; ++i){
+		min[i] = boxmin[i];
+		max[i] = boxmin[i] + boxsize[i];
+	}
+}
+
+
+void TOctreeField::BField(const double x, const double y, const double z, const double t, double B[3], double dBidxj[3][3]) const{
+	if (!hasB)
+		return;
+	std::array<double, 3> r, size;
+	long leaf = FindLeaf(x, y, z, r, size);
+	if (leaf < 0)
+		return;
+	Interpolate(leaf, r, size, 0, 3, B, dBidxj);
+}
+
+
+void TOctreeField::EField(const double x, const double y, const double z, const double t, double &V, double Ei[3]) const{
+	if (!hasV)
+		return;
+	std::array<double, 3> r, size;
+	long leaf = FindLeaf(x, y, z, r, size);
+	if (leaf < 0)
+		return;
+	double dVdxi[1][3];
+	Interpolate(leaf, r, size, ncomp - 1, 1, &V, dVdxi);
+	for (int i = 0; i < 3; ++i)
+		Ei[i] = -dVdxi[0][i];
+}
+
+
+TFieldContainer ReadBinaryOctree(const std::string &params, std::ostream &out){
+	std::istringstream ss(params);
+	boost::filesystem::path ft;
+	std::string fieldtype, Bscale, Escale;
+	double BoundaryWidth;
+	ss >> fieldtype >> ft >> Bscale >> Escale >> BoundaryWidth;
+	if (!ss){
+		throw std::runtime_error((boost::format("Could not read all required parameters for field %1%!") % fieldtype).str());
+	}
+	std::unique_ptr<TOctreeField> octree(new TOctreeField(boost::filesystem::absolute(ft, configpath.parent_path()).string(), out));
+	double min[3], max[3];
+	octree->GetBounds(min, max);
+	return TFieldContainer(std::move(octree), Bscale, Escale, max[0], min[0], max[1], min[1], max[2], min[2], BoundaryWidth);
+}
@@ -8,98 +8,276 @@
 #include <string>
 #include <iostream>
 #include <vector>
+#include <array>
+#include <limits>
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <memory>
+#include <sstream>
+
+#include <boost/format.hpp>
+
 #include "field_2d.h"
 #include "field_3d.h"
 #include "conductor.h"
 #include "edmfields.h"
 #include "harmonicfields.h"
 #include "analyticFields.h"
+#include "field_octree.h"
 
 
 TFieldManager::TFieldManager(TConfig &conf){
+	std::vector<std::string> keys, params;
 	for (const auto &i: conf["FIELDS"]){
-		std::string type;
-		boost::filesystem::path ft;
-		double Ibar, p1, p2, p3, p4, p5, p6, p7;
-		double bW, xma, xmi, yma, ymi, zma, zmi;
-		double axis_x, axis_y, axis_z, angle, G0, G1, G2, G3, G4, G5, G6, G7, G8, G9, G10, G11, G12, G13, G14, G15, G16, G17, G18, G19, G20, G21, G22, G23;
-		std::string Bscale, Escale, Bx, By, Bz;
-		std::istringstream ss(i.second);
-		ss >> type;
-
-        if (type == "OPERA2D" or type == "2Dtable"){
-            fields.emplace_back(ReadOperaField2(i.second));
-		}
-        else if (type == "OPERA3D" or type == "3Dtable"){
-            fields.emplace_back(ReadOperaField3(i.second));
-		}
-        else if (type == "COMSOL"){
-            fields.emplace_back(ReadComsolField(i.second));
-		}
-        else if ((type == "Conductor") && (ss >> Ibar >> p1 >> p2 >> p3 >> p4 >> p5 >> p6 >> Bscale)){
-			std::unique_ptr<TField> f(new TConductorField(p1, p2, p3, p4, p5, p6, Ibar));
-            fields.emplace_back(TFieldContainer(std::move(f), Bscale));
-		}
-        else if ((type == "EDMStaticB0GradZField") && (ss >> p1 >> p2 >> p3 >> p4 >> p5 >> p6 >> p7 >> bW >> xma >> xmi >> yma >> ymi >> zma >> zmi >> Bscale)){
-			//conversion to radians
-			p4*=pi/180;
-			p5*=pi/180;
-			std::unique_ptr<TField> f(new TEDMStaticB0GradZField(p1, p2, p3, p4, p5, p6, p7));
-            fields.emplace_back(TFieldContainer(std::move(f), Bscale, "0", xma, xmi, yma, ymi, zma, zmi, bW));
-		}
-		else if (type == "HarmonicExpandedBField" and
-				 ss >> p1 >> p2 >> p3 >> bW >> xma >> xmi >> yma >> ymi >> zma >> zmi >> Bscale >> axis_x >> axis_y >> axis_z >> angle and
-				 ss >> G0 >> G1 >> G2 >> G3 >> G4 >> G5 >> G6 >> G7 >> G8 >> G9 >> G10 >> G11 >> G12 >> G13 >> G14 >> G15 >> G16 >> G17 >> G18 >> G19 >> G20 >> G21 >> G22 >> G23){
-
-			//conversion to radians
-			p4*=pi/180;
-			p5*=pi/180;
-			std::unique_ptr<TField> f(new HarmonicExpandedBField(p1, p2, p3, axis_x, axis_y, axis_z, angle, G0, G1, G2, G3, G4, G5, G6, G7, G8, G9, G10, G11, G12, G13, G14, G15, G16, G17, G18, G19, G20, G21, G22, G23));
-			fields.emplace_back(TFieldContainer(std::move(f), Bscale, "0", xma, xmi, yma, ymi, zma, zmi, bW));
-		}
-        else if ((type == "EDMStaticEField") and (ss >> p1 >> p2 >> p3 >> Bscale)){
-			std::unique_ptr<TField> f(new TEDMStaticEField (p1, p2, p3));
-            fields.emplace_back(TFieldContainer(std::move(f), Bscale));
-		}
-		else if (type == "ExponentialFieldX" and ss >> p1 >> p2 >> p3 >> p4 >> p5 >> xma >> xmi >> yma >> ymi >> zma >> zmi >> Bscale){
-			std::unique_ptr<TField> f( new TExponentialFieldX(p1, p2, p3, p4, p5));
-			fields.emplace_back(TFieldContainer(std::move(f), Bscale, "0", xma, xmi, yma, ymi, zma, zmi, 0.));
-		}
+		keys.push_back(i.first);
+		params.push_back(i.second);
+	}
+	const std::map<std::string, std::string> *formulas = nullptr;
+	for (auto &section: conf){
+		if (section.first == "FORMULAS")
+			formulas = &section.second;
+	}
 
-		else if (type == "LinearFieldZ" and	ss >> p1 >> p2 >> xma >> xmi >> yma >> ymi >> zma >> zmi >> Bscale){
-			std::unique_ptr<TField> f( new TLinearFieldZ(p1, p2));
-			fields.emplace_back(TFieldContainer(std::move(f), Bscale, "0", xma, xmi, yma, ymi, zma, zmi, 0.));
-		}
+	// load fields in parallel, buffering their log messages to print them in order
+	std::vector<std::unique_ptr<TFieldContainer> > loaded(params.size());
+	std::vector<std::ostringstream> outs(params.size());
+	auto printlogs = [&](){
+		for (auto &o: outs)
+			std::cout << o.str();
+	};
+	try{
+		parallel_for(params.size(), [&](const size_t i){
+			std::string type;
+			std::istringstream(params[i]) >> type;
+			if (type != "BakedField") // baked fields are created after the fields they contain are loaded
+				loaded[i].reset(new TFieldContainer(LoadField(params[i], formulas, outs[i])));
+		});
+	}
+	catch (...){
+		printlogs();
+		throw;
+	}
+	printlogs();
+	for (size_t i = 0; i < params.size(); ++i){
+		if (!loaded[i])
+			loaded[i].reset(new TFieldContainer(BakeFields(params[i], keys, loaded, std::cout)));
+	}
+	for (auto &f: loaded){
+		if (f)
+			fields.push_back(std::move(*f));
+	}
 
-		else if (type == "B0GradZ" and ss >> p1 >> p2 >> p3 >> xma >> xmi >> yma >> ymi >> zma >> zmi >> Bscale){
-			std::unique_ptr<TField> f(new TB0GradZ(p1, p2, p3));
-			fields.emplace_back(TFieldContainer(std::move(f), Bscale, "0", xma, xmi, yma, ymi, zma, zmi, 0.));
-		}
+	BuildGrid();
+	std::cout << "\n";
+}
+
+
+TFieldContainer TFieldManager::LoadField(const std::string &params, const std::map<std::string, std::string> *formulas, std::ostream &out){
+	auto formula = [formulas](const std::string &name){
+		if (formulas == nullptr)
+			throw std::runtime_error("Section FORMULAS not found in config file");
+		auto f = formulas->find(name);
+		return f == formulas->end() ? std::string() : f->second;
+	};
+	std::string type;
+	boost::filesystem::path ft;
+	double Ibar, p1, p2, p3, p4, p5, p6, p7;
+	double bW, xma, xmi, yma, ymi, zma, zmi;
+	std::string Bscale, Escale, Bx, By, Bz;
+	std::istringstream ss(params);
+	ss >> type;
 
-		else if (type == "B0GradX2" and ss >> p1 >> p2 >> p3 >> p4 >> xma >> xmi >> yma >> ymi >> zma >> zmi >> Bscale){
-			std::unique_ptr<TField> f( new TB0GradX2(p1, p2, p3, p4));
-			fields.emplace_back(TFieldContainer(std::move(f), Bscale, "0", xma, xmi, yma, ymi, zma, zmi, 0.));
+    if (type == "OPERA2D" or type == "2Dtable"){
+        return ReadOperaField2(params, out);
+	}
+    else if (type == "OPERA3D" or type == "3Dtable"){
+        return ReadOperaField3(params, out);
+	}
+    else if (type == "COMSOL"){
+        return ReadComsolField(params, out);
+	}
+    else if (type == "BINARY3D"){
+        return ReadBinaryField3(params, out);
+	}
+    else if (type == "BINARYOCTREE"){
+        return ReadBinaryOctree(params, out);
+	}
+    else if (type == "ConductorSet"){
+        return ReadConductorSet(params, out);
+	}
+    else if ((type == "Conductor") && (ss >> Ibar >> p1 >> p2 >> p3 >> p4 >> p5 >> p6 >> Bscale)){
+		std::unique_ptr<TField> f(new TConductorField(p1, p2, p3, p4, p5, p6, Ibar));
+        return TFieldContainer(std::move(f), Bscale);
+	}
+    else if ((type == "EDMStaticB0GradZField") && (ss >> p1 >> p2 >> p3 >> p4 >> p5 >> p6 >> p7 >> bW >> xma >> xmi >> yma >> ymi >> zma >> zmi >> Bscale)){
+		//conversion to radians
+		p4*=pi/180;
+		p5*=pi/180;
+		std::unique_ptr<TField> f(new TEDMStaticB0GradZField(p1, p2, p3, p4, p5, p6, p7));
+        return TFieldContainer(std::move(f), Bscale, "0", xma, xmi, yma, ymi, zma, zmi, bW);
+	}
+	else if (type == "HarmonicExpandedBField"){
+		return ReadHarmonicExpandedBField(params, out);
+	}
+    else if ((type == "EDMStaticEField") and (ss >> p1 >> p2 >> p3 >> Bscale)){
+		std::unique_ptr<TField> f(new TEDMStaticEField (p1, p2, p3));
+        return TFieldContainer(std::move(f), Bscale);
+	}
+	else if (type == "ExponentialFieldX" and ss >> p1 >> p2 >> p3 >> p4 >> p5 >> xma >> xmi >> yma >> ymi >> zma >> zmi >> Bscale){
+		std::unique_ptr<TField> f( new TExponentialFieldX(p1, p2, p3, p4, p5));
+		return TFieldContainer(std::move(f), Bscale, "0", xma, xmi, yma, ymi, zma, zmi, 0.);
+	}
+
+	else if (type == "LinearFieldZ" and	ss >> p1 >> p2 >> xma >> xmi >> yma >> ymi >> zma >> zmi >> Bscale){
+		std::unique_ptr<TField> f( new TLinearFieldZ(p1, p2));
+		return TFieldContainer(std::move(f), Bscale, "0", xma, xmi, yma, ymi, zma, zmi, 0.);
+	}
+
+	else if (type == "B0GradZ" and ss >> p1 >> p2 >> p3 >> xma >> xmi >> yma >> ymi >> zma >> zmi >> Bscale){
+		std::unique_ptr<TField> f(new TB0GradZ(p1, p2, p3));
+		return TFieldContainer(std::move(f), Bscale, "0", xma, xmi, yma, ymi, zma, zmi, 0.);
+	}
+
+	else if (type == "B0GradX2" and ss >> p1 >> p2 >> p3 >> p4 >> xma >> xmi >> yma >> ymi >> zma >> zmi >> Bscale){
+		std::unique_ptr<TField> f( new TB0GradX2(p1, p2, p3, p4));
+		return TFieldContainer(std::move(f), Bscale, "0", xma, xmi, yma, ymi, zma, zmi, 0.);
+	}
+
+	else if (type == "B0GradXY" and ss >> p1 >> p2 >> p3 >> xma >> xmi >> yma >> ymi >> zma >> zmi >> Bscale){
+		std::unique_ptr<TField> f(new TB0GradXY(p1, p2, p3));
+		return TFieldContainer(std::move(f), Bscale, "0", xma, xmi, yma, ymi, zma, zmi, 0.);
+	}
+
+	else if (type == "B0_XY" and ss >> p1 >> p2 >> xma >> xmi >> yma >> ymi >> zma >> zmi >> Bscale){
+		std::unique_ptr<TField> f(new TB0_XY(p1, p2));
+		return TFieldContainer(std::move(f), Bscale, "0", xma, xmi, yma, ymi, zma, zmi, 0.);
+	}
+
+	else if (type == "CustomBField" and ss >> Bx >> By >> Bz >> xma >> xmi >> yma >> ymi >> zma >> zmi >> bW >> Bscale){
+		std::unique_ptr<TField> f(new TCustomBField(formula(Bx), formula(By), formula(Bz)));
+		return TFieldContainer(std::move(f), Bscale, "0", xma, xmi, yma, ymi, zma, zmi, bW);
+	}
+	else{
+        throw std::runtime_error("Could not load field """ + type + """! Check config file for invalid field type or parameters.");
+	}
+}
+
+
+TFieldContainer TFieldManager::BakeFields(const std::string &params, const std::vector<std::string> &keys, std::vector<std::unique_ptr<TFieldContainer> > &loaded, std::ostream &out){
+	std::string type, IDs, Bscale;
+	double xma, xmi, yma, ymi, zma, zmi, tolerance;
+	int maxdepth;
+	std::istringstream ss(params);
+	if (!(ss >> type >> IDs >> xma >> xmi >> yma >> ymi >> zma >> zmi >> tolerance >> maxdepth >> Bscale))
+		throw std::runtime_error("Could not read all required parameters for field BakedField!");
+
+	std::vector<const TFieldContainer*> baked;
+	std::vector<size_t> indices;
+	std::istringstream ids(IDs);
+	for (std::string ID; std::getline(ids, ID, ',');){
+		auto key = std::find(keys.begin(), keys.end(), ID);
+		if (key == keys.end() || !loaded[key - keys.begin()])
+			throw std::runtime_error((boost::format("Field %1% in BakedField %2% not found!") % ID % IDs).str());
+		indices.push_back(key - keys.begin());
+		baked.push_back(loaded[indices.back()].get());
+	}
+
+	double center[3] = {0.5*(xma + xmi), 0.5*(yma + ymi), 0.5*(zma + zmi)}, B[3];
+	for (auto f: baked)
+		f->BField(center[0], center[1], center[2], 0, B, nullptr); // evaluate scaling formulas once, so they are not updated concurrently while sampling in parallel
+	auto sampler = [&baked](const double x, const double y, const double z, double B[4], double dBidxj[4][3]){
+		for (int i = 0; i < 4; ++i){
+			B[i] = 0;
+			for (int j = 0; j < 3; ++j)
+				dBidxj[i][j] = 0;
 		}
+		for (auto f: baked){
+			double Btmp[3] = {0, 0, 0}, dBtmp[3][3] = {{0, 0, 0}, {0, 0, 0}, {0, 0, 0}};
+			f->BField(x, y, z, 0, Btmp, dBtmp);
+			for (int i = 0; i < 3; ++i){
+				B[i] += Btmp[i];
+				for (int j = 0; j < 3; ++j)
+					dBidxj[i][j] += dBtmp[i][j];
+			}
+		}
+	};
+	out << "Baking fields " << IDs << " into octree with tolerance " << tolerance << " and maximum depth " << maxdepth << "\n";
+	std::unique_ptr<TField> f(new TOctreeField({{xmi, ymi, zmi}}, {{xma, yma, zma}}, sampler, true, false, tolerance, 0, maxdepth, out));
+	for (auto i: indices)
+		loaded[i].reset(); // remove baked fields from list
+	return TFieldContainer(std::move(f), Bscale, "0", xma, xmi, yma, ymi, zma, zmi, 0.);
+}
 
-		else if (type == "B0GradXY" and ss >> p1 >> p2 >> p3 >> xma >> xmi >> yma >> ymi >> zma >> zmi >> Bscale){
-			std::unique_ptr<TField> f(new TB0GradXY(p1, p2, p3));
-			fields.emplace_back(TFieldContainer(std::move(f), Bscale, "0", xma, xmi, yma, ymi, zma, zmi, 0.));
+
+void TFieldManager::BuildGrid(){
+	std::vector<std::array<double, 6> > boxes;
+	std::vector<size_t> bounded;
+	double min[3], max[3];
+	for (size_t i = 0; i < fields.size(); ++i){
+		if (fields[i].GetBoundingBox(min, max)){
+			bounded.push_back(i);
+			boxes.push_back({min[0], min[1], min[2], max[0], max[1], max[2]});
 		}
+		else
+			unbounded.push_back(i);
+	}
 
-		else if (type == "B0_XY" and ss >> p1 >> p2 >> xma >> xmi >> yma >> ymi >> zma >> zmi >> Bscale){
-			std::unique_ptr<TField> f(new TB0_XY(p1, p2));
-			fields.emplace_back(TFieldContainer(std::move(f), Bscale, "0", xma, xmi, yma, ymi, zma, zmi, 0.));
+	// enclose all bounded fields, aim for about eight cells per field with cubic cells
+	for (int j = 0; j < 3; ++j){
+		gridmin[j] = std::numeric_limits<double>::infinity();
+		max[j] = -std::numeric_limits<double>::infinity();
+		gridsize[j] = 0;
+		cellsize[j] = 1;
+	}
+	for (auto &box: boxes){
+		for (int j = 0; j < 3; ++j){
+			gridmin[j] = std::min(gridmin[j], box[j]);
+			max[j] = std::max(max[j], box[j + 3]);
 		}
+	}
+	if (boxes.empty())
+		return;
+	double h = std::cbrt((max[0] - gridmin[0])*(max[1] - gridmin[1])*(max[2] - gridmin[2])/std::min(8*boxes.size(), static_cast<size_t>(32768)));
+	for (int j = 0; j < 3; ++j){
+		gridsize[j] = std::max(1, std::min(64, static_cast<int>(std::ceil((max[j] - gridmin[j])/h))));
+		cellsize[j] = (max[j] - gridmin[j])/gridsize[j];
+	}
 
-		else if (type == "CustomBField" and ss >> Bx >> By >> Bz >> xma >> xmi >> yma >> ymi >> zma >> zmi >> bW >> Bscale){
-			std::unique_ptr<TField> f(new TCustomBField(conf["FORMULAS"][Bx], conf["FORMULAS"][By], conf["FORMULAS"][Bz]));
-			fields.emplace_back(TFieldContainer(std::move(f), Bscale, "0", xma, xmi, yma, ymi, zma, zmi, bW));
+	cells.resize(gridsize[0]*gridsize[1]*gridsize[2], unbounded);
+	for (size_t b = 0; b < boxes.size(); ++b){
+		int lo[3], hi[3];
+		for (int j = 0; j < 3; ++j){ // add some slack to be safe against rounding in FieldsAt
+			lo[j] = std::max(0, static_cast<int>(std::floor((boxes[b][j] - gridmin[j])/cellsize[j] - 1e-9)));
+			hi[j] = std::min(gridsize[j] - 1, static_cast<int>(std::floor((boxes[b][j + 3] - gridmin[j])/cellsize[j] + 1e-9)));
 		}
-		else{
-            throw std::runtime_error("Could not load field """ + type + """! Check config file for invalid field type or parameters.");
+		for (int i = lo[0]; i <= hi[0]; ++i){
+			for (int j = lo[1]; j <= hi[1]; ++j){
+				for (int k = lo[2]; k <= hi[2]; ++k){
+					std::vector<size_t> &cell = cells[(i*gridsize[1] + j)*gridsize[2] + k];
+					cell.insert(std::upper_bound(cell.begin(), cell.end(), bounded[b]), bounded[b]); // keep original order of fields
+				}
+			}
 		}
 	}
-	std::cout << "\n";
+	size_t entries = 0;
+	for (auto &cell: cells)
+		entries += cell.size() - unbounded.size();
+	std::cout << "Indexed " << boxes.size() << " fields with boundaries in " << gridsize[0] << "x" << gridsize[1] << "x" << gridsize[2]
+			<< " grid, each point visits " << boost::format("%.1f") % (static_cast<double>(entries)/cells.size()) << " of them on average\n";
+}
+
+
+const std::vector<size_t>& TFieldManager::FieldsAt(const double x, const double y, const double z) const{
+	const double p[3] = {x, y, z};
+	int idx[3];
+	for (int j = 0; j < 3; ++j){
+		double u = (p[j] - gridmin[j])/cellsize[j];
+		if (not (u >= -1e-9 and u <= gridsize[j]*(1 + 1e-9))) // outside of grid (or no grid at all), only unbounded fields can be non-zero
+			return unbounded;
+		idx[j] = std::max(0, std::min(gridsize[j] - 1, static_cast<int>(u)));
+	}
+	return cells[(idx[0]*gridsize[1] + idx[1])*gridsize[2] + idx[2]];
 }
 
 
@@ -112,7 +290,8 @@ void TFieldManager::BField(const double x, const double y, const double z, const
 		}
 	}
 
-    for (const auto &it: fields){
+    for (size_t f: FieldsAt(x, y, z)){
+		const TFieldContainer &it = fields[f];
 		double Btmp[3] = {0,0,0};
 		double dBtmp[3][3] = {{0,0,0},{0,0,0},{0,0,0}};
 		if (dBidxj != nullptr)
@@ -137,7 +316,8 @@ void TFieldManager::EField(const double x, const double y, const double z, const
 	for (int i = 0; i < 3; i++){
 		Ei[i] = 0;
 	}
-    for (const auto &it: fields){
+    for (size_t f: FieldsAt(x, y, z)){
+		const TFieldContainer &it = fields[f];
 		double Vtmp = 0, Etmp[3] = {0,0,0};
 
         it.EField(x, y, z, t, Vtmp, Etmp);
@@ -147,3 +327,51 @@ void TFieldManager::EField(const double x, const double y, const double z, const
 				Ei[i] += Etmp[i];
 		}
 }
+
+
+TFieldCache::TFieldCache(): next(0){
+	for (auto &s: samples){
+		s.t = std::numeric_limits<double>::quiet_NaN(); // NaN never matches any key
+		s.hasB = s.hasdB = s.hasE = false;
+	}
+}
+
+
+TFieldCache::sample& TFieldCache::Find(const double x, const double y, const double z, const double t){
+	for (auto &s: samples){
+		if (s.t == t && s.x == x && s.y == y && s.z == z)
+			return s;
+	}
+	sample &s = samples[next];
+	next = (next + 1) % size;
+	s.t = t;
+	s.x = x;
+	s.y = y;
+	s.z = z;
+	s.hasB = s.hasdB = s.hasE = false;
+	return s;
+}
+
+
+void TFieldCache::BField(const TFieldManager &field, const double x, const double y, const double z, const double t, double B[3], double dBidxj[3][3]){
+	sample &s = Find(x, y, z, t);
+	if (!s.hasB || (dBidxj != nullptr && !s.hasdB)){
+		field.BField(x, y, z, t, s.B, dBidxj != nullptr ? s.dBidxj : nullptr);
+		s.hasB = true;
+		s.hasdB |= dBidxj != nullptr;
+	}
+	std::copy(s.B, s.B + 3, B);
+	if (dBidxj != nullptr)
+		std::copy(&s.dBidxj[0][0], &s.dBidxj[0][0] + 9, &dBidxj[0][0]);
+}
+
+
+void TFieldCache::EField(const TFieldManager &field, const double x, const double y, const double z, const double t, double &V, double Ei[3]){
+	sample &s = Find(x, y, z, t);
+	if (!s.hasE){
+		field.EField(x, y, z, t, s.V, s.Ei);
+		s.hasE = true;
+	}
+	V = s.V;
+	std::copy(s.Ei, s.Ei + 3, Ei);
+}
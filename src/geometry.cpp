@@ -2,8 +2,10 @@
 
 #include <iostream>
 #include <algorithm>
+#include <cmath>
 
 #include "globals.h"
+#include "primitives.h"
 
 using namespace std;
 
@@ -59,7 +61,14 @@ std::ostream& operator<<(std::ostream &str, const material &mat){
 }
 
 std::istream& operator>>(std::istream &str, solid &model){
-	str >> model.filename >> model.mat.name;
+	str >> model.filename;
+	int nparams = PrimitiveParameterCount(model.filename.string());
+	if (nparams >= 0){ // analytic solid instead of STL file
+		model.primitive.resize(nparams);
+		for (double &p: model.primitive)
+			str >> p;
+	}
+	str >> model.mat.name;
 	if (!str)
 		throw std::runtime_error((boost::format("Could not load solid with ID %d! Did you define invalid parameters?") % model.ID).str());
 
@@ -78,18 +87,62 @@ std::istream& operator>>(std::istream &str, solid &model){
 			throw std::runtime_error((boost::format("Invalid ignoretimes for solid %d") % model.ID).str());
 		}
 	}
+
+	if (!str.eof()){ // optional rigid transformation following ignore times
+		str.clear();
+		std::string keyword;
+		while (str >> keyword){
+			std::vector<double> &params = keyword == "rotate" ? model.rotation : model.translation;
+			if (keyword != "rotate" && keyword != "translate")
+				throw std::runtime_error((boost::format("Unknown parameter '%s' for solid %d") % keyword % model.ID).str());
+			params.resize(keyword == "rotate" ? 4 : 3);
+			for (double &p: params)
+				str >> p;
+			if (!str)
+				throw std::runtime_error((boost::format("Invalid %s parameters for solid %d") % keyword % model.ID).str());
+		}
+		str.clear(std::ios::eofbit | std::ios::failbit);
+	}
 	return str;
 }
 
 std::ostream& operator<<(std::ostream &str, const solid &sld){
-	str << sld.ID << " " << sld.filename << " " << sld.mat.name;
+	str << sld.ID << " " << sld.filename.string();
+	for (double p: sld.primitive)
+		str << " " << p;
+	str << " " << sld.mat.name;
 	for (auto i : sld.ignoretimes)
 		str << " " << i.first << "-" << i.second;
+	if (!sld.rotation.empty())
+		str << " rotate " << sld.rotation[0] << " " << sld.rotation[1] << " " << sld.rotation[2] << " " << sld.rotation[3];
+	if (!sld.translation.empty())
+		str << " translate " << sld.translation[0] << " " << sld.translation[1] << " " << sld.translation[2];
 	if (!str)
 		throw std::runtime_error((boost::format("Could not write solid %d!") % sld.ID).str());
 	return str;
 }
 
+// build rigid transformation from rotation axis and angle (Rodrigues' formula) and translation
+CTransform SolidTransform(const solid &sld){
+	double R[3][3] = {{1., 0., 0.}, {0., 1., 0.}, {0., 0., 1.}};
+	if (!sld.rotation.empty()){
+		double norm = std::sqrt(sld.rotation[0]*sld.rotation[0] + sld.rotation[1]*sld.rotation[1] + sld.rotation[2]*sld.rotation[2]);
+		if (norm == 0)
+			throw std::runtime_error((boost::format("Rotation axis of solid %d has zero length") % sld.ID).str());
+		double u[3] = {sld.rotation[0]/norm, sld.rotation[1]/norm, sld.rotation[2]/norm};
+		double c = std::cos(sld.rotation[3]*conv), s = std::sin(sld.rotation[3]*conv);
+		for (int i = 0; i < 3; ++i){
+			for (int j = 0; j < 3; ++j)
+				R[i][j] = (i == j ? c : 0.) + (1 - c)*u[i]*u[j];
+		}
+		R[0][1] -= s*u[2]; R[1][0] += s*u[2];
+		R[0][2] += s*u[1]; R[2][0] -= s*u[1];
+		R[1][2] -= s*u[0]; R[2][1] += s*u[0];
+	}
+	std::vector<double> t = sld.translation.empty() ? std::vector<double>(3, 0.) : sld.translation;
+	return CTransform(R[0][0], R[0][1], R[0][2], t[0], R[1][0], R[1][1], R[1][2], t[1], R[2][0], R[2][1], R[2][2], t[2]);
+}
+
 TGeometry::TGeometry(TConfig &geometryin){
 	boost::filesystem::path matpath;
 	istringstream(geometryin["GLOBAL"]["materials_file"]) >> matpath; // check if there is a materials file linked in the config file
@@ -112,6 +165,8 @@ TGeometry::TGeometry(TConfig &geometryin){
 					}
 	); // Read materials from config and add them to list
 
+	std::vector<std::pair<std::string, int> > stlfiles;
+	std::vector<solid> primitivesolids;
 	for (auto sldparams : geometryin["GEOMETRY"]){
 		solid sld;
 		istringstream(sldparams.first) >> sld.ID;
@@ -126,23 +181,74 @@ TGeometry::TGeometry(TConfig &geometryin){
 			sld.name = "default solid";
 			defaultsolid = sld;
 		}
+		else if (!sld.primitive.empty()){
+			primitivesolids.push_back(sld);
+		}
 		else{
-			sld.name = mesh.ReadFile(boost::filesystem::absolute(sld.filename, configpath.parent_path()).native(), sld.ID);
+			stlfiles.push_back(std::make_pair(boost::filesystem::absolute(sld.filename, configpath.parent_path()).native(), sld.ID));
 			solids.push_back(sld);
 		}
 	}
 
+	bool mergecoplanar = false;
+	istringstream(geometryin["GLOBAL"]["mergecoplanar"]) >> mergecoplanar;
+	std::vector<std::string> names = mesh.ReadFiles(stlfiles, mergecoplanar); // load all STL files in parallel, identical files share a single mesh
+	for (size_t i = 0; i < solids.size(); ++i)
+		solids[i].name = names[i];
+	for (auto &sld: primitivesolids){ // add analytic solids after STL solids, so the order of solids matches the order in mesh
+		sld.name = sld.filename.string();
+		mesh.AddPrimitive(CreatePrimitive(sld.name, sld.primitive), sld.ID);
+		std::cout << "Created " << sld << "\n";
+		solids.push_back(sld);
+	}
+	for (auto &sld: solids){
+		if (!sld.rotation.empty() || !sld.translation.empty())
+			mesh.SetTransform(sld.ID, SolidTransform(sld));
+	}
+
 	if (std::unique(solids.begin(), solids.end(), [](const solid s1, const solid s2){ return s1.ID == s2.ID; }) != solids.end()) // check if IDs of each solid are unique
 		throw std::runtime_error("You defined solids with identical ID! IDs have to be unique!");
+
+	// split time into intervals in which the set of ignored solids is constant
+	for (size_t i = 0; i < solids.size(); ++i){
+		solidindex[solids[i].ID] = i;
+		for (auto its: solids[i].ignoretimes){
+			ignoretimesteps.push_back(its.first);
+			ignoretimesteps.push_back(its.second);
+		}
+	}
+	std::sort(ignoretimesteps.begin(), ignoretimesteps.end());
+	ignoretimesteps.erase(std::unique(ignoretimesteps.begin(), ignoretimesteps.end()), ignoretimesteps.end());
+	ignoredsolids.push_back(std::vector<bool>(solids.size(), false)); // no solid is ignored before the first step
+	for (double t: ignoretimesteps){ // ignore state is constant from each step until the next one
+		std::vector<bool> ignored;
+		std::transform(solids.begin(), solids.end(), std::back_inserter(ignored), [t](const solid &sld){ return sld.is_ignored(t); });
+		ignoredsolids.push_back(ignored);
+	}
 }
 
-bool TGeometry::GetCollisions(const double x1, const double p1[3], const double x2, const double p2[3], multimap<TCollision, bool> &colls) const{
-	vector<TCollision> c = mesh.Collision(std::vector<double>{p1[0], p1[1], p1[2]}, std::vector<double>{p2[0], p2[1], p2[2]});
+bool TGeometry::GetCollisions(const double x1, const double p1[3], const double x2, const double p2[3], multimap<TCollision, bool> &colls,
+								const std::vector<std::pair<solid, bool> > *currentsolids, TMeshQueryCache *cache) const{
+	std::vector<bool> skip;
+	if (currentsolids){ // skip solids which are ignored in all time intervals touched by the segment and which the particle is not inside of
+		size_t i1 = GetTimeInterval(std::min(x1, x2)), i2 = GetTimeInterval(std::max(x1, x2));
+		skip = ignoredsolids[i1];
+		for (size_t i = i1 + 1; i <= i2; ++i){
+			for (size_t j = 0; j < skip.size(); ++j)
+				skip[j] = skip[j] && ignoredsolids[i][j];
+		}
+		for (auto &sld: *currentsolids){
+			auto idx = solidindex.find(sld.first.ID);
+			if (idx != solidindex.end())
+				skip[idx->second] = false;
+		}
+	}
+
+	vector<TCollision> c = mesh.Collision(std::vector<double>{p1[0], p1[1], p1[2]}, std::vector<double>{p2[0], p2[1], p2[2]}, skip, cache);
 	colls.clear();
 	for (auto it: c){
-		solid sld = GetSolid(it.ID);
 		double t = x1 + (x2 - x1)*it.s;
-		colls.emplace(it, sld.is_ignored(t));
+		colls.emplace(it, ignoredsolids[GetTimeInterval(t)][solidindex.at(it.ID)]);
 	}
 	return !colls.empty();
 }
@@ -168,8 +274,8 @@ solid TGeometry::GetSolid(const double t, const double p[3]) const{
 }
 
 solid TGeometry::GetSolid(const unsigned ID) const{
-	auto sld = std::find_if(solids.begin(), solids.end(), [&ID](const solid &s){ return s.ID == ID; });
-	if (sld == solids.end())
+	auto idx = solidindex.find(ID);
+	if (idx == solidindex.end())
 		throw std::runtime_error((boost::format("Could not find solid with ID %s") % ID).str());
-	return *sld;
+	return solids[idx->second];
 }
@@ -1,329 +1,233 @@
-
 /**
  * \file
- * Implementation of a magnetic field determined by 
+ * Implementation of a magnetic field determined by
  * coefficients, provided as inputs by the user, of an expansion in
  * terms of harmonic polynomials.
 */
 
 #include "harmonicfields.h"
-#include <boost/math/special_functions/legendre.hpp>
-#include <boost/math/special_functions/factorials.hpp>
-#include <boost/math/tools/roots.hpp>
-#include <iostream>
-#include <cmath>
-#include <boost/math/quaternion.hpp>
-#include <boost/numeric/ublas/vector.hpp>
-#include <boost/math/constants/constants.hpp>
 
-HarmonicExpandedBField::HarmonicExpandedBField(const double _xoff, const double _yoff, const double _zoff, 
-		const double _axis_x, const double _axis_y, const double _axis_z, const double _angle, 
-		const double G0, const double G1, const double G2, const double G3, const double G4, const double G5, const double G6, const double G7, const double G8, 
-		const double G9, const double G10, const double G11, const double G12, const double G13, const double G14, const double G15, const double G16, const double G17, 
-		const double G18, const double G19, const double G20, const double G21, const double G22, const double G23){
+#include <cmath>
+#include <map>
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+#include <algorithm>
 
-	// the offset values
-	xoff = _xoff;
-	yoff = _yoff;
-	zoff = _zoff;
+#include <boost/format.hpp>
+#include <boost/filesystem.hpp>
 
-	// parameters defining the axis-angle quaternion rotation
-	axis_x = _axis_x;
-	axis_y = _axis_y;
-	axis_z = _axis_z;
-	angle  = _angle;
+#include "globals.h"
 
-	// G parameters
-    G[0]  = G0;
-	G[1]  = G1;
-	G[2]  = G2;
-	G[3]  = G3;
-	G[4]  = G4;
-	G[5]  = G5;
-	G[6]  = G6;
-	G[7]  = G7;
-	G[8]  = G8;
-	G[9]  = G9;
-	G[10] = G10;
-	G[11] = G11;
-	G[12] = G12;
-	G[13] = G13;
-	G[14] = G14;
-	G[15] = G15;
-	G[16] = G16;
-	G[17] = G17;
-	G[18] = G18;
-	G[19] = G19;
-	G[20] = G20;
-	G[21] = G21;
-	G[22] = G22;
-	G[23] = G23;
+/// Polynomial in x, y, and z, mapping exponents to coefficients
+typedef std::map<std::array<int, 3>, double> polynomial;
 
+/**
+ * Multiply two polynomials
+ */
+static polynomial Multiply(const polynomial &a, const polynomial &b){
+	polynomial p;
+	for (auto &i: a){
+		for (auto &j: b)
+			p[{{i.first[0] + j.first[0], i.first[1] + j.first[1], i.first[2] + j.first[2]}}] += i.second*j.second;
 	}
+	return p;
+}
 
-void HarmonicExpandedBField::BField(const double _x, const double _y, const double _z, const double t, double B[3], double dBidxj[3][3]) const{
-
-	// Updating the x, y, z values with the given offset values
-	double x = _x + xoff;
-	double y = _y + yoff;
-	double z = _z + zoff;
-
-	/* 
-	Information about Calculating the Harmonic Polynomial Expansion
-
-	The calculations below are hard-coded using the cartesian form of the 
-	harmonic polynomial expansion. Alternatively, this can be carried out 
-	in an iterative fashion using the BOOST library for "Legendre and 
-	associated polynomials":
-	
-	boost.org/doc/libs/1_65_0/libs/math/doc/html/math_toolkit/sf_poly/legendre.html 
-
-	This was not chosen for the implementation here because it was believed
-	that this hard-coded representation displayed the physical form of the 
-	functions more explicitly. Perhaps more importantly, this form is much
-	easier to debug. 
-
-	If in future, simulations wish to explore harmonic expansions above third 
-	order, returning to an implementation using BOOST's legendre library may
-	be preferrable. 
-	*/
-
-	// Calculating B_x
-	B[0] = 	  G[2] 	\
-			+ G[3]  * (y) \
-			+ G[5]  * (-x / 2) \
-			+ G[6]  * (z) \
-			+ G[7]  * (x) \
-			+ G[8]  * (2 * x * y) \
-			+ G[9]  * (2 * y * z) \
-			+ G[10] * (-x * y / 2) \
-			+ G[11] * (-x * z) \
-			+ G[12] * (-(3 * pow(x,2) + pow(y,2) - 4 * pow(z,2)) / 4) \
-			+ G[13] * (2 * x * z) \
-			+ G[14] * ((pow(x,2) - pow(y,2))) \
-			+ G[15] * ((3 * pow(x,2) * y - pow(y,3))) \
-			+ G[16] * (6 * x * y * z) \
-			+ G[17] * (-(3 * pow(x,2) * y + pow(y,3) - 6 * y * pow(z,2)) / 2) \
-			+ G[18] * (-(3 / 2) * (x * y * z)) \
-			+ G[19] * ((3 / 8) * (pow(x,3) + x * pow(y,2) - 4 * x * pow(z,2))) \
-			+ G[20] * ((-1 / 4) * (9 * pow(x,2) * z + 3 * pow(y,2) * z - 4 * pow(z,3))) \
-			+ G[21] * (-pow(x,3) + 3 * x * pow(z,2)) \
-			+ G[22] * (3 * (pow(x,2) * z - pow(y,2) * z)) \
-			+ G[23] * (pow(x,3) - 3 * x * pow(y,2));
-	
-	// Calculating B_y
-	B[1] =	  G[0] 	\
-			+ G[3]  * (x) \
-			+ G[4]  * (z) \
-			+ G[5]  * (-y / 2) \
-			+ G[7]  * (-y) \
-			+ G[8]  * (pow(x,2) - pow(y,2)) \
-			+ G[9]  * (2 * x * z) \
-			+ G[10] * ((pow(x,2) + 3 * pow(y,2) - 4 * pow(z,2)) / 4) \
-			+ G[11] * (-y * z) \
-			+ G[12] * (-x * y / 2) \
-			+ G[13] * (-2 * y * z) \
-			+ G[14] * (-2 * x * y) \
-			+ G[15] * (pow(x,3) - 3 * x * pow(y,2)) \
-			+ G[16] * (3 * (pow(x,2) * z - pow(y,2) * z)) \
-			+ G[17] * (-(pow(x,3) + 3 * x * pow(y,2) - 6 * x * pow(z,2)) / 2) \
-			+ G[18] * ( (-1 / 4) * (3 * pow(x,2) * z + 9 * pow(y,2) * z - 4 * pow(z,3))) \
-			+ G[19] * ((3 / 8) * (pow(x,2) * y + pow(y,3) - 4 * y * pow(z,2))) \
-			+ G[20] * ((-3 / 2) * x * y * z) \
-			+ G[21] * (-3 * y * pow(z,2) + pow(y,3)) \
-			+ G[22] * (-6 * x * y * z) \
-			+ G[23] * (-3 * pow(x,2) * y + pow(y,3));
-
-	// Calculating B_z
-	B[2] =	  G[1] 	\
-			+ G[4]  * (y) \
-			+ G[5]  * (z) \
-			+ G[6]  * (x) \
-			+ G[9]  * (2 * x * y) \
-			+ G[10] * (2 * y * z) \
-			+ G[11] * (pow(z,2) - (1 / 2) * (pow(x,2) + pow(y,2))) \
-			+ G[12] * (2 * x * z) \
-			+ G[13] * (pow(x,2) - pow(y,2)) \
-			+ G[16] * (3 * pow(x,2) * y - pow(y,3))\
-			+ G[17] * (6 * x * y * z)  \
-			+ G[18] * (3 * y * pow(z,2) - (3/4) * (pow(x,2) * y + pow(y,3))) \
-			+ G[19] * (pow(z,3) - (3 / 2) * z * (pow(x,2) + pow(y,2))) \
-			+ G[20] * (3 * x * pow(z,2) - (3/4) * (pow(x,3) + x * pow(y,2))) \
-			+ G[21] * (3 * (pow(x,2) * z - pow(y,2) * z)) \
-			+ G[22] * (pow(x,3) - 3 * x * pow(y,2));
-
-	// Calculating dBxdx
-	dBidxj[0][0] = -G[5]/2 + G[7] + 2*G[8]*y - G[10]*y/2 - G[11]*z - \
-					3*G[12]*x/2 + 2*G[13]*z + 2*G[14]*x + 6*G[15]*x*y + \
-					6*G[16]*y*z - 3*G[17]*x*y - 1.5*G[18]*y*z + \
-					G[19]*(1.125*pow(x,2) + 0.375*pow(y,2) - 1.5*pow(z,2)) - \
-					4.5*G[20]*x*z + G[21]*(-3*pow(x,2) + 3*pow(z,2)) + \
-					6*G[22]*x*z + G[23]*(3*pow(x,2) - 3*pow(y,2));
-
-	// Calculating dBxdy
-	dBidxj[0][1] = G[3] + 2*G[8]*x + 2*G[9]*z - G[10]*x/2 - G[12]*y/2 - \
-					2*G[14]*y + G[15]*(3*pow(x,2) - 3*pow(y,2)) + 6*G[16]*x*z+\
-					G[17]*(-3*pow(x,2)/2 - 3*pow(y,2)/2 + 3*pow(z,2)) - \
-					1.5*G[18]*x*z + 0.75*G[19]*x*y - 1.5*G[20]*y*z - \
-					6*G[22]*y*z - 6*G[23]*x*y;
-
-	// Calculating dBxdz
-	dBidxj[0][2] = G[6] + 2*G[9]*y - G[11]*x + 2*G[12]*z + 2*G[13]*x + \
-					6*G[16]*x*y + 6*G[17]*y*z - 1.5*G[18]*x*y - 3.0*G[19]*x*z+\
-					G[20]*(-2.25*pow(x,2) - 0.75*pow(y,2) + 3.0*pow(z,2)) + \
-					6*G[21]*x*z + G[22]*(3*pow(x,2) - 3*pow(y,2));
-
-	// Calculating dBydx
-	dBidxj[1][0] = G[3] + 2*G[8]*x + 2*G[9]*z + G[10]*x/2 - G[12]*y/2 - \
-					2*G[14]*y + G[15]*(3*pow(x,2) - 3*pow(y,2)) + 6*G[16]*x*z+\
-					G[17]*(-3*pow(x,2)/2 - 3*pow(y,2)/2 + 3*pow(z,2)) - \
-					1.5*G[18]*x*z + 0.75*G[19]*x*y - 1.5*G[20]*y*z - \
-					6*G[22]*y*z - 6*G[23]*x*y;
-
-	// Calculating dBydy
-	dBidxj[1][1] = -G[5]/2 - G[7] - 2*G[8]*y + 3*G[10]*y/2 - G[11]*z - \
-					G[12]*x/2 - 2*G[13]*z - 2*G[14]*x - 6*G[15]*x*y - \
-					6*G[16]*y*z - 3*G[17]*x*y - 4.5*G[18]*y*z + \
-					G[19]*(0.375*pow(x,2) + 1.125*pow(y,2) - 1.5*pow(z,2)) - \
-					1.5*G[20]*x*z + G[21]*(3*pow(y,2) - 3*pow(z,2)) - \
-					6*G[22]*x*z + G[23]*(-3*pow(x,2) + 3*pow(y,2));
-
-	// Calculating dBydz
-	dBidxj[1][2] = G[4] + 2*G[9]*x - 2*G[10]*z - G[11]*y - 2*G[13]*y + \
-					G[16]*(3*pow(x,2) - 3*pow(y,2)) + 6*G[17]*x*z + \
-					G[18]*(-0.75*pow(x,2) - 2.25*pow(y,2) + 3.0*pow(z,2)) - \
-					3.0*G[19]*y*z - 1.5*G[20]*x*y - 6*G[21]*y*z - 6*G[22]*x*y;
-
-	// Calculating dBzdx
-	dBidxj[2][0] = G[6] + 2*G[9]*y - 1.0*G[11]*x + 2*G[12]*z + 2*G[13]*x + \
-					6*G[16]*x*y + 6*G[17]*y*z - 1.5*G[18]*x*y - 3.0*G[19]*x*z+\
-					G[20]*(-2.25*pow(x,2) - 0.75*pow(y,2) + 3*pow(z,2)) + \
-					6*G[21]*x*z + G[22]*(3*pow(x,2) - 3*pow(y,2));
-
-	// Calculating dBzdy
-	dBidxj[2][1] = G[4] + 2*G[9]*x + 2*G[10]*z - 1.0*G[11]*y - 2*G[13]*y + \
-					G[16]*(3*pow(x,2) - 3*pow(y,2)) + 6*G[17]*x*z + \
-					G[18]*(-0.75*pow(x,2) - 2.25*pow(y,2) + 3*pow(z,2)) - \
-					3.0*G[19]*y*z - 1.5*G[20]*x*y - 6*G[21]*y*z - 6*G[22]*x*y;
-
-	// Calculating dBzdz
-	dBidxj[2][2] = G[5] + 2*G[10]*y + 2*G[11]*z + 2*G[12]*x + 6*G[17]*x*y + \
-					6*G[18]*y*z + G[19]*(-1.5*pow(x,2) - 1.5*pow(y,2) + \
-					3*pow(z,2)) + 6*G[20]*x*z + G[21]*(3*pow(x,2) -3*pow(y,2));
-
-	/* 
-	Information about Rotations with Quaternions
-
-	from the double-specific constructor documentation of BOOST
-	boost.org/doc/libs/1_70_0/libs/math/doc/html/math_toolkit/quat_mem_fun.html
-
-	explicit quaternion(double const & requested_a = 0.0, 
-						double const & requested_b = 0.0, 
-						double const & requested_c = 0.0, 
-						double const & requested_d = 0.0);
-
-	This constructs a quartention. From the useful wikipedia page on rotations
-	and quartenions... wikipedia.org/wiki/Quaternions_and_spatial_rotation
+/**
+ * Add multiple of polynomial b to polynomial a
+ */
+static void Add(polynomial &a, const polynomial &b, const double factor){
+	for (auto &j: b)
+		a[j.first] += factor*j.second;
+}
 
-	"In a programmatic implementation, this is achieved by constructing a 
-	quaternion whose vector part is p and real part equals zero and then
-	performing the quaternion multiplication. The vector part of the resulting 
-	quaternion is the desired vector p′."
+/**
+ * Differentiate polynomial with respect to x (dim = 0), y (dim = 1), or z (dim = 2)
+ */
+static polynomial Derivative(const polynomial &a, const int dim){
+	polynomial p;
+	for (auto &i: a){
+		if (i.first[dim] > 0){
+			std::array<int, 3> e = i.first;
+			--e[dim];
+			p[e] += i.second*i.first[dim];
+		}
+	}
+	return p;
+}
 
-	here they refer to the original vector, which we want to rotate, as p. The 
-	resulting, rotated, vector is called p'. Refer to the referenced wikipedia
-	page for details on how to construct the desired quartenion q. On that 
-	wikipedia page, an example rotation in 3D space is provided. 
 
-	(!!!) due to the limitation of boost version within the UCN cluster, 
-	we are not able to use the QVM library (earliest v1.62 of boost) which 
-	contains more updated functionality specific to the rotations 
-	implemented here. See http://boostorg.github.io/qvm/#quat_rotate
-	and https://github.com/boostorg/qvm
-	*/
+const int HarmonicExpandedBField::maxorder;
+
+HarmonicExpandedBField::HarmonicExpandedBField(const double _xoff, const double _yoff, const double _zoff,
+		const double axis_x, const double axis_y, const double axis_z, const double angle, const std::vector<double> &G):
+		xoff(_xoff), yoff(_yoff), zoff(_zoff){
+	// find order l, coefficients up to order l are G(0,-1) ... G(l,l+1), (l + 1)*(l + 3) in total
+	int l = 0;
+	while ((l + 1)*(l + 3) < static_cast<int>(G.size()))
+		++l;
+	if (l > maxorder)
+		throw std::runtime_error((boost::format("Harmonic expansion of order %1% exceeds maximum order %2%!") % l % maxorder).str());
+	const int N = l + 1; // the potential contains solid harmonics up to degree l + 1
+	degree = l;
+
+	// regular solid harmonics r^n P_n^m(cos(theta)) exp(i m phi) as real and imaginary polynomials, from the recurrences of associated Legendre polynomials
+	const polynomial X = {{{{1, 0, 0}}, 1.}}, Y = {{{{0, 1, 0}}, 1.}}, Z = {{{{0, 0, 1}}, 1.}}, R2 = {{{{2, 0, 0}}, 1.}, {{{0, 2, 0}}, 1.}, {{{0, 0, 2}}, 1.}};
+	std::vector<std::vector<std::array<polynomial, 2> > > R(N + 1);
+	for (int n = 0; n <= N; ++n)
+		R[n].resize(n + 1);
+	R[0][0][0] = {{{{0, 0, 0}}, 1.}};
+	for (int m = 1; m <= N; ++m){ // R_m^m = -(2m - 1) (x + iy) R_(m-1)^(m-1)
+		Add(R[m][m][0], Multiply(X, R[m - 1][m - 1][0]), -(2*m - 1));
+		Add(R[m][m][0], Multiply(Y, R[m - 1][m - 1][1]), 2*m - 1);
+		Add(R[m][m][1], Multiply(X, R[m - 1][m - 1][1]), -(2*m - 1));
+		Add(R[m][m][1], Multiply(Y, R[m - 1][m - 1][0]), -(2*m - 1));
+	}
+	for (int m = 0; m < N; ++m){
+		for (int n = m + 1; n <= N; ++n){ // (n - m) R_n^m = (2n - 1) z R_(n-1)^m - (n + m - 1) r^2 R_(n-2)^m
+			for (int part = 0; part < 2; ++part){
+				Add(R[n][m][part], Multiply(Z, R[n - 1][m][part]), (2.*n - 1)/(n - m));
+				if (n - 2 >= m)
+					Add(R[n][m][part], Multiply(R2, R[n - 2][m][part]), -(n + m - 1.)/(n - m));
+			}
+		}
+	}
 
-	// The B vector is rotated, as well as the three dBxdxj, dBydxj dBzdxj 
-	// directional gradient vectors, using the same quaternion conjugation.
-	// This achieves a full rotation of the magnetic field and its spatial 
-	// derivatives.
+	// potential
+	polynomial Phi;
+	for (int ll = 0; ll <= l; ++ll){
+		int n = ll + 1;
+		for (int m = -n; m <= n; ++m){
+			std::size_t index = ll*ll + 3*ll + 1 + m;
+			if (index >= G.size() || G[index] == 0)
+				continue;
+			int am = std::abs(m);
+			double C = std::pow(-2., am); // C(n, m) = (n - 1)! (-2)^m / (n + m)!
+			for (int k = n; k <= n + am; ++k)
+				C /= k;
+			Add(Phi, R[n][am][m >= 0 ? 0 : 1], G[index]*C);
+		}
+	}
 
-	// if the user provides values of 0 for every input to the axis of rotation
-	// then no rotation is performed.
+	// rotate potential, Phi'(p) = Phi(R^T p), so B' = grad Phi' = R B(R^T p)
 	if (axis_x != 0 || axis_y != 0 || axis_z != 0){
+		double norm = std::sqrt(axis_x*axis_x + axis_y*axis_y + axis_z*axis_z);
+		double u[3] = {axis_x/norm, axis_y/norm, axis_z/norm}, c = std::cos(angle), s = std::sin(angle);
+		double rot[3][3] = {{c + u[0]*u[0]*(1 - c), u[0]*u[1]*(1 - c) - u[2]*s, u[0]*u[2]*(1 - c) + u[1]*s},
+							{u[1]*u[0]*(1 - c) + u[2]*s, c + u[1]*u[1]*(1 - c), u[1]*u[2]*(1 - c) - u[0]*s},
+							{u[2]*u[0]*(1 - c) - u[1]*s, u[2]*u[1]*(1 - c) + u[0]*s, c + u[2]*u[2]*(1 - c)}};
+		std::array<std::vector<polynomial>, 3> qpow; // powers of rotated coordinates q_j = sum_k rot[k][j] p_k
+		for (int j = 0; j < 3; ++j){
+			polynomial q = {{{{1, 0, 0}}, rot[0][j]}, {{{0, 1, 0}}, rot[1][j]}, {{{0, 0, 1}}, rot[2][j]}};
+			qpow[j].push_back({{{{0, 0, 0}}, 1.}});
+			for (int k = 1; k <= N; ++k)
+				qpow[j].push_back(Multiply(qpow[j].back(), q));
+		}
+		polynomial rotated;
+		for (auto &t: Phi)
+			Add(rotated, Multiply(Multiply(qpow[0][t.first[0]], qpow[1][t.first[1]]), qpow[2][t.first[2]]), t.second);
+		Phi.swap(rotated);
+	}
 
-        // construct the quarternion, p, which represents the vector to be 
-		// rotated
-        // here the 0th component is equal to zero, and the remaining three 
-        // components are those of the earlier computed magnetic field
-        boost::math::quaternion<double> p(0, B[0], B[1], B[2]);
-
-        // the components of the axis of rotation (member variables of this 
-		// class) are used to construct a normalized vector.
-        boost::numeric::ublas::vector<double> axis(3, 0);
-        axis(0) = axis_x;
-        axis(1) = axis_y;
-        axis(2) = axis_z;
-
-        // the rotational axis vector is normalized
-        axis = (axis / boost::numeric::ublas::norm_2(axis));
-
-        // calculate quarternion, q, whih represents the rotation
-        boost::math::quaternion<double> q(cos(angle / 2), 
-                                          sin(angle / 2) * axis(0), 
-                                          sin(angle / 2) * axis(1), 
-                                          sin(angle / 2) * axis(2));
-
-        // get the conjugate of the quaternion, q'
-        boost::math::quaternion<double> q_prime = conj(q);
-
-        // perform multiplication to rotate
-        boost::math::quaternion<double> p_prime = q * p * q_prime;
-
-        // extract the resulting vector components, post-rotation
-        B[0] = p_prime.R_component_2();
-        B[1] = p_prime.R_component_3();
-        B[2] = p_prime.R_component_4();
-
-
-        // We create three quaternions, one for the gradient of each of the 
-        // gradient vectors
-
-        boost::math::quaternion<double> p_x(0, 
-                                            dBidxj[0][0],
-                                            dBidxj[0][1],
-                                            dBidxj[0][2]);
-
-        boost::math::quaternion<double> p_y(0, 
-                                            dBidxj[1][0], 
-                                            dBidxj[1][1], 
-                                            dBidxj[1][2]);
-
-        boost::math::quaternion<double> p_z(0, 
-                                            dBidxj[2][0], 
-                                            dBidxj[2][1], 
-                                            dBidxj[2][2]);
+	// collect monomials of field and its derivatives
+	std::map<std::array<int, 3>, std::array<double, 3> > B;
+	std::map<std::array<int, 3>, std::array<double, 9> > dB;
+	for (int i = 0; i < 3; ++i){
+		polynomial Bi = Derivative(Phi, i);
+		for (auto &t: Bi)
+			B[t.first][i] = t.second; // new map entries are zero-initialized
+		for (int j = 0; j < 3; ++j){
+			for (auto &t: Derivative(Bi, j))
+				dB[t.first][3*i + j] = t.second;
+		}
+	}
+	for (auto &t: B){
+		if (std::any_of(t.second.begin(), t.second.end(), [](const double c){ return c != 0; }))
+			Bterms.push_back(term<3>{t.first, t.second});
+	}
+	for (auto &t: dB){
+		if (std::any_of(t.second.begin(), t.second.end(), [](const double c){ return c != 0; }))
+			dBterms.push_back(term<9>{t.first, t.second});
+	}
+}
 
-        // we use the same quaternion, q, and conjugate q' for these rotations
-        boost::math::quaternion<double> p_x_prime = q * p_x * q_prime;
-        boost::math::quaternion<double> p_y_prime = q * p_y * q_prime;
-        boost::math::quaternion<double> p_z_prime = q * p_z * q_prime;
 
-        // extract the resulting vector components, post-rotation
-        // assign the components to the dBidxj matrix
-        dBidxj[0][0] = p_x_prime.R_component_2();
-        dBidxj[0][1] = p_x_prime.R_component_3();
-        dBidxj[0][2] = p_x_prime.R_component_4();
+void HarmonicExpandedBField::BField(const double _x, const double _y, const double _z, const double t, double B[3], double dBidxj[3][3]) const{
+	// Updating the x, y, z values with the given offset values
+	const double p[3] = {_x + xoff, _y + yoff, _z + zoff};
+	double powers[3][maxorder + 1];
+	for (int i = 0; i < 3; ++i){
+		powers[i][0] = 1;
+		for (int e = 1; e <= degree; ++e)
+			powers[i][e] = powers[i][e - 1]*p[i];
+	}
 
-        dBidxj[1][0] = p_y_prime.R_component_2();
-        dBidxj[1][1] = p_y_prime.R_component_3();
-        dBidxj[1][2] = p_y_prime.R_component_4();
+	B[0] = B[1] = B[2] = 0;
+	for (auto &term: Bterms){
+		double m = powers[0][term.exponents[0]]*powers[1][term.exponents[1]]*powers[2][term.exponents[2]];
+		for (int i = 0; i < 3; ++i)
+			B[i] += term.coeff[i]*m;
+	}
+	if (dBidxj != nullptr){
+		double dB[9] = {0, 0, 0, 0, 0, 0, 0, 0, 0};
+		for (auto &term: dBterms){
+			double m = powers[0][term.exponents[0]]*powers[1][term.exponents[1]]*powers[2][term.exponents[2]];
+			for (int i = 0; i < 9; ++i)
+				dB[i] += term.coeff[i]*m;
+		}
+		for (int i = 0; i < 3; ++i){
+			for (int j = 0; j < 3; ++j)
+				dBidxj[i][j] = dB[3*i + j];
+		}
+	}
+}
 
-        dBidxj[2][0] = p_z_prime.R_component_2();
-        dBidxj[2][1] = p_z_prime.R_component_3();
-        dBidxj[2][2] = p_z_prime.R_component_4();
 
-    }
+TFieldContainer ReadHarmonicExpandedBField(const std::string &params, std::ostream &out){
+	std::istringstream ss(params);
+	std::string type, Bscale;
+	double xoff, yoff, zoff, bW, xma, xmi, yma, ymi, zma, zmi, axis_x, axis_y, axis_z, angle;
+	if (!(ss >> type >> xoff >> yoff >> zoff >> bW >> xma >> xmi >> yma >> ymi >> zma >> zmi >> Bscale >> axis_x >> axis_y >> axis_z >> angle))
+		throw std::runtime_error("Could not read all required parameters for field HarmonicExpandedBField!");
+
+	// read coefficients from remaining parameters, or from a file if the only remaining parameter is not a number
+	std::vector<double> G;
+	auto readnumbers = [&G](std::istream &in, const std::string &source){
+		std::string token;
+		while (in >> token){
+			char *end;
+			G.push_back(std::strtod(token.c_str(), &end));
+			if (*end != '\0' || end == token.c_str())
+				throw std::runtime_error((boost::format("Invalid coefficient %1% in %2%!") % token % source).str());
+		}
+	};
+	std::string rest;
+	std::getline(ss, rest);
+	std::istringstream restss(rest);
+	std::string first;
+	restss >> first;
+	char *end;
+	std::strtod(first.c_str(), &end);
+	if (!first.empty() && (*end != '\0' || end == first.c_str()) && (restss >> std::ws).eof()){
+		boost::filesystem::path ft = boost::filesystem::absolute(first, configpath.parent_path());
+		std::ifstream f(ft.string());
+		if (!f.is_open())
+			throw std::runtime_error("Could not open " + first);
+		std::string line;
+		while (std::getline(f, line)){
+			std::istringstream ls(line);
+			if (!(ls >> std::ws).eof() && ls.peek() != '#')
+				readnumbers(ls, first);
+		}
+	}
+	else{
+		std::istringstream coeffs(rest);
+		readnumbers(coeffs, "HarmonicExpandedBField parameters");
+	}
+	if (G.empty())
+		throw std::runtime_error("No coefficients given for HarmonicExpandedBField!");
 
-	// }
+	std::unique_ptr<HarmonicExpandedBField> f(new HarmonicExpandedBField(xoff, yoff, zoff, axis_x, axis_y, axis_z, angle, G));
+	return TFieldContainer(std::move(f), Bscale, "0", xma, xmi, yma, ymi, zma, zmi, bW);
 }
-
@@ -34,16 +34,16 @@ void TLogger::Print(const std::unique_ptr<TParticle>& p, const value_type x, con
     value_type tstart = p->GetInitialTime();
     state_type ystart = p->GetInitialState();
     state_type spinstart = p->GetInitialSpin();
-    field.BField(ystart[0], ystart[1], ystart[2], tstart, Bstart);
-    field.EField(ystart[0], ystart[1], ystart[2], tstart, Vstart, Eistart);
+    p->GetMagneticField(tstart, ystart, field, Bstart);
+    p->GetElectricField(tstart, ystart, field, Vstart, Eistart);
 
     double H;
     solid sld = geom.GetSolid(x, &y[0]);
     H = E + p->GetPotentialEnergy(x, y, field, sld);
 
     double B[3], Ei[3], V;
-    field.BField(y[0], y[1], y[2], x, B);
-    field.EField(y[0], y[1], y[2], x, V, Ei);
+    p->GetMagneticField(x, y, field, B);
+    p->GetElectricField(x, y, field, V, Ei);
 
     double wL = 0;
     if (spin[3] > 0)
@@ -138,8 +138,8 @@ void TLogger::PrintTrack(const std::unique_ptr<TParticle>& p, const value_type x
     double dBidxj[3][3] = {{0,0,0},{0,0,0},{0,0,0}};
     double E[3] = {0,0,0};
     double V = 0;
-    field.BField(y[0],y[1],y[2],x,B, dBidxj);
-    field.EField(y[0],y[1],y[2],x,V,E);
+    p->GetMagneticField(x, y, field, B, dBidxj);
+    p->GetElectricField(x, y, field, V, E);
     value_type Ek = p->GetKineticEnergy(&y[3]);
     value_type H = Ek + p->GetPotentialEnergy(x, y, field, sld);
 
@@ -216,7 +216,7 @@ void TLogger::PrintHit(const std::unique_ptr<TParticle>& p, const value_type x,
     Log(p->GetName(), "hit", variables, default_titles);
 }
 
-void TLogger::PrintSpin(const std::unique_ptr<TParticle>& p, const value_type x, const dense_stepper_type& spinstepper,
+void TLogger::PrintSpin(const std::unique_ptr<TParticle>& p, const value_type x1, const value_type x, const state_type &spin,
                const dense_stepper_type &trajectory_stepper, const TFieldManager &field) {
     bool log = false;
     double interval = 0.;
@@ -225,7 +225,6 @@ void TLogger::PrintSpin(const std::unique_ptr<TParticle>& p, const value_type x,
     if (not log or interval <= 0)
         return;
 
-    double x1 = spinstepper.previous_time();
     if (x > x1 and int(x1 / interval) == int(x / interval)) // if time crossed an integer multiple of spinloginterval
         return;
 
@@ -236,11 +235,6 @@ void TLogger::PrintSpin(const std::unique_ptr<TParticle>& p, const value_type x,
     double Omega[3];
     p->SpinPrecessionAxis(x, trajectory_stepper, field, Omega[0], Omega[1], Omega[2]);
 
-    state_type spin(spinstepper.current_state());
-    if (x < spinstepper.current_time()){
-        spinstepper.calc_state(x, spin);
-    }
-
     map<string, double> variables = {{"jobnumber", static_cast<double>(jobnumber)},
                                      {"particle", static_cast<double>(p->GetParticleNumber())},
                                      {"t", x},
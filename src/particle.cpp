@@ -70,7 +70,7 @@ TParticle::TParticle(const char *aname, const  double qq, const long double mm,
 	spinstart.resize(SPIN_STATE_VARIABLES, 0);
 
 	double B[3];
-	afield.BField(x, y, z, t, B);
+	GetMagneticField(t, ystart, afield, B);
 	double Babs = sqrt(B[0]*B[0] + B[1]*B[1] + B[2]*B[2]);
 	if (Babs > 0){
 		std::uniform_real_distribution<double> phidist(0., 2.*pi);
@@ -97,9 +97,9 @@ TParticle::TParticle(const char *aname, const  double qq, const long double mm,
 void TParticle::derivs(const state_type &y, state_type &dydx, const value_type x, const TFieldManager *field) const{
 	double B[3], dBidxj[3][3], E[3], V; // magnetic/electric field and electric potential in lab frame
 	if (q != 0 || (mu != 0 && y[7] != 0)) // if particle has charge or magnetic moment, calculate magnetic field
-		field->BField(y[0],y[1],y[2], x, B, dBidxj);
+		GetMagneticField(x, y, *field, B, dBidxj);
  	if (q != 0) // if particle has charge caculate electric field
-		field->EField(y[0],y[1],y[2], x, V, E);
+		GetElectricField(x, y, *field, V, E);
 	EquationOfMotion(y, dydx, x, B, dBidxj, E);
 }
 
@@ -176,24 +176,6 @@ void TParticle::SpinPrecessionAxis(const double t, const double B[3], const doub
 }
 
 
-void TParticle::SpinDerivs(const state_type &y, state_type &dydx, const value_type x, const dense_stepper_type &stepper, const TFieldManager *field, const std::vector<alglib::spline1dinterpolant> &omega) const{
-	double omegax, omegay, omegaz;
-	if (omega.size() == 3){ // if interpolator exists, use it
-		omegax = alglib::spline1dcalc(omega[0], x);
-		omegay = alglib::spline1dcalc(omega[1], x);
-		omegaz = alglib::spline1dcalc(omega[2], x);
-	}
-	else
-		SpinPrecessionAxis(x, stepper, *field, omegax, omegay, omegaz); // else calculate precession axis directly
-
-	dydx[0] = omegay*y[2] - omegaz*y[1]; // dS/dt = W x S
-	dydx[1] = omegaz*y[0] - omegax*y[2];
-	dydx[2] = omegax*y[1] - omegay*y[0];
-	dydx[3] = 1.; // integrate time
-	dydx[4] = sqrt(omegax*omegax + omegay*omegay + omegaz*omegaz); // integrate precession phase
-}
-
-
 void TParticle::DoStep(const value_type x1, const state_type &y1, value_type &x2, state_type &y2, const dense_stepper_type &stepper,
                        const solid &currentsolid, TMCGenerator &mc, const TFieldManager &field){
     state_type y2temp = y2;
@@ -257,11 +239,11 @@ double TParticle::GetPotentialEnergy(const value_type t, const state_type &y, co
 	if (q != 0 || mu != 0){
 		double B[3], E[3], V;
 		if (mu != 0){
-			field.BField(y[0],y[1],y[2],t,B);
+			GetMagneticField(t, y, field, B);
 			result += -y[7]*mu/ele_e*sqrt(B[0]*B[0] + B[1]*B[1] + B[2]*B[2]);
 		}
 		if (q != 0){
-			field.EField(y[0],y[1],y[2],t,V,E);
+			GetElectricField(t, y, field, V, E);
 			result += q/ele_e*V;
 		}
 	}
@@ -0,0 +1,324 @@
+#include "primitives.h"
+
+#include <cmath>
+#include <algorithm>
+
+#include <boost/format.hpp>
+
+#include "globals.h"
+
+namespace{
+/**
+ * Sort intersections appended after index first by their distance from the segment start and
+ * remove duplicates, which occur if a segment hits an edge shared by two faces.
+ *
+ * @param segment Line segment
+ * @param hits List of intersections
+ * @param first Index of first intersection to sort
+ */
+void SortIntersections(const CSegment &segment, std::vector<std::pair<CPoint, CVector> > &hits, const size_t first){
+	auto dist = [&segment](const std::pair<CPoint, CVector> &h){ return CGAL::squared_distance(segment.start(), h.first); };
+	std::sort(hits.begin() + first, hits.end(), [&dist](const std::pair<CPoint, CVector> &h1, const std::pair<CPoint, CVector> &h2){
+		return dist(h1) < dist(h2);
+	});
+	hits.erase(std::unique(hits.begin() + first, hits.end(), [](const std::pair<CPoint, CVector> &h1, const std::pair<CPoint, CVector> &h2){
+		return CGAL::squared_distance(h1.first, h2.first) < REFLECT_TOLERANCE*REFLECT_TOLERANCE;
+	}), hits.end());
+}
+}
+
+
+TSpherePrimitive::TSpherePrimitive(const CPoint &acenter, const double aradius): center(acenter), radius(aradius){
+	if (radius <= 0)
+		throw std::runtime_error("Radius of sphere has to be larger than zero!");
+}
+
+void TSpherePrimitive::Intersections(const CSegment &segment, std::vector<std::pair<CPoint, CVector> > &hits) const{
+	CVector d = segment.to_vector();
+	CVector f = segment.start() - center;
+	double a = d*d;
+	double b = 2*(f*d);
+	double c = f*f - radius*radius;
+	double disc = b*b - 4*a*c;
+	if (a == 0 || disc <= 0) // no intersection or tangential contact
+		return;
+	double q = -0.5*(b + std::copysign(std::sqrt(disc), b)); // numerically stable roots of quadratic equation
+	size_t first = hits.size();
+	for (double s: {q/a, c/q}){
+		if (s >= 0 && s <= 1){
+			CPoint p = segment.start() + s*d;
+			hits.push_back(std::make_pair(p, (p - center)/radius));
+		}
+	}
+	SortIntersections(segment, hits, first);
+}
+
+bool TSpherePrimitive::Inside(const CPoint &p) const{
+	return CGAL::squared_distance(p, center) <= radius*radius;
+}
+
+CCuboid TSpherePrimitive::BoundingBox() const{
+	return CCuboid(center.x() - radius, center.y() - radius, center.z() - radius, center.x() + radius, center.y() + radius, center.z() + radius);
+}
+
+double TSpherePrimitive::Area() const{
+	return 4*pi*radius*radius;
+}
+
+void TSpherePrimitive::SurfacePoint(const double u1, const double u2, const double u3, CPoint &p, CVector &n) const{
+	double cost = 1 - 2*u2;
+	double sint = std::sqrt(1 - cost*cost);
+	double phi = 2*pi*u3;
+	n = CVector(sint*std::cos(phi), sint*std::sin(phi), cost);
+	p = center + radius*n;
+}
+
+
+TBoxPrimitive::TBoxPrimitive(const CCuboid &abox): box(abox){
+	if (box.is_degenerate())
+		throw std::runtime_error("Box has zero volume!");
+}
+
+void TBoxPrimitive::Intersections(const CSegment &segment, std::vector<std::pair<CPoint, CVector> > &hits) const{
+	CVector d = segment.to_vector();
+	size_t first = hits.size();
+	for (int k = 0; k < 3; ++k){
+		if (d[k] == 0)
+			continue;
+		for (int side = 0; side < 2; ++side){
+			double plane = side == 0 ? box.min_coord(k) : box.max_coord(k);
+			double s = (plane - segment.start()[k])/d[k];
+			if (s < 0 || s > 1)
+				continue;
+			double p[3] = {segment.start().x() + s*d.x(), segment.start().y() + s*d.y(), segment.start().z() + s*d.z()};
+			p[k] = plane;
+			if (p[(k + 1) % 3] >= box.min_coord((k + 1) % 3) && p[(k + 1) % 3] <= box.max_coord((k + 1) % 3) &&
+				p[(k + 2) % 3] >= box.min_coord((k + 2) % 3) && p[(k + 2) % 3] <= box.max_coord((k + 2) % 3)){
+				double n[3] = {0., 0., 0.};
+				n[k] = side == 0 ? -1. : 1.;
+				hits.push_back(std::make_pair(CPoint(p[0], p[1], p[2]), CVector(n[0], n[1], n[2])));
+			}
+		}
+	}
+	SortIntersections(segment, hits, first);
+}
+
+bool TBoxPrimitive::Inside(const CPoint &p) const{
+	return !box.has_on_unbounded_side(p);
+}
+
+CCuboid TBoxPrimitive::BoundingBox() const{
+	return box;
+}
+
+double TBoxPrimitive::Area() const{
+	double l[3] = {box.xmax() - box.xmin(), box.ymax() - box.ymin(), box.zmax() - box.zmin()};
+	return 2*(l[0]*l[1] + l[1]*l[2] + l[2]*l[0]);
+}
+
+void TBoxPrimitive::SurfacePoint(const double u1, const double u2, const double u3, CPoint &p, CVector &n) const{
+	double l[3] = {box.xmax() - box.xmin(), box.ymax() - box.ymin(), box.zmax() - box.zmin()};
+	double faceareas[3] = {l[1]*l[2], l[2]*l[0], l[0]*l[1]}; // area of faces perpendicular to x, y, z
+	double u = u1*(faceareas[0] + faceareas[1] + faceareas[2]);
+	int k = 0;
+	while (k < 2 && u >= faceareas[k]){
+		u -= faceareas[k];
+		++k;
+	}
+	int side = u < faceareas[k]/2 ? 0 : 1; // pick lower or upper face
+	double c[3];
+	c[k] = side == 0 ? box.min_coord(k) : box.max_coord(k);
+	c[(k + 1) % 3] = box.min_coord((k + 1) % 3) + u2*l[(k + 1) % 3];
+	c[(k + 2) % 3] = box.min_coord((k + 2) % 3) + u3*l[(k + 2) % 3];
+	double nv[3] = {0., 0., 0.};
+	nv[k] = side == 0 ? -1. : 1.;
+	p = CPoint(c[0], c[1], c[2]);
+	n = CVector(nv[0], nv[1], nv[2]);
+}
+
+
+TAxialPrimitive::TAxialPrimitive(const CPoint &p1, const CPoint &p2, const double r1, const double r2, const double ri1, const double ri2): start(p1){
+	axis = p2 - p1;
+	length = std::sqrt(axis.squared_length());
+	if (length == 0)
+		throw std::runtime_error("End caps of cylinder, tube or cone coincide!");
+	axis = axis/length;
+	router[0] = r1;
+	router[1] = r2;
+	rinner[0] = ri1;
+	rinner[1] = ri2;
+	for (int i = 0; i < 2; ++i){
+		if (rinner[i] < 0 || router[i] < rinner[i])
+			throw std::runtime_error("Radii of cylinder, tube or cone have to fulfill 0 <= inner radius <= outer radius!");
+	}
+	if (router[0] + router[1] == 0)
+		throw std::runtime_error("Cylinder, tube or cone has zero volume!");
+
+	e1 = std::abs(axis.x()) < 0.9 ? CGAL::cross_product(axis, CVector(1., 0., 0.)) : CGAL::cross_product(axis, CVector(0., 1., 0.));
+	e1 = e1/std::sqrt(e1.squared_length());
+	e2 = CGAL::cross_product(axis, e1);
+}
+
+void TAxialPrimitive::LateralIntersections(const CSegment &segment, const double r[2], const bool outward, std::vector<std::pair<CPoint, CVector> > &hits) const{
+	if (r[0] == 0 && r[1] == 0)
+		return;
+	double k = (r[1] - r[0])/length; // change of radius along axis
+	CVector d = segment.to_vector();
+	CVector v0 = segment.start() - start;
+	double h0 = v0*axis, dh = d*axis; // position along axis: h0 + s*dh
+	CVector w0 = v0 - h0*axis, dw = d - dh*axis; // distance vector from axis: w0 + s*dw
+	double R0 = r[0] + k*h0, dR = k*dh; // radius of surface at position: R0 + s*dR
+
+	// solve |w0 + s*dw|^2 = (R0 + s*dR)^2
+	double a = dw*dw - dR*dR;
+	double b = 2*(w0*dw - R0*dR);
+	double c = w0*w0 - R0*R0;
+	std::vector<double> roots;
+	if (std::abs(a) <= 1e-14*(dw*dw + dR*dR)){ // segment parallel to surface line
+		if (b != 0)
+			roots.push_back(-c/b);
+	}
+	else{
+		double disc = b*b - 4*a*c;
+		if (disc <= 0)
+			return;
+		double q = -0.5*(b + std::copysign(std::sqrt(disc), b));
+		roots.push_back(q/a);
+		if (q != 0)
+			roots.push_back(c/q);
+	}
+
+	for (double s: roots){
+		if (s < 0 || s > 1)
+			continue;
+		double h = h0 + s*dh;
+		if (h < 0 || h > length || r[0] + k*h < 0) // outside end caps or on mirrored cone
+			continue;
+		CVector w = w0 + s*dw;
+		double rho = std::sqrt(w.squared_length());
+		if (rho == 0) // cone apex
+			continue;
+		CVector n = w/rho - k*axis;
+		n = n/std::sqrt(n.squared_length());
+		hits.push_back(std::make_pair(segment.start() + s*d, outward ? n : -n));
+	}
+}
+
+void TAxialPrimitive::Intersections(const CSegment &segment, std::vector<std::pair<CPoint, CVector> > &hits) const{
+	size_t first = hits.size();
+	LateralIntersections(segment, router, true, hits);
+	LateralIntersections(segment, rinner, false, hits);
+
+	CVector d = segment.to_vector();
+	double h0 = (segment.start() - start)*axis, dh = d*axis;
+	if (dh != 0){
+		for (int i = 0; i < 2; ++i){ // end caps
+			double s = (i*length - h0)/dh;
+			if (s < 0 || s > 1)
+				continue;
+			CPoint p = segment.start() + s*d;
+			double rho2 = CGAL::squared_distance(p, start + i*length*axis);
+			if (rho2 <= router[i]*router[i] && rho2 >= rinner[i]*rinner[i])
+				hits.push_back(std::make_pair(p, i == 0 ? -axis : axis));
+		}
+	}
+	SortIntersections(segment, hits, first);
+}
+
+bool TAxialPrimitive::Inside(const CPoint &p) const{
+	CVector v = p - start;
+	double h = v*axis;
+	if (h < 0 || h > length)
+		return false;
+	double rho2 = (v - h*axis).squared_length();
+	double R = router[0] + (router[1] - router[0])*h/length;
+	double Ri = rinner[0] + (rinner[1] - rinner[0])*h/length;
+	return rho2 <= R*R && rho2 >= Ri*Ri;
+}
+
+CCuboid TAxialPrimitive::BoundingBox() const{
+	std::vector<CPoint> corners;
+	for (int i = 0; i < 2; ++i){ // bounding box of each end cap
+		CPoint c = start + i*length*axis;
+		CVector ext(router[i]*std::sqrt(std::max(0., 1 - axis.x()*axis.x())),
+					router[i]*std::sqrt(std::max(0., 1 - axis.y()*axis.y())),
+					router[i]*std::sqrt(std::max(0., 1 - axis.z()*axis.z())));
+		corners.push_back(c - ext);
+		corners.push_back(c + ext);
+	}
+	return CCuboid(CGAL::bbox_3(corners.begin(), corners.end()));
+}
+
+double TAxialPrimitive::LateralArea(const double r[2]) const{
+	return pi*(r[0] + r[1])*std::sqrt(length*length + (r[1] - r[0])*(r[1] - r[0]));
+}
+
+double TAxialPrimitive::CapArea(const int i) const{
+	return pi*(router[i]*router[i] - rinner[i]*rinner[i]);
+}
+
+double TAxialPrimitive::Area() const{
+	return LateralArea(router) + LateralArea(rinner) + CapArea(0) + CapArea(1);
+}
+
+void TAxialPrimitive::SurfacePoint(const double u1, const double u2, const double u3, CPoint &p, CVector &n) const{
+	double areas[4] = {LateralArea(router), LateralArea(rinner), CapArea(0), CapArea(1)};
+	double u = u1*(areas[0] + areas[1] + areas[2] + areas[3]);
+	int part = 0;
+	while (part < 3 && (u >= areas[part] || areas[part] == 0)){
+		u -= areas[part];
+		++part;
+	}
+	double phi = 2*pi*u3;
+	CVector radial = std::cos(phi)*e1 + std::sin(phi)*e2;
+	if (part < 2){ // lateral surface, sample position along axis proportional to circumference
+		const double *r = part == 0 ? router : rinner;
+		double k = (r[1] - r[0])/length;
+		double C = u2*(r[0]*length + k*length*length/2);
+		double denom = r[0] + std::sqrt(r[0]*r[0] + 2*k*C);
+		double h = denom > 0 ? 2*C/denom : 0.; // solve r0*h + k*h^2/2 = C
+		p = start + h*axis + (r[0] + k*h)*radial;
+		n = radial - k*axis;
+		n = n/std::sqrt(n.squared_length());
+		if (part == 1)
+			n = -n;
+	}
+	else{ // end cap, annulus between inner and outer radius
+		int i = part - 2;
+		double rho = std::sqrt(rinner[i]*rinner[i] + u2*(router[i]*router[i] - rinner[i]*rinner[i]));
+		p = start + i*length*axis + rho*radial;
+		n = i == 0 ? -axis : axis;
+	}
+}
+
+
+int PrimitiveParameterCount(const std::string &type){
+	if (type == "sphere")
+		return 4;
+	else if (type == "box")
+		return 6;
+	else if (type == "cylinder")
+		return 7;
+	else if (type == "tube" || type == "cone")
+		return 8;
+	return -1;
+}
+
+
+std::shared_ptr<TPrimitive> CreatePrimitive(const std::string &type, const std::vector<double> &p){
+	if (PrimitiveParameterCount(type) < 0)
+		throw std::runtime_error((boost::format("Unknown solid type %1%!") % type).str());
+	if (static_cast<int>(p.size()) != PrimitiveParameterCount(type))
+		throw std::runtime_error((boost::format("Solid type %1% needs %2% parameters, but %3% were given!") % type % PrimitiveParameterCount(type) % p.size()).str());
+
+	if (type == "sphere")
+		return std::make_shared<TSpherePrimitive>(CPoint(p[0], p[1], p[2]), p[3]);
+	else if (type == "box")
+		return std::make_shared<TBoxPrimitive>(CCuboid(p[0], p[2], p[4], p[1], p[3], p[5]));
+	else if (type == "cylinder")
+		return std::make_shared<TAxialPrimitive>(CPoint(p[0], p[1], p[2]), CPoint(p[3], p[4], p[5]), p[6], p[6]);
+	else if (type == "tube")
+		return std::make_shared<TAxialPrimitive>(CPoint(p[0], p[1], p[2]), CPoint(p[3], p[4], p[5]), p[7], p[7], p[6], p[6]);
+	else
+		return std::make_shared<TAxialPrimitive>(CPoint(p[0], p[1], p[2]), CPoint(p[3], p[4], p[5]), p[6], p[7]);
+}
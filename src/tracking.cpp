@@ -65,6 +65,7 @@ void TTracker::IntegrateParticle(std::unique_ptr<TParticle>& p, const double tma
 //	progress_display progress(100, cout, ' ' + to_string(particlenumber) + ' ');
 
     currentsolids = geom.GetSolids(x, &y[0]);
+    querycache = TMeshQueryCache(); // new particle starts somewhere else
     p->SetStopID(ID_UNKNOWN);
 
     while (p->GetStopID() == ID_UNKNOWN){ // integrate as long as nothing happened to particle
@@ -177,7 +178,7 @@ bool TTracker::CheckHit(const std::unique_ptr<TParticle>& p, const value_type x1
     multimap<TCollision, bool> colls;
     bool collfound = false;
     try{
-        collfound = geom.GetCollisions(x1, &y1[0], x2, &y2[0], colls);
+        collfound = geom.GetCollisions(x1, &y1[0], x2, &y2[0], colls, &currentsolids, &querycache);
     }
     catch(...){
         p->SetStopID(ID_CGAL_ERROR);
@@ -234,7 +235,7 @@ bool TTracker::iterate_collision(value_type &x1, state_type &y1, value_type &x2,
     state_type yc(STATE_VARIABLES);
     stepper.calc_state(xc, yc);
     multimap<TCollision, bool> colls;
-    if (geom.GetCollisions(x1, &y1[0], xc, &yc[0], colls)){ // if collision in first segment, further iterate
+    if (geom.GetCollisions(x1, &y1[0], xc, &yc[0], colls, &currentsolids, &querycache)){ // if collision in first segment, further iterate
 //    cout << "1 " << x1 << " " << xc1 - x1 << endl;
         if (iterate_collision(x1, y1, xc, yc, colls.begin()->first, stepper, geom, iteration + 1)){
             x2 = xc;
@@ -242,7 +243,7 @@ bool TTracker::iterate_collision(value_type &x1, state_type &y1, value_type &x2,
             return true; // if successfully iterated
         }
     }
-    if (geom.GetCollisions(xc, &yc[0], x2, &y2[0], colls)){ // if collision in second segment, further iterate
+    if (geom.GetCollisions(xc, &yc[0], x2, &y2[0], colls, &currentsolids, &querycache)){ // if collision in second segment, further iterate
 //    cout << "2 " << xc1 << " " << xc2 - xc1 << endl;
         if (iterate_collision(xc, yc, x2, y2, colls.begin()->first, stepper, geom, iteration + 1)){
             x1 = xc;
@@ -271,7 +272,7 @@ bool TTracker::DoHit(const std::unique_ptr<TParticle>& p, const value_type x1, c
     bool trajectoryaltered = false, traversed = true;
 
     multimap<TCollision, bool> colls;
-    if (!geom.GetCollisions(x1, &y1[0], x2, &y2[0], colls))
+    if (!geom.GetCollisions(x1, &y1[0], x2, &y2[0], colls, &currentsolids, &querycache))
         throw std::runtime_error("Called DoHit for a trajectory segment that does not contain a collision!");
 
     vector<pair<solid, bool> > newsolids = currentsolids;
@@ -290,7 +291,8 @@ bool TTracker::DoHit(const std::unique_ptr<TParticle>& p, const value_type x1, c
         }
         else if (coll.first.distnormal > 0){ // if leaving solid
             if (foundsld == newsolids.end()){ // if solid was not entered before something went wrong
-                if (coll.first.s > 0){ // if collision happened right at the start of the step it is likely that the hit solid was already removed from the list in the previous step and this is not an error
+                // unless the particle entered it while it was ignored: GetCollisions skips those solids, so the entry was never recorded
+                if (coll.first.s > 0 && sld.ignoretimes.empty()){ // if collision happened right at the start of the step it is likely that the hit solid was already removed from the list in the previous step and this is not an error
 //	  cout << x1 << " " << x2 - x1 << " " << coll.first.distnormal << " " << coll.first.s << " " << sld.name << endl;
 //          throw runtime_error((boost::format("Particle inside '%1%' which it did not enter before!") % sld.name).str());
                     cout << "Particle inside solid " << sld.name << " which it did not enter before. Stopping it!\n";
@@ -368,8 +370,8 @@ void TTracker::IntegrateSpin(const std::unique_ptr<TParticle>& p, state_type &sp
 
     state_type y1 = stepper.previous_state();
     double B1[3], B2[3], polarisation;
-    field.BField(y1[0], y1[1], y1[2], x1, B1);
-    field.BField(y2[0], y2[1], y2[2], x2, B2);
+    p->GetMagneticField(x1, y1, field, B1);
+    p->GetMagneticField(x2, y2, field, B2);
     double Babs1 = sqrt(B1[0]*B1[0] + B1[1]*B1[1] + B1[2]*B1[2]);
     double Babs2 = sqrt(B2[0]*B2[0] + B2[1]*B2[1] + B2[2]*B2[2]);
 
@@ -420,29 +422,60 @@ void TTracker::IntegrateSpin(const std::unique_ptr<TParticle>& p, state_type &sp
         }
 
 
-        dense_stepper_type spinstepper = boost::numeric::odeint::make_dense_output(1e-12, 1e-12, stepper_type());
-        spinstepper.initialize(spin, x1, std::abs(pi/p->GetGyromagneticRatio()/Babs1)); // initialize integrator with step size = half rotation
-        logger->PrintSpin(p, x1, spinstepper, stepper, field);
-        unsigned int steps = 0;
-        while (true){
+        auto precessionaxis = [&](const double t, double Omega[3]){
+            if (interpolatefields){
+                for (int i = 0; i < 3; ++i)
+                    Omega[i] = alglib::spline1dcalc(omega_int[i], t);
+            }
+            else
+                p->SpinPrecessionAxis(t, stepper, field, Omega[0], Omega[1], Omega[2]);
+        };
+
+        // fourth-order Magnus integrator with precession axis sampled at start, middle, and end of each step (Simpson's rule)
+        // each step rotates the spin by the exact rotation exp(theta x), so the spin length is preserved
+        // the step size is controlled by the difference of theta to the midpoint rule, which only grows with the change of the precession axis along the step
+        double t = x1, h = x2 - x1; // first try to rotate spin over whole trajectory step
+        double Omega1[3], Omegam[3], Omega2[3];
+        precessionaxis(t, Omega1);
+        logger->PrintSpin(p, x1, x1, spin, stepper, field);
+        while (t < x2){
             if (quit.load())
                 return;
 
-            // take an integration step, SpinDerivs contains right-hand side of equation of motion
-            spinstepper.do_step(std::bind(&TParticle::SpinDerivs, p.get(), std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, stepper, &field, omega_int));
-            steps++;
-            double t = spinstepper.current_time();
-            if (t > x2){ // if stepper overshot, calculate end point and stop
-                t = x2;
-                spinstepper.calc_state(t, spin);
+            bool last = h >= x2 - t;
+            if (last)
+                h = x2 - t;
+            precessionaxis(t + 0.5*h, Omegam);
+            precessionaxis(last ? x2 : t + h, Omega2);
+            double theta[3], err2 = 0;
+            double commutator[3] = {Omega2[1]*Omega1[2] - Omega2[2]*Omega1[1], Omega2[2]*Omega1[0] - Omega2[0]*Omega1[2], Omega2[0]*Omega1[1] - Omega2[1]*Omega1[0]};
+            for (int i = 0; i < 3; ++i){
+                theta[i] = h/6*(Omega1[i] + 4*Omegam[i] + Omega2[i]) + h*h/12*commutator[i];
+                err2 += (theta[i] - h*Omegam[i])*(theta[i] - h*Omegam[i]);
+            }
+            double err = sqrt(err2);
+            if (err > MAX_SPIN_ROTATION_ERROR){ // reject step and retry with smaller step size
+                h *= max(0.2, 0.9*cbrt(MAX_SPIN_ROTATION_ERROR/err));
+                continue;
             }
-            else
-                spin = spinstepper.current_state();
-
-            logger->PrintSpin(p, t, spinstepper, stepper, field);
 
-            if (t >= x2)
-                break;
+            double angle = sqrt(theta[0]*theta[0] + theta[1]*theta[1] + theta[2]*theta[2]);
+            if (angle > 0){ // rotate spin by angle around theta (Rodrigues' formula)
+                double u[3] = {theta[0]/angle, theta[1]/angle, theta[2]/angle}, c = cos(angle), s = sin(angle);
+                double udotS = u[0]*spin[0] + u[1]*spin[1] + u[2]*spin[2];
+                double uxS[3] = {u[1]*spin[2] - u[2]*spin[1], u[2]*spin[0] - u[0]*spin[2], u[0]*spin[1] - u[1]*spin[0]};
+                for (int i = 0; i < 3; ++i)
+                    spin[i] = spin[i]*c + uxS[i]*s + u[i]*udotS*(1 - c);
+            }
+            auto norm = [](const double v[3]){ return sqrt(v[0]*v[0] + v[1]*v[1] + v[2]*v[2]); };
+            spin[3] += h; // integration time
+            spin[4] += h/6*(norm(Omega1) + 4*norm(Omegam) + norm(Omega2)); // precession phase
+
+            double tprev = t;
+            t = last ? x2 : t + h;
+            copy(Omega2, Omega2 + 3, Omega1); // reuse precession axis at end of step as start of next step
+            logger->PrintSpin(p, tprev, t, spin, stepper, field);
+            h *= err > 0 ? min(5., 0.9*cbrt(MAX_SPIN_ROTATION_ERROR/err)) : 5.;
         }
 
         // calculate new spin projection
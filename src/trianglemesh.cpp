@@ -1,170 +1,683 @@
-#include "trianglemesh.h"
-
-#include <fstream>
-#include <random>
-#include <boost/format.hpp>
-#include <CGAL/Polygon_mesh_processing/polygon_soup_to_polygon_mesh.h>
-#include <CGAL/Polygon_mesh_processing/repair_polygon_soup.h>
-#include <CGAL/Polygon_mesh_processing/self_intersections.h>
-#include <CGAL/Polygon_mesh_processing/corefinement.h>
-#include <CGAL/Polygon_mesh_processing/measure.h>
-#include <CGAL/Polygon_mesh_processing/connected_components.h>
-#include <CGAL/boost/graph/Face_filtered_graph.h>
-#include <CGAL/Polygon_mesh_processing/repair.h>
-
-
-// read triangles from STL-file
-std::string TTriangleMesh::ReadFile(const std::string &filename, const int ID){
-	std::ifstream f(filename, std::fstream::binary);
-	if (!f.is_open())
-		throw std::runtime_error( (boost::format("Could not open %1%") % filename).str() );
-
-	char header[80];
-	f.read(header, 80); // read 80-byte header
-	std::string sldname(std::move(header), 80);
-	sldname.erase(sldname.find_last_not_of(" ") + 1); // strip trailing whitespace from header
-
-	unsigned int filefacecount;
-	f.read((char*)&filefacecount,4);
-	if (filefacecount == 0)
-		throw std::runtime_error( (boost::format("%1% contains no triangles") % filename).str() );
-	std::cout << "Reading '" << filename << "' containing " << filefacecount << " triangles ... ";    // print header
-
-	std::vector<CPoint> vertices;
-	std::vector<std::vector<size_t> > faces;
-	while (f){
-		f.seekg(3*4,std::fstream::cur);  // skip normal in STL-file (will be calculated from vertices)
-        std::vector<size_t> vidx;
-		for (short j = 0; j < 3; j++){
-		    float v[3];
-		    f.read((char*)v,12);
-			if (f) {
-                CPoint p(std::abs(v[0]) < REFLECT_TOLERANCE ? 0. : v[0], std::abs(v[1]) < REFLECT_TOLERANCE ? 0. : v[1], std::abs(v[2]) < REFLECT_TOLERANCE ? 0. : v[2]);
-                auto vertex = vertices.end(); //std::find_if(vertices.begin(), vertices.end(), [&p](const CPoint &p2) { return CGAL::squared_distance(p, p2) < std::pow(REFLECT_TOLERANCE, 2); });
-                vidx.push_back(std::distance(vertices.begin(), vertex));
-                if (vertex == vertices.end())
-                    vertices.push_back(p);
-            }
-		}
-		if (f) {
-            faces.push_back(vidx);
-            f.seekg(2, std::fstream::cur);    // 2 attribute bytes, not used in the STL standard (http://www.ennex.com/~fabbers/StL.asp)
-        }
-	}
-	f.close();
-
-	if (faces.size() != filefacecount)
-		throw std::runtime_error( (boost::format("%1% should contain %2% triangles but read %3%") % filename % filefacecount % faces.size()).str() );
-
-    namespace PMP = CGAL::Polygon_mesh_processing;
-    typedef boost::graph_traits<CMesh>::face_descriptor fd;
-    auto cerr_precision = std::cerr.precision(3);
-    auto cout_precision = std::cout.precision(3);
-    PMP::repair_polygon_soup(vertices, faces/*, CGAL::parameters::require_same_orientation(true)*/);
-    PMP::orient_polygon_soup(vertices, faces);
-    std::unique_ptr<CMesh> mesh(new CMesh());
-
-    if (not PMP::is_polygon_soup_a_polygon_mesh(faces))
-        //throw(std::runtime_error("Triangles do not form a mesh"));
-        std::cerr << "Triangles do not form a mesh\n";
-    PMP::polygon_soup_to_polygon_mesh(vertices, faces, *mesh);
-//    CGAL::Polygon_mesh_processing::duplicate_non_manifold_vertices(*mesh);
-    double A = PMP::area(*mesh)*1e4;
-    double V = PMP::volume(*mesh)*1e6;
-
-    auto fccmap = mesh->add_property_map<fd, boost::graph_traits<CMesh>::faces_size_type>("f:CC").first;
-    auto num = PMP::connected_components(*mesh, fccmap);
-    std::cout << "built mesh with " << mesh->number_of_faces() << " triangles and " << num << " components (" << A << "cm2, " << V << "cm3)\n";
-    int affected_components = 0;
-    double border_length = 0.;
-    double self_intersecting_area = 0.;
-    for (size_t i = 0; i < num; ++i) {
-        CGAL::Face_filtered_graph<CMesh> ffg(*mesh, i, fccmap);
-        bool not_closed = not CGAL::is_closed(ffg);
-        bool not_bounding = not PMP::does_bound_a_volume(ffg);
-        bool self_intersecting = PMP::does_self_intersect(ffg);
-        if (not_closed){
-            std::vector<boost::graph_traits<CMesh>::halfedge_descriptor> border_edges;
-            PMP::border_halfedges(ffg, std::back_inserter(border_edges));
-            for (auto edge: border_edges)
-                border_length += PMP::edge_length(edge, *mesh);
-        }
-        if (self_intersecting){
-            std::vector<std::pair<fd, fd> > self_intersecting_face_pairs;
-            PMP::self_intersections(ffg, std::back_inserter(self_intersecting_face_pairs));
-            std::set<fd> self_intersecting_faces;
-            for (auto face_pair: self_intersecting_face_pairs) {
-                self_intersecting_faces.insert(face_pair.first);
-                self_intersecting_faces.insert(face_pair.second);
-            }
-            for (auto face: self_intersecting_faces)
-                self_intersecting_area += PMP::face_area(face, *mesh);
-        }
-        if (not_closed or not_bounding or self_intersecting) {
-            ++affected_components;
-        }
-    }
-    if (affected_components > 0) {
-        std::cerr << "\nWarning: " << affected_components << " of " << num << " components have holes with total circumference "
-                  << border_length * 1e2 << "cm and " << self_intersecting_area * 1e4
-                  << "cm2 of their area is self-intersecting!\n\n";
-    }
-    std::cerr.precision(cout_precision);
-    std::cerr.precision(cerr_precision);
-
-    std::vector<double> areas;
-    std::transform(mesh->faces_begin(), mesh->faces_end(), std::back_inserter(areas), [&mesh](const CMesh::Face_index &fi){ return CGAL::Polygon_mesh_processing::face_area(fi, *mesh); });
-    std::discrete_distribution<size_t> triangle_sampler(areas.begin(), areas.end());
-
-    std::unique_ptr<CTree> tree(new CTree(mesh->faces_begin(), mesh->faces_end(), *mesh));
-    tree->accelerate_distance_queries();
-
-    std::vector<double> total_areas;
-    std::transform(meshes.begin(), meshes.end(), std::back_inserter(total_areas), [](const CTriangleMesh &m){ return CGAL::Polygon_mesh_processing::area(*m.mesh); });
-    mesh_sampler = std::discrete_distribution<size_t>(total_areas.begin(), total_areas.end());
-
-    meshes.push_back({std::move(mesh), std::move(tree), ID, triangle_sampler});
-
-	return sldname;
-}
-
-
-// test segment p1->p2 for collision with triangles and return a list of all found collisions
-std::vector<TCollision> TTriangleMesh::Collision(const std::vector<double> &p1, const std::vector<double> &p2) const{
-	CSegment segment(CPoint(p1[0], p1[1], p1[2]), CPoint(p2[0], p2[1], p2[2]));
-	std::vector<TCollision> colls;
-	for (auto &it: meshes) {
-        std::vector<CIntersection> out;
-        it.tree->all_intersections(segment, std::back_inserter(out)); // search intersections of segment with mesh
-        for (auto &i: out){
-            const CPoint *collp = boost::get<CPoint>(&(i->first));
-            if (collp) { // if intersection is a point
-                CVector n = CGAL::Polygon_mesh_processing::compute_face_normal(i->second, *it.mesh);
-                colls.push_back(TCollision(segment, n, *collp, it.ID)); // add collision to list
-            }
-            else
-                throw std::runtime_error("Segment-triangle intersection happened to not be a point");
-        }
-    }
-
-	std::sort(	colls.begin(),
-				colls.end(),
-				[](const TCollision &c1, const TCollision &c2){
-					if (c1.s == c2.s){
-                        //std::cout << "Coincident collision between solids " << c1.ID << " and " << c2.ID << std::endl;
-						return c1.ID > c2.ID;
-					}
-					else
-						return c1.s < c2.s;
-				}
-	);
-	return colls;
-
-}
-
-
-bool TTriangleMesh::InSolid(const double x, const double y, const double z) const{
-    return std::any_of(meshes.begin(), meshes.end(), [x,y,z](const CTriangleMesh &mesh){
-        return mesh.tree->number_of_intersected_primitives(CKernel::Ray_3(CPoint(x,y,z), CVector(0.,0.,1.))) % 2 != 0;
-    });
-}
+#include "trianglemesh.h"
+#include "globals.h"
+#include "primitives.h"
+
+#include <fstream>
+#include <sstream>
+#include <random>
+#include <chrono>
+#include <array>
+#include <unordered_map>
+#include <cmath>
+#include <iterator>
+#include <numeric>
+
+#include <boost/filesystem.hpp>
+#include <boost/format.hpp>
+#include <CGAL/Polygon_mesh_processing/polygon_soup_to_polygon_mesh.h>
+#include <CGAL/Polygon_mesh_processing/repair_polygon_soup.h>
+#include <CGAL/Polygon_mesh_processing/self_intersections.h>
+#include <CGAL/Polygon_mesh_processing/corefinement.h>
+#include <CGAL/Polygon_mesh_processing/measure.h>
+#include <CGAL/Polygon_mesh_processing/connected_components.h>
+#include <CGAL/boost/graph/Face_filtered_graph.h>
+#include <CGAL/Polygon_mesh_processing/repair.h>
+#include <CGAL/Exact_predicates_inexact_constructions_kernel.h>
+#include <CGAL/Constrained_Delaunay_triangulation_2.h>
+#include <CGAL/Triangulation_vertex_base_with_info_2.h>
+#include <CGAL/Triangulation_face_base_with_info_2.h>
+
+
+namespace{
+/**
+ * Merges vertices closer than REFLECT_TOLERANCE using a spatial hash with cells of size REFLECT_TOLERANCE.
+ *
+ * Matching vertices can only lie in the same or a neighboring cell, so each lookup checks 27 cells instead of all vertices.
+ */
+class TVertexWelder{
+private:
+	typedef std::array<long long, 3> TCell; ///< Integer cell coordinates
+	/// Hash function for cell coordinates
+	struct TCellHash{
+		size_t operator()(const TCell &c) const{
+			return std::hash<long long>()(c[0]*73856093LL ^ c[1]*19349663LL ^ c[2]*83492791LL);
+		}
+	};
+	std::vector<CPoint> &vertices; ///< Vertex list, new vertices are appended
+	std::unordered_map<TCell, std::vector<size_t>, TCellHash> cells; ///< Indices of vertices in each cell
+
+	/// Return cell containing point p
+	static TCell GetCell(const CPoint &p){
+		return {static_cast<long long>(std::floor(p.x()/REFLECT_TOLERANCE)),
+				static_cast<long long>(std::floor(p.y()/REFLECT_TOLERANCE)),
+				static_cast<long long>(std::floor(p.z()/REFLECT_TOLERANCE))};
+	}
+public:
+	/**
+	 * Constructor
+	 *
+	 * @param v Vertex list, should be empty
+	 */
+	TVertexWelder(std::vector<CPoint> &v): vertices(v){ }
+
+	/**
+	 * Find vertex closer than REFLECT_TOLERANCE to p or append p to the vertex list.
+	 *
+	 * If several vertices are close enough, the one added first is returned.
+	 *
+	 * @param p Vertex
+	 *
+	 * @return Returns index of matching vertex in vertex list
+	 */
+	size_t AddVertex(const CPoint &p){
+		TCell c = GetCell(p);
+		size_t match = vertices.size();
+		for (long long i = -1; i <= 1; ++i){
+			for (long long j = -1; j <= 1; ++j){
+				for (long long k = -1; k <= 1; ++k){
+					auto cell = cells.find({c[0] + i, c[1] + j, c[2] + k});
+					if (cell == cells.end())
+						continue;
+					for (size_t idx: cell->second){
+						if (idx < match && CGAL::squared_distance(p, vertices[idx]) < REFLECT_TOLERANCE*REFLECT_TOLERANCE)
+							match = idx;
+					}
+				}
+			}
+		}
+		if (match == vertices.size()){
+			vertices.push_back(p);
+			cells[c].push_back(match);
+		}
+		return match;
+	}
+};
+
+/**
+ * Constrained Delaunay triangulation used to retriangulate planar regions, vertices store the index of the original vertex,
+ * faces store their nesting level (odd levels lie inside the region)
+ */
+typedef CGAL::Exact_predicates_inexact_constructions_kernel CKernel2;
+typedef CGAL::Triangulation_vertex_base_with_info_2<size_t, CKernel2> CVertexBase2;
+typedef CGAL::Triangulation_face_base_with_info_2<int, CKernel2, CGAL::Constrained_triangulation_face_base_2<CKernel2> > CFaceBase2;
+typedef CGAL::Constrained_Delaunay_triangulation_2<CKernel2, CGAL::Triangulation_data_structure_2<CVertexBase2, CFaceBase2> > CCDT;
+
+
+/**
+ * Set nesting level of all faces of a constrained triangulation, counting the constrained edges crossed on the way from the infinite face
+ *
+ * @param cdt Constrained triangulation
+ */
+void MarkNestingLevels(CCDT &cdt){
+	for (auto f = cdt.all_faces_begin(); f != cdt.all_faces_end(); ++f)
+		f->info() = -1;
+	std::vector<std::pair<CCDT::Face_handle, int> > queue = {std::make_pair(cdt.infinite_face(), 0)};
+	std::vector<CCDT::Face_handle> border; // faces behind constrained edges, visited after all faces with lower level
+	while (!queue.empty()){
+		while (!queue.empty()){
+			CCDT::Face_handle f = queue.back().first;
+			int level = queue.back().second;
+			queue.pop_back();
+			if (f->info() != -1)
+				continue;
+			f->info() = level;
+			for (int i = 0; i < 3; ++i){
+				CCDT::Face_handle n = f->neighbor(i);
+				if (n->info() != -1)
+					continue;
+				if (cdt.is_constrained(CCDT::Edge(f, i)))
+					border.push_back(n);
+				else
+					queue.push_back(std::make_pair(n, level));
+			}
+		}
+		for (auto f: border){
+			if (f->info() == -1){
+				// all neighbors across constrained edges have the same level, since nesting levels of the region's boundary loops alternate
+				for (int i = 0; i < 3; ++i){
+					if (f->neighbor(i)->info() != -1 && cdt.is_constrained(CCDT::Edge(f, i))){
+						queue.push_back(std::make_pair(f, f->neighbor(i)->info() + 1));
+						break;
+					}
+				}
+			}
+		}
+		border.clear();
+	}
+}
+
+
+/**
+ * Replace the triangles of a planar region by a constrained Delaunay triangulation of its boundary.
+ *
+ * This uses the fewest possible triangles without adding vertices and maximizes their minimum angle.
+ * Interior vertices of the region are dropped, boundary vertices are kept, so neighboring regions still fit seamlessly.
+ * The new triangles are validated against the boundary and the area of the region.
+ *
+ * @param vertices Vertex list
+ * @param faces Triangle list
+ * @param region Indices of triangles in the region
+ * @param normal Unit normal of the region's plane
+ * @param newfaces New triangles are appended to this list if the retriangulation succeeds and reduces the number of triangles
+ *
+ * @return Returns false if the region could not be retriangulated (e.g. because its boundary is not a set of simple loops)
+ */
+bool RetriangulateRegion(const std::vector<CPoint> &vertices, const std::vector<std::vector<size_t> > &faces, const std::vector<size_t> &region,
+						const CVector &normal, std::vector<std::vector<size_t> > &newfaces){
+	const unsigned long long nv = vertices.size();
+	std::unordered_map<unsigned long long, int> edges; // directed edges of the region, keyed by from*nv + to
+	double area = 0;
+	for (size_t f: region){
+		for (int j = 0; j < 3; ++j){
+			if (++edges[faces[f][j]*nv + faces[f][(j + 1) % 3]] > 1)
+				return false; // region is not oriented consistently
+		}
+		area += std::sqrt(CGAL::squared_area(vertices[faces[f][0]], vertices[faces[f][1]], vertices[faces[f][2]]));
+	}
+	std::unordered_map<size_t, size_t> boundary; // directed boundary edges, from -> to
+	for (auto &e: edges){
+		size_t from = e.first / nv, to = e.first % nv;
+		if (edges.count(to*nv + from) == 0 && !boundary.emplace(from, to).second)
+			return false; // boundary loops touch each other
+	}
+
+	// project boundary onto plane, (u, v, normal) is a right-handed basis so counter-clockwise triangles have the region's orientation
+	int axis = std::abs(normal.x()) < std::abs(normal.y()) ? (std::abs(normal.x()) < std::abs(normal.z()) ? 0 : 2) : (std::abs(normal.y()) < std::abs(normal.z()) ? 1 : 2);
+	CVector u = CGAL::cross_product(normal, CVector(axis == 0 ? 1. : 0., axis == 1 ? 1. : 0., axis == 2 ? 1. : 0.));
+	u = u/std::sqrt(u.squared_length());
+	CVector v = CGAL::cross_product(normal, u);
+	CCDT cdt;
+	std::unordered_map<size_t, CCDT::Vertex_handle> handles;
+	for (auto &e: boundary){
+		CVector p = vertices[e.first] - CGAL::ORIGIN;
+		CCDT::Vertex_handle h = cdt.insert(CCDT::Point(p*u, p*v));
+		if (cdt.number_of_vertices() != handles.size() + 1)
+			return false; // two boundary vertices project onto the same point
+		h->info() = e.first;
+		handles[e.first] = h;
+	}
+	try{
+		for (auto &e: boundary)
+			cdt.insert_constraint(handles[e.first], handles[e.second]);
+	}
+	catch (CCDT::Intersection_of_constraints_exception &){
+		return false; // boundary intersects itself in projection
+	}
+	if (cdt.number_of_vertices() != handles.size())
+		return false;
+	MarkNestingLevels(cdt);
+
+	std::vector<std::vector<size_t> > triangles;
+	double newarea = 0;
+	for (auto f = cdt.finite_faces_begin(); f != cdt.finite_faces_end(); ++f){
+		if (f->info() % 2 == 1){
+			triangles.push_back({f->vertex(0)->info(), f->vertex(1)->info(), f->vertex(2)->info()});
+			newarea += std::sqrt(CGAL::squared_area(vertices[triangles.back()[0]], vertices[triangles.back()[1]], vertices[triangles.back()[2]]));
+			for (int j = 0; j < 3; ++j){
+				size_t from = triangles.back()[j], to = triangles.back()[(j + 1) % 3];
+				auto b = boundary.find(to);
+				if (b != boundary.end() && b->second == from)
+					return false; // triangle lies outside of region
+			}
+		}
+	}
+	size_t boundaryedges = 0;
+	for (auto &t: triangles){
+		for (int j = 0; j < 3; ++j){
+			auto b = boundary.find(t[j]);
+			if (b != boundary.end() && b->second == t[(j + 1) % 3])
+				++boundaryedges;
+		}
+	}
+	if (boundaryedges != boundary.size() || std::abs(newarea - area) > 1e-6*area || triangles.size() >= region.size())
+		return false; // new triangles do not cover the region exactly or do not reduce the number of triangles
+	newfaces.insert(newfaces.end(), triangles.begin(), triangles.end());
+	return true;
+}
+
+
+/**
+ * Merge adjacent coplanar triangles of a consistently oriented triangle soup and retriangulate each planar region with RetriangulateRegion.
+ *
+ * Starting with the largest triangles, regions grow across edges shared by exactly two triangles
+ * as long as all vertices of the neighboring triangle lie within REFLECT_TOLERANCE of the first triangle's plane.
+ * Regions that cannot be retriangulated keep their original triangles.
+ *
+ * @param vertices Vertex list
+ * @param faces Triangle list, is replaced by the merged list
+ */
+void MergeCoplanarFaces(const std::vector<CPoint> &vertices, std::vector<std::vector<size_t> > &faces){
+	const unsigned long long nv = vertices.size();
+	std::unordered_map<unsigned long long, std::vector<size_t> > edgefaces; // faces adjacent to each undirected edge, keyed by min*nv + max
+	std::vector<CVector> normals;
+	std::vector<double> areas;
+	for (size_t f = 0; f < faces.size(); ++f){
+		if (faces[f].size() != 3){
+			normals.push_back(CGAL::NULL_VECTOR);
+			areas.push_back(0);
+			continue;
+		}
+		for (int j = 0; j < 3; ++j)
+			edgefaces[std::min(faces[f][j], faces[f][(j + 1) % 3])*nv + std::max(faces[f][j], faces[f][(j + 1) % 3])].push_back(f);
+		CVector n = CGAL::cross_product(vertices[faces[f][1]] - vertices[faces[f][0]], vertices[faces[f][2]] - vertices[faces[f][0]]);
+		double l = std::sqrt(n.squared_length());
+		normals.push_back(l > 0 ? n/l : CGAL::NULL_VECTOR);
+		areas.push_back(l/2);
+	}
+	std::vector<size_t> order(faces.size());
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(), [&areas](const size_t f1, const size_t f2){ return areas[f1] > areas[f2]; }); // largest triangles define the most accurate planes
+
+	std::vector<bool> assigned(faces.size(), false);
+	std::vector<std::vector<size_t> > newfaces;
+	for (size_t seed: order){
+		if (assigned[seed])
+			continue;
+		assigned[seed] = true;
+		std::vector<size_t> region = {seed};
+		const CVector &n = normals[seed];
+		double d = n*(vertices[faces[seed][0]] - CGAL::ORIGIN);
+		for (size_t i = 0; i < region.size() && areas[seed] > 0; ++i){
+			const std::vector<size_t> &f = faces[region[i]];
+			for (int j = 0; j < 3; ++j){
+				const std::vector<size_t> &adjacent = edgefaces[std::min(f[j], f[(j + 1) % 3])*nv + std::max(f[j], f[(j + 1) % 3])];
+				if (adjacent.size() != 2)
+					continue;
+				size_t other = adjacent[0] == region[i] ? adjacent[1] : adjacent[0];
+				if (assigned[other] || normals[other]*n <= 0)
+					continue;
+				if (std::all_of(faces[other].begin(), faces[other].end(), [&](const size_t vi){ return std::abs(n*(vertices[vi] - CGAL::ORIGIN) - d) < REFLECT_TOLERANCE; })){
+					assigned[other] = true;
+					region.push_back(other);
+				}
+			}
+		}
+		if (region.size() < 3 || !RetriangulateRegion(vertices, faces, region, n, newfaces)){
+			for (size_t f: region)
+				newfaces.push_back(faces[f]);
+		}
+	}
+	faces.swap(newfaces);
+}
+}
+
+// read triangles from STL-file
+std::string TTriangleMesh::ReadFile(const std::string &filename, const int ID, const bool mergecoplanar){
+	return ReadFiles({std::make_pair(filename, ID)}, mergecoplanar)[0];
+}
+
+
+// read several STL-files in parallel, print their logs in order
+std::vector<std::string> TTriangleMesh::ReadFiles(const std::vector<std::pair<std::string, int> > &files, const bool mergecoplanar){
+	auto start = std::chrono::steady_clock::now();
+
+	// find files with identical canonical path or content, only the first of those has to be loaded
+	std::vector<size_t> original(files.size());
+	std::vector<std::string> paths, contents;
+	for (size_t i = 0; i < files.size(); ++i){
+		boost::system::error_code ec;
+		boost::filesystem::path path = boost::filesystem::canonical(files[i].first, ec);
+		paths.push_back(ec ? files[i].first : path.native());
+		std::ifstream f(files[i].first, std::fstream::binary);
+		contents.push_back(std::string(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>()));
+		original[i] = i;
+		for (size_t j = 0; j < i; ++j){
+			if (original[j] == j && f.is_open() && (paths[i] == paths[j] || contents[i] == contents[j])){
+				original[i] = j;
+				break;
+			}
+		}
+	}
+	contents.clear();
+
+	std::vector<size_t> toload;
+	for (size_t i = 0; i < files.size(); ++i){
+		if (original[i] == i)
+			toload.push_back(i);
+	}
+
+	std::vector<CTriangleMesh> loaded(files.size());
+	std::vector<std::string> names(files.size());
+	std::vector<std::ostringstream> outs(files.size()), errs(files.size());
+	std::vector<double> loadtimes(files.size());
+	parallel_for(toload.size(), [&](const size_t n){
+		size_t i = toload[n];
+		auto filestart = std::chrono::steady_clock::now();
+		loaded[i] = LoadFile(files[i].first, files[i].second, mergecoplanar, names[i], outs[i], errs[i]);
+		loadtimes[i] = std::chrono::duration<double>(std::chrono::steady_clock::now() - filestart).count();
+	});
+	double totaltime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	for (size_t i = 0; i < files.size(); ++i){
+		if (original[i] == i){
+			std::cout << outs[i].str();
+			std::cerr << errs[i].str();
+			std::cout << "Loaded '" << files[i].first << "' in " << boost::format("%.2f") % loadtimes[i] << "s\n";
+			meshes.push_back(std::move(loaded[i]));
+		}
+		else{
+			std::cout << "'" << files[i].first << "' is identical to '" << files[original[i]].first << "', sharing its mesh\n";
+			CTriangleMesh m = meshes[meshes.size() - i + original[i]]; // copy shared pointers to mesh and tree
+			m.ID = files[i].second;
+			names[i] = names[original[i]];
+			meshes.push_back(m);
+		}
+	}
+	if (files.size() > 1)
+		std::cout << "Loaded " << files.size() << " STL files in " << boost::format("%.2f") % totaltime << "s\n";
+
+	UpdateMeshSampler();
+	return names;
+}
+
+
+void TTriangleMesh::AddPrimitive(const std::shared_ptr<const TPrimitive> &primitive, const int ID){
+	meshes.push_back({nullptr, nullptr, primitive, ID, std::discrete_distribution<size_t>(), false, CTransform(CGAL::IDENTITY), CTransform(CGAL::IDENTITY)});
+	UpdateMeshSampler();
+}
+
+
+std::string TTriangleMesh::ReadSolid(const std::string &description, const int ID, const boost::filesystem::path &basepath){
+	std::istringstream str(description);
+	std::string type;
+	str >> type;
+	int nparams = PrimitiveParameterCount(type);
+	if (nparams < 0){
+		boost::filesystem::path filename(type);
+		return ReadFile(boost::filesystem::absolute(filename, basepath).native(), ID);
+	}
+	std::vector<double> params(nparams);
+	for (double &p: params)
+		str >> p;
+	if (!str)
+		throw std::runtime_error((boost::format("Could not read parameters of %1%!") % description).str());
+	AddPrimitive(CreatePrimitive(type, params), ID);
+	std::cout << "Created " << type;
+	for (double p: params)
+		std::cout << " " << p;
+	std::cout << "\n";
+	return type;
+}
+
+
+void TTriangleMesh::UpdateMeshSampler(){
+	std::vector<double> total_areas;
+	std::transform(meshes.begin(), meshes.end(), std::back_inserter(total_areas), &MeshArea);
+	mesh_sampler = std::discrete_distribution<size_t>(total_areas.begin(), total_areas.end());
+}
+
+
+CCuboid TTriangleMesh::MeshBoundingBox(const CTriangleMesh &m){
+	CCuboid b = m.primitive ? m.primitive->BoundingBox() : CCuboid(m.tree->bbox());
+	if (not m.transformed)
+		return b;
+	std::vector<CPoint> corners;
+	for (int i = 0; i < 8; ++i)
+		corners.push_back(m.transform(b.vertex(i)));
+	return CCuboid(CGAL::bbox_3(corners.begin(), corners.end()));
+}
+
+
+bool TTriangleMesh::InMesh(const CTriangleMesh &m, const CPoint &p){
+	CPoint pl = m.transformed ? m.inverse(p) : p;
+	if (m.primitive)
+		return m.primitive->Inside(pl);
+	return m.tree->number_of_intersected_primitives(CKernel::Ray_3(pl, CVector(0., 0., 1.))) % 2 != 0;
+}
+
+
+double TTriangleMesh::MeshArea(const CTriangleMesh &m){
+	return m.primitive ? m.primitive->Area() : CGAL::Polygon_mesh_processing::area(*m.mesh);
+}
+
+
+void TTriangleMesh::PrimitiveSurfacePoint(const CTriangleMesh &m, const double u1, const double u2, const double u3, CPoint &p, CVector &n){
+	m.primitive->SurfacePoint(u1, u2, u3, p, n);
+	if (m.transformed){
+		p = m.transform(p);
+		n = m.transform(n);
+	}
+}
+
+
+// read triangles from STL-file, repair and check mesh, and build AABB tree
+TTriangleMesh::CTriangleMesh TTriangleMesh::LoadFile(const std::string &filename, const int ID, const bool mergecoplanar, std::string &sldname, std::ostream &out, std::ostream &err){
+	std::ifstream f(filename, std::fstream::binary);
+	if (!f.is_open())
+		throw std::runtime_error( (boost::format("Could not open %1%") % filename).str() );
+
+	char header[80];
+	f.read(header, 80); // read 80-byte header
+	sldname = std::string(std::move(header), 80);
+	sldname.erase(sldname.find_last_not_of(" ") + 1); // strip trailing whitespace from header
+
+	unsigned int filefacecount;
+	f.read((char*)&filefacecount,4);
+	if (filefacecount == 0)
+		throw std::runtime_error( (boost::format("%1% contains no triangles") % filename).str() );
+	out << "Reading '" << filename << "' containing " << filefacecount << " triangles ... ";    // print header
+
+	std::vector<CPoint> vertices;
+	std::vector<std::vector<size_t> > faces;
+	TVertexWelder welder(vertices);
+	while (f){
+		f.seekg(3*4,std::fstream::cur);  // skip normal in STL-file (will be calculated from vertices)
+        std::vector<size_t> vidx;
+		for (short j = 0; j < 3; j++){
+		    float v[3];
+		    f.read((char*)v,12);
+			if (f) {
+                CPoint p(std::abs(v[0]) < REFLECT_TOLERANCE ? 0. : v[0], std::abs(v[1]) < REFLECT_TOLERANCE ? 0. : v[1], std::abs(v[2]) < REFLECT_TOLERANCE ? 0. : v[2]);
+                vidx.push_back(welder.AddVertex(p)); // merge vertices closer than REFLECT_TOLERANCE
+            }
+		}
+		if (f) {
+            faces.push_back(vidx);
+            f.seekg(2, std::fstream::cur);    // 2 attribute bytes, not used in the STL standard (http://www.ennex.com/~fabbers/StL.asp)
+        }
+	}
+	f.close();
+
+	if (faces.size() != filefacecount)
+		throw std::runtime_error( (boost::format("%1% should contain %2% triangles but read %3%") % filename % filefacecount % faces.size()).str() );
+	out << "welded " << 3*faces.size() << " corners into " << vertices.size() << " vertices ... ";
+
+    namespace PMP = CGAL::Polygon_mesh_processing;
+    typedef boost::graph_traits<CMesh>::face_descriptor fd;
+    out.precision(3);
+    err.precision(3);
+    PMP::repair_polygon_soup(vertices, faces/*, CGAL::parameters::require_same_orientation(true)*/);
+    PMP::orient_polygon_soup(vertices, faces);
+    if (mergecoplanar){
+        size_t nfaces = faces.size();
+        MergeCoplanarFaces(vertices, faces);
+        PMP::remove_isolated_points_in_polygon_soup(vertices, faces); // drop vertices that were inside merged regions
+        out << "merged coplanar triangles, reducing them from " << nfaces << " to " << faces.size() << " (" << boost::format("%.1f") % (100.*(nfaces - faces.size())/nfaces) << "%) ... ";
+    }
+    std::unique_ptr<CMesh> mesh(new CMesh());
+
+    if (not PMP::is_polygon_soup_a_polygon_mesh(faces))
+        //throw(std::runtime_error("Triangles do not form a mesh"));
+        err << "Triangles do not form a mesh\n";
+    PMP::polygon_soup_to_polygon_mesh(vertices, faces, *mesh);
+//    CGAL::Polygon_mesh_processing::duplicate_non_manifold_vertices(*mesh);
+    double A = PMP::area(*mesh)*1e4;
+    double V = PMP::volume(*mesh)*1e6;
+
+    auto fccmap = mesh->add_property_map<fd, boost::graph_traits<CMesh>::faces_size_type>("f:CC").first;
+    auto num = PMP::connected_components(*mesh, fccmap);
+    out << "built mesh with " << mesh->number_of_faces() << " triangles and " << num << " components (" << A << "cm2, " << V << "cm3)\n";
+    int affected_components = 0;
+    double border_length = 0.;
+    double self_intersecting_area = 0.;
+    for (size_t i = 0; i < num; ++i) {
+        CGAL::Face_filtered_graph<CMesh> ffg(*mesh, i, fccmap);
+        bool not_closed = not CGAL::is_closed(ffg);
+        bool not_bounding = not PMP::does_bound_a_volume(ffg);
+        bool self_intersecting = PMP::does_self_intersect(ffg);
+        if (not_closed){
+            std::vector<boost::graph_traits<CMesh>::halfedge_descriptor> border_edges;
+            PMP::border_halfedges(ffg, std::back_inserter(border_edges));
+            for (auto edge: border_edges)
+                border_length += PMP::edge_length(edge, *mesh);
+        }
+        if (self_intersecting){
+            std::vector<std::pair<fd, fd> > self_intersecting_face_pairs;
+            PMP::self_intersections(ffg, std::back_inserter(self_intersecting_face_pairs));
+            std::set<fd> self_intersecting_faces;
+            for (auto face_pair: self_intersecting_face_pairs) {
+                self_intersecting_faces.insert(face_pair.first);
+                self_intersecting_faces.insert(face_pair.second);
+            }
+            for (auto face: self_intersecting_faces)
+                self_intersecting_area += PMP::face_area(face, *mesh);
+        }
+        if (not_closed or not_bounding or self_intersecting) {
+            ++affected_components;
+        }
+    }
+    if (affected_components > 0) {
+        err << "\nWarning: " << affected_components << " of " << num << " components have holes with total circumference "
+                  << border_length * 1e2 << "cm and " << self_intersecting_area * 1e4
+                  << "cm2 of their area is self-intersecting!\n\n";
+    }
+
+    std::vector<double> areas;
+    std::transform(mesh->faces_begin(), mesh->faces_end(), std::back_inserter(areas), [&mesh](const CMesh::Face_index &fi){ return CGAL::Polygon_mesh_processing::face_area(fi, *mesh); });
+    std::discrete_distribution<size_t> triangle_sampler(areas.begin(), areas.end());
+
+    std::unique_ptr<CTree> tree(new CTree(mesh->faces_begin(), mesh->faces_end(), *mesh));
+    tree->accelerate_distance_queries();
+
+    return {std::move(mesh), std::move(tree), nullptr, ID, triangle_sampler, false, CTransform(CGAL::IDENTITY), CTransform(CGAL::IDENTITY)};
+}
+
+
+void TTriangleMesh::CachedIntersections(const CTriangleMesh &m, const CSegment &segment, TMeshQueryCache::Entry &cache, std::vector<CIntersection> &out){
+    const CPoint &p1 = segment.source(), &p2 = segment.target();
+    if (cache.hasfreeregion && !cache.freeregion.has_on_unbounded_side(p1) && !cache.freeregion.has_on_unbounded_side(p2))
+        return; // a box is convex, so the whole segment is inside and cannot hit the surface
+
+    if (!cache.candidates.empty() && !cache.region.has_on_unbounded_side(p1) && !cache.region.has_on_unbounded_side(p2)){
+        // segment lies inside region, so it can only hit triangles intersecting the region
+        for (auto f: cache.candidates){
+            CMesh::Halfedge_index h = m.mesh->halfedge(f);
+            CKernel::Triangle_3 tri(m.mesh->point(m.mesh->target(h)), m.mesh->point(m.mesh->target(m.mesh->next(h))), m.mesh->point(m.mesh->source(h))); // same vertex order as in AABB tree
+            auto i = CGAL::intersection(segment, tri);
+            if (i)
+                out.push_back(std::make_pair(*i, f));
+        }
+        return;
+    }
+
+    m.tree->all_intersections(segment, std::back_inserter(out));
+    if (!out.empty()){
+        // remember triangles around segment, enlarged by a fraction of its length to also contain nearby points on a curved trajectory
+        double margin = 0.1*std::sqrt(segment.squared_length()) + REFLECT_TOLERANCE;
+        CGAL::Bbox_3 box = segment.bbox();
+        cache.region = CCuboid(box.xmin() - margin, box.ymin() - margin, box.zmin() - margin, box.xmax() + margin, box.ymax() + margin, box.zmax() + margin);
+        margin += REFLECT_TOLERANCE; // collect candidates with a bit of extra margin to be safe against rounding
+        cache.candidates.clear();
+        m.tree->all_intersected_primitives(CGAL::Bbox_3(box.xmin() - margin, box.ymin() - margin, box.zmin() - margin, box.xmax() + margin, box.ymax() + margin, box.zmax() + margin),
+                                           std::back_inserter(cache.candidates));
+    }
+    else if (cache.countdown > 0)
+        --cache.countdown;
+    else{
+        // try a new free box around segment end, where the trajectory continues, first a large one, then a smaller one
+        double l = std::sqrt(segment.squared_length());
+        cache.hasfreeregion = false;
+        for (double h = 64*l; h > 4*l && !cache.hasfreeregion; h /= 8){
+            double H = h + REFLECT_TOLERANCE; // test slightly larger box to be safe against rounding
+            cache.hasfreeregion = !m.tree->do_intersect(CGAL::Bbox_3(p2.x() - H, p2.y() - H, p2.z() - H, p2.x() + H, p2.y() + H, p2.z() + H));
+            if (cache.hasfreeregion)
+                cache.freeregion = CCuboid(p2.x() - h, p2.y() - h, p2.z() - h, p2.x() + h, p2.y() + h, p2.z() + h);
+        }
+        if (cache.hasfreeregion)
+            cache.backoff = 0;
+        else{ // surface is too close, wait longer before next attempt
+            cache.backoff = std::min(2*cache.backoff + 1, 64u);
+            cache.countdown = cache.backoff;
+        }
+    }
+}
+
+
+// test segment p1->p2 for collision with triangles and return a list of all found collisions
+std::vector<TCollision> TTriangleMesh::Collision(const std::vector<double> &p1, const std::vector<double> &p2, const std::vector<bool> &skip,
+													TMeshQueryCache *cache) const{
+	CSegment segment(CPoint(p1[0], p1[1], p1[2]), CPoint(p2[0], p2[1], p2[2]));
+	std::vector<TCollision> colls;
+	if (cache && cache->entries.size() != meshes.size())
+		cache->entries.assign(meshes.size(), TMeshQueryCache::Entry());
+	for (size_t m = 0; m < meshes.size(); ++m) {
+        if (m < skip.size() && skip[m])
+            continue;
+        const CTriangleMesh &it = meshes[m];
+        std::vector<CIntersection> out;
+        CSegment localsegment = it.transformed ? segment.transform(it.inverse) : segment; // search in mesh coordinates
+        if (it.primitive){
+            std::vector<std::pair<CPoint, CVector> > hits;
+            it.primitive->Intersections(localsegment, hits);
+            for (auto &h: hits){
+                TCollision c(localsegment, h.second, h.first, it.ID);
+                if (it.transformed){
+                    CVector n = it.transform(h.second);
+                    std::copy(n.cartesian_begin(), n.cartesian_end(), c.normal);
+                }
+                colls.push_back(c);
+            }
+            continue;
+        }
+        if (!cache)
+            it.tree->all_intersections(localsegment, std::back_inserter(out)); // search intersections of segment with mesh
+        else
+            CachedIntersections(it, localsegment, cache->entries[m], out); // search intersections, skipping tree traversal if possible
+        for (auto &i: out){
+            const CPoint *collp = boost::get<CPoint>(&(i->first));
+            if (collp) { // if intersection is a point
+                CVector n = CGAL::Polygon_mesh_processing::compute_face_normal(i->second, *it.mesh);
+                TCollision c(localsegment, n, *collp, it.ID); // s and distnormal are invariant under rigid transformations
+                if (it.transformed){
+                    n = it.transform(n);
+                    std::copy(n.cartesian_begin(), n.cartesian_end(), c.normal);
+                }
+                colls.push_back(c); // add collision to list
+            }
+            else
+                throw std::runtime_error("Segment-triangle intersection happened to not be a point");
+        }
+    }
+
+	std::sort(	colls.begin(),
+				colls.end(),
+				[](const TCollision &c1, const TCollision &c2){
+					if (c1.s == c2.s){
+                        //std::cout << "Coincident collision between solids " << c1.ID << " and " << c2.ID << std::endl;
+						return c1.ID > c2.ID;
+					}
+					else
+						return c1.s < c2.s;
+				}
+	);
+	return colls;
+
+}
+
+
+bool TTriangleMesh::InSolid(const double x, const double y, const double z) const{
+    return std::any_of(meshes.begin(), meshes.end(), [x,y,z](const CTriangleMesh &mesh){
+        return InMesh(mesh, CPoint(x,y,z));
+    });
+}
+
+
+void TTriangleMesh::SetTransform(const int ID, const CTransform &transform){
+    for (auto &m: meshes){
+        if (m.ID == ID){
+            m.transformed = true;
+            m.transform = transform;
+            m.inverse = transform.inverse();
+        }
+    }
+}
@@ -3,8 +3,10 @@
  */
 
 #include <random>
+#include <fstream>
 
 #include <boost/test/unit_test.hpp>
+#include <boost/filesystem.hpp>
 #include <boost/format.hpp>
 
 #include "analyticFields.h"
@@ -13,6 +15,9 @@
 #include "edmfields.h"
 #include "fields.h"
 #include "config.h"
+#include "field_2d.h"
+#include "field_3d.h"
+#include "harmonicfields.h"
 
 #include <iostream>
 
@@ -200,6 +205,28 @@ BOOST_AUTO_TEST_CASE(TCustomBFieldTest){
     BOOST_CHECK_THROW(TCustomBField("a", "b", "c"), std::runtime_error);
     TCustomBField f("0", "0", "0");
     checkMagneticFieldZero(f, 1., 2., 3.);
+
+    // derivatives have to be exact, last formula is not supported by the compiler and falls back to numerical derivatives
+    TCustomBField g("x^2*y - sin(z) + 2^3^2", "exp(-x*y)/sqrt(z^2 + 1) + atan2(y, X)", "if (x > 0, -x^2, 0) + z*t");
+    int nTests = 1000;
+    for (int n = 0; n < nTests; ++n){
+        double x = uni(rng), y = uni(rng), z = uni(rng), t = uni(rng);
+        double B[3], dBidxj[3][3], r2 = x*x + y*y, e = std::exp(-x*y), s = std::sqrt(z*z + 1);
+        g.BField(x, y, z, t, B, dBidxj);
+        BOOST_TEST_CONTEXT("Parameters: x = " << x << ", y = " << y << ", z = " << z << ", t = " << t){
+            BOOST_CHECK_CLOSE(B[0], x*x*y - std::sin(z) + 512, 1e-12);
+            BOOST_CHECK_CLOSE(dBidxj[0][0], 2*x*y, 1e-12);
+            BOOST_CHECK_CLOSE(dBidxj[0][1], x*x, 1e-12);
+            BOOST_CHECK_CLOSE(dBidxj[0][2], -std::cos(z), 1e-12);
+            BOOST_CHECK_CLOSE(B[1], e/s + std::atan2(y, x), 1e-12);
+            BOOST_CHECK_CLOSE(dBidxj[1][0], -y*e/s - y/r2, 1e-12);
+            BOOST_CHECK_CLOSE(dBidxj[1][1], -x*e/s + x/r2, 1e-12);
+            BOOST_CHECK_CLOSE(dBidxj[1][2], -e*z/(s*s*s), 1e-12);
+            BOOST_CHECK_SMALL(B[2] - (x > 0 ? -x*x : 0) - z*t, 1e-12);
+            BOOST_CHECK_SMALL(dBidxj[2][0] - (x > 0 ? -2*x : 0), std::abs(x) < 1e-3 ? 1. : 1e-6);
+            BOOST_CHECK_SMALL(dBidxj[2][2] - t, 1e-6);
+        }
+    }
 }
 
 // check that TFieldScaler correctly identifies invalid formulas and returns expected scaling factor
@@ -221,6 +248,19 @@ BOOST_AUTO_TEST_CASE(TFieldScalerTest){
             BOOST_CHECK_EQUAL(dFidxj[i][j], scaler2.scalingFactor(1.));
         }
     }
+
+    // precompiled piecewise formulas have to agree with the same functions evaluated by the formula interpreter and with the ternary formula from the example config
+    TFieldScaler ramp("pwlinear(t, 400, 0, 500, 1, 700, 1, 800, 0)*1e-4"), pwramp("pwlinear(t,400,0,500,1e-4,700,1e-4,800,0)");
+    TFieldScaler ternaryramp("t<400?0:(t<500?0.01*(t-400):(t<700?1:(t<800?0.01*(800-t):0)))*0.0001");
+    TFieldScaler steps("pwconst(t, 0, 1, 1, 2, 2, 3) + 0"), pwsteps("pwconst( t, 0, 1, 1, 2, 2, 3 )");
+    for (double t = -10; t < 1000; t += 0.25){
+        BOOST_CHECK_CLOSE(pwramp.scalingFactor(t), ramp.scalingFactor(t), 1e-10);
+        BOOST_CHECK_CLOSE(pwramp.scalingFactor(t), ternaryramp.scalingFactor(t), 1e-10);
+        BOOST_CHECK_EQUAL(pwsteps.scalingFactor(t), steps.scalingFactor(t));
+        BOOST_CHECK_EQUAL(pwsteps.scalingFactor(t), t < 1 ? 1. : (t < 2 ? 2. : 3.));
+    }
+    BOOST_CHECK_THROW(TFieldScaler("pwlinear(t, 1, 2, 3)"), std::runtime_error);
+    BOOST_CHECK_CLOSE(TFieldScaler("2*pi").scalingFactor(1.), 2*pi, 1e-12);
 }
 
 // check that TFieldBoundaryBox correctly identifies invalid parameters and correctly scales within and outside of boundary (without smoothing)
@@ -317,6 +357,201 @@ BOOST_AUTO_TEST_CASE(TConductorFieldTest){
     }
 }
 
+// compare field of a set of random wires to the sum of the fields of single conductors, and check loading the set from a file
+BOOST_AUTO_TEST_CASE(TConductorSetFieldTest){
+    std::vector<std::array<double, 7> > wires;
+    std::vector<TConductorField> conductors;
+    boost::filesystem::path file = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("%%%%-%%%%.txt");
+    {
+        std::ofstream f(file.native());
+        f.precision(17);
+        f << "# I x1 y1 z1 x2 y2 z2\n";
+        for (int i = 0; i < 20; ++i){
+            std::array<double, 7> w;
+            for (auto &v: w)
+                v = uni(rng);
+            wires.push_back(w);
+            conductors.emplace_back(w[1], w[2], w[3], w[4], w[5], w[6], w[0]);
+            for (auto v: w)
+                f << v << " ";
+            f << "\n\n";
+        }
+    }
+    TConductorSetField set(wires);
+    TFieldContainer fromfile = ReadConductorSet("ConductorSet " + file.native() + " 2");
+    boost::filesystem::remove(file);
+
+    int nTests = 1000;
+    for (int n = 0; n < nTests; ++n){
+        double x = uni(rng), y = uni(rng), z = uni(rng);
+        double B[3] = {0, 0, 0}, dBidxj[3][3] = {{0, 0, 0}, {0, 0, 0}, {0, 0, 0}}, Bset[3], dBset[3][3], Bfile[3], dBfile[3][3];
+        for (auto &c: conductors){
+            double Bc[3], dBc[3][3];
+            c.BField(x, y, z, 0, Bc, dBc);
+            for (int i = 0; i < 3; ++i){
+                B[i] += Bc[i];
+                for (int j = 0; j < 3; ++j)
+                    dBidxj[i][j] += dBc[i][j];
+            }
+        }
+        set.BField(x, y, z, 0, Bset, dBset);
+        fromfile.BField(x, y, z, 0, Bfile, dBfile);
+        BOOST_TEST_CONTEXT("Parameters: x = " << x << ", y = " << y << ", z = " << z){
+            for (int i = 0; i < 3; ++i){
+                BOOST_CHECK_CLOSE(Bset[i], B[i], 1e-6);
+                BOOST_CHECK_CLOSE(Bfile[i], 2*Bset[i], 1e-10);
+                for (int j = 0; j < 3; ++j)
+                    BOOST_CHECK_CLOSE(dBset[i][j], dBidxj[i][j], 1e-6);
+            }
+            set.BField(x, y, z, 0, Bfile, nullptr);
+            for (int i = 0; i < 3; ++i)
+                BOOST_CHECK_CLOSE(Bfile[i], Bset[i], 1e-10);
+            checkElectricFieldZero(set, x, y, z);
+        }
+    }
+}
+
+// compare interpolation of two baked conductors to their exact field, and check that the interpolation is continuous across leaves
+BOOST_AUTO_TEST_CASE(TOctreeFieldTest){
+    TConductorField c1(0.8, 0, -1, 0.8, 0, 1, 1e4), c2(-0.2, 0.7, -1, 0.3, 0.7, 1, -5e3);
+    TConfig config({{"FIELDS", {{"1", "Conductor 1e4 0.8 0 -1 0.8 0 1 1"}, {"2", "Conductor -5e3 -0.2 0.7 -1 0.3 0.7 1 1"},
+                                {"3", "BakedField 1,2 0.5 -0.5 0.5 -0.5 0.5 -0.5 1e-7 6 2"}}}});
+    TFieldManager m(config);
+
+    int nTests = 1000;
+    for (int n = 0; n < nTests; ++n){
+        double x = 0.25*uni(rng), y = 0.25*uni(rng), z = 0.25*uni(rng);
+        double B[3], Bexact[3] = {0, 0, 0}, Bc[3], Bshifted[3];
+        m.BField(x, y, z, 0, B);
+        for (auto c: {&c1, &c2}){
+            c->BField(x, y, z, 0, Bc, nullptr);
+            for (int i = 0; i < 3; ++i)
+                Bexact[i] += 2*Bc[i];
+        }
+        m.BField(x + 1e-9, y + 1e-9, z + 1e-9, 0, Bshifted);
+        BOOST_TEST_CONTEXT("Parameters: x = " << x << ", y = " << y << ", z = " << z){
+            for (int i = 0; i < 3; ++i){
+                BOOST_CHECK_SMALL(B[i] - Bexact[i], 1e-6);
+                BOOST_CHECK_SMALL(Bshifted[i] - B[i], 1e-9);
+            }
+        }
+    }
+    double B[3];
+    m.BField(0.6, 0, 0, 0, B);
+    for (int i = 0; i < 3; ++i)
+        BOOST_CHECK_EQUAL(B[i], 0.); // baked conductors are removed outside of bounding box
+
+    TConfig wrongID({{"FIELDS", {{"1", "Conductor 1e4 0.8 0 -1 0.8 0 1 1"}, {"2", "BakedField 1,3 0.5 -0.5 0.5 -0.5 0.5 -0.5 1e-7 6 1"}}}});
+    BOOST_CHECK_THROW(TFieldManager wrong(wrongID), std::runtime_error);
+}
+
+// compare HarmonicExpandedBField to known harmonic polynomials, check that random higher-order expansions are divergence- and curl-free, and check rotation and loading coefficients from a file
+BOOST_AUTO_TEST_CASE(HarmonicExpandedBFieldTest){
+    int nTests = 100;
+    for (int n = 0; n < nTests; ++n){
+        double xoff = uni(rng), yoff = uni(rng), zoff = uni(rng), G8 = uni(rng), G19 = uni(rng);
+        std::vector<double> G(24, 0.);
+        G[8] = G8; // G(2,-3)
+        G[19] = G19; // G(3,0)
+        HarmonicExpandedBField f1(xoff, yoff, zoff, 0, 0, 0, 0, G);
+        auto X = boost::format("(x + %1$.20g)") % xoff, Y = boost::format("(y + %1$.20g)") % yoff, Z = boost::format("(z + %1$.20g)") % zoff;
+        auto Bx = boost::format("%1$.20g*2*%2%*%3% + %4$.20g*3/8*(%2%^3 + %2%*%3%^2 - 4*%2%*%5%^2)") % G8 % X % Y % G19 % Z;
+        auto By = boost::format("%1$.20g*(%2%^2 - %3%^2) + %4$.20g*3/8*(%3%^3 + %2%^2*%3% - 4*%3%*%5%^2)") % G8 % X % Y % G19 % Z;
+        auto Bz = boost::format("%1$.20g*(%2%^3 - 3/2*%2%*(%3%^2 + %4%^2))") % G19 % Z % X % Y;
+        TCustomBField f2(Bx.str(), By.str(), Bz.str());
+        double x = uni(rng), y = uni(rng), z = uni(rng);
+        BOOST_TEST_CONTEXT("Parameters: xoff = " << xoff << ", yoff = " << yoff << ", zoff = " << zoff << ", G8 = " << G8 << ", G19 = " << G19 << ", x = " << x << ", y = " << y << ", z = " << z){
+            compareMagneticFields(f1, f2, x, y, z);
+            checkElectricFieldZero(f1, x, y, z);
+        }
+    }
+
+    std::vector<double> G(40); // all coefficients up to order 5
+    for (auto &g: G)
+        g = uni(rng);
+    HarmonicExpandedBField f(0.1, -0.2, 0.3, uni(rng), uni(rng), uni(rng), uni(rng), G);
+    for (int n = 0; n < nTests; ++n){
+        double x = 0.5*uni(rng), y = 0.5*uni(rng), z = 0.5*uni(rng), h = 1e-6;
+        double B[3], dBidxj[3][3], Bp[3], Bm[3];
+        f.BField(x, y, z, 0, B, dBidxj);
+        BOOST_TEST_CONTEXT("Parameters: x = " << x << ", y = " << y << ", z = " << z){
+            BOOST_CHECK_SMALL(dBidxj[0][0] + dBidxj[1][1] + dBidxj[2][2], 1e-9); // div B = 0
+            for (int j = 0; j < 3; ++j){
+                double p[3] = {x, y, z};
+                p[j] += h;
+                f.BField(p[0], p[1], p[2], 0, Bp, nullptr);
+                p[j] -= 2*h;
+                f.BField(p[0], p[1], p[2], 0, Bm, nullptr);
+                for (int i = 0; i < 3; ++i){
+                    BOOST_CHECK_SMALL(dBidxj[i][j] - dBidxj[j][i], 1e-9); // curl B = 0
+                    BOOST_CHECK_SMALL(dBidxj[i][j] - (Bp[i] - Bm[i])/2/h, 1e-5);
+                }
+            }
+        }
+    }
+
+    double B[3], dBidxj[3][3];
+    HarmonicExpandedBField rotated(0, 0, 0, 1, 0, 0, pi/2, {0, 1}); // homogeneous field along z rotated by 90 degrees around x axis
+    rotated.BField(uni(rng), uni(rng), uni(rng), 0, B, dBidxj);
+    BOOST_CHECK_SMALL(B[0], 1e-15);
+    BOOST_CHECK_CLOSE(B[1], -1., 1e-12);
+    BOOST_CHECK_SMALL(B[2], 1e-15);
+
+    boost::filesystem::path file = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("%%%%-%%%%.txt");
+    {
+        std::ofstream out(file.native());
+        out.precision(17);
+        out << "# G(l,m)\n";
+        for (auto g: G)
+            out << g << "\n";
+    }
+    TFieldContainer fromfile = ReadHarmonicExpandedBField("HarmonicExpandedBField 0.1 -0.2 0.3 0 1 -1 1 -1 1 -1 2 0 0 0 0 " + file.native());
+    boost::filesystem::remove(file);
+    HarmonicExpandedBField unrotated(0.1, -0.2, 0.3, 0, 0, 0, 0, G);
+    double Bfile[3];
+    for (int n = 0; n < nTests; ++n){
+        double x = 0.5*uni(rng), y = 0.5*uni(rng), z = 0.5*uni(rng);
+        unrotated.BField(x, y, z, 0, B, nullptr);
+        fromfile.BField(x, y, z, 0, Bfile, nullptr);
+        for (int i = 0; i < 3; ++i)
+            BOOST_CHECK_CLOSE(Bfile[i], 2*B[i], 1e-10);
+    }
+    BOOST_CHECK_THROW(HarmonicExpandedBField(0, 0, 0, 0, 0, 0, 0, std::vector<double>(22*24 + 1)), std::runtime_error); // order 21 exceeds maximum order
+}
+
+// check that TFieldCache returns the same fields as TFieldManager, including derivatives requested after the field was cached
+BOOST_AUTO_TEST_CASE(TFieldCacheTest){
+    TConfig config({{"FIELDS", {{"1", "Conductor 1e4 0.8 0 -1 0.8 0 1 1"}, {"2", "EDMStaticEField 0 1e3 1e6 t"}}}});
+    TFieldManager m(config);
+    TFieldCache cache;
+
+    int nTests = 100;
+    std::vector<std::array<double, 4> > points;
+    for (int n = 0; n < nTests; ++n)
+        points.push_back({{uni(rng), uni(rng), uni(rng), uni(rng)}});
+    for (int pass = 0; pass < 2; ++pass){ // second pass evaluates each point three times in a row, so the last two evaluations come from the cache
+        for (auto &p: points){
+            double B[3], dBidxj[3][3], V, Ei[3], Bc[3], dBc[3][3], Vc, Eic[3];
+            m.BField(p[0], p[1], p[2], p[3], B, dBidxj);
+            m.EField(p[0], p[1], p[2], p[3], V, Ei);
+            for (int k = 0; k < 1 + 2*pass; ++k){
+                cache.BField(m, p[0], p[1], p[2], p[3], Bc);
+                for (int i = 0; i < 3; ++i)
+                    BOOST_CHECK_EQUAL(Bc[i], B[i]);
+                cache.BField(m, p[0], p[1], p[2], p[3], Bc, dBc);
+                cache.EField(m, p[0], p[1], p[2], p[3], Vc, Eic);
+                BOOST_CHECK_EQUAL(Vc, V);
+                for (int i = 0; i < 3; ++i){
+                    BOOST_CHECK_EQUAL(Bc[i], B[i]);
+                    BOOST_CHECK_EQUAL(Eic[i], Ei[i]);
+                    for (int j = 0; j < 3; ++j)
+                        BOOST_CHECK_EQUAL(dBc[i][j], dBidxj[i][j]);
+                }
+            }
+        }
+    }
+}
+
 // compare field calculated from TEDMStaticB0GradZField along the y axis to a TCustomBField with same field calculation formula, using randomly selected offsets, parameters and positions
 BOOST_AUTO_TEST_CASE(TEDMStaticB0GradZFieldTest){
     int nTests = 100;
@@ -374,6 +609,263 @@ BOOST_AUTO_TEST_CASE(TFieldManagerTest){
 }
 
 
+// check that the spatial index in TFieldManager visits all fields that can be non-zero at a point
+BOOST_AUTO_TEST_CASE(TFieldManagerGridTest){
+    std::map<std::string, std::string> fieldconf;
+    std::vector<TFieldContainer> fields;
+    std::uniform_real_distribution<double> size(0.01, 1.);
+    for (int i = 0; i < 50; ++i){ // many small overlapping fields with hard boundaries
+        double x = uni(rng), y = uni(rng), z = uni(rng), s = size(rng), a1 = uni(rng), a2 = uni(rng);
+        std::ostringstream conf;
+        conf.precision(17);
+        conf << "LinearFieldZ " << a1 << " " << a2 << " " << x + s << " " << x - s << " " << y + s << " " << y - s << " " << z + s << " " << z - s << " 1";
+        fieldconf[std::to_string(i)] = conf.str();
+        fields.emplace_back(std::unique_ptr<TField>(new TLinearFieldZ(a1, a2)), "1", "0", x + s, x - s, y + s, y - s, z + s, z - s, 0.);
+    }
+    fieldconf["50"] = "Conductor 1 0 0 -1 0 0 1 1"; // field without boundary
+    fields.emplace_back(std::unique_ptr<TField>(new TConductorField(0, 0, -1, 0, 0, 1, 1)), "1");
+    TConfig config({{"FIELDS", fieldconf}});
+    TFieldManager m(config);
+
+    int nTests = 10000;
+    for (int n = 0; n < nTests; ++n){
+        double x = 1.5*uni(rng), y = 1.5*uni(rng), z = 1.5*uni(rng);
+        double B[3], dBidxj[3][3], Bsum[3] = {0, 0, 0}, dBsum[3][3] = {{0, 0, 0}, {0, 0, 0}, {0, 0, 0}};
+        m.BField(x, y, z, 0, B, dBidxj);
+        for (auto &f: fields){
+            double Btmp[3], dBtmp[3][3];
+            f.BField(x, y, z, 0, Btmp, dBtmp);
+            for (int i = 0; i < 3; ++i){
+                Bsum[i] += Btmp[i];
+                for (int j = 0; j < 3; ++j)
+                    dBsum[i][j] += dBtmp[i][j];
+            }
+        }
+        BOOST_TEST_CONTEXT("Parameters: x = " << x << ", y = " << y << ", z = " << z){
+            for (int i = 0; i < 3; ++i){
+                BOOST_CHECK_SMALL(B[i] - Bsum[i], 1e-12);
+                for (int j = 0; j < 3; ++j)
+                    BOOST_CHECK_SMALL(dBidxj[i][j] - dBsum[i][j], 1e-12);
+            }
+        }
+    }
+}
+
+
+// check that a linear field is reproduced by TabField3 on grids with even and uneven spacing
+BOOST_AUTO_TEST_CASE(TabField3LinearTest){
+    std::array<std::vector<double>, 3> xyz, B;
+    std::vector<double> V;
+    std::vector<double> zgrid = {-1., -0.7, -0.2, 0., 0.1, 0.5, 1.2}; // z axis is unevenly spaced
+    for (int i = 0; i <= 20; ++i){
+        for (int j = 0; j <= 10; ++j){
+            for (double z: zgrid){
+                double x = -1. + 0.1*i, y = -0.5 + 0.15*j;
+                xyz[0].push_back(x);
+                xyz[1].push_back(y);
+                xyz[2].push_back(z);
+                B[0].push_back(0.1 + 0.2*x - 0.3*y + 0.4*z);
+                B[1].push_back(-0.2*x + 0.5*z);
+                B[2].push_back(1. + 0.3*y);
+                V.push_back(2.*x - y + 3.*z);
+            }
+        }
+    }
+    TabField3 f(xyz, B, V);
+
+    int nTests = 10000;
+    for (int n = 0; n < nTests; ++n){
+        double x = uni(rng), y = uni(rng), z = uni(rng);
+        double Bi[3] = {0, 0, 0}, dBidxj[3][3] = {{0, 0, 0}, {0, 0, 0}, {0, 0, 0}}, Vi = 0, Ei[3] = {0, 0, 0};
+        f.BField(x, y, z, 0, Bi, dBidxj);
+        f.EField(x, y, z, 0, Vi, Ei);
+        BOOST_TEST_CONTEXT("Parameters: x = " << x << ", y = " << y << ", z = " << z){
+            if (x >= -1. && x < 1. && y >= -0.5 && y < 1. && z >= -1. && z < 1.2){
+                BOOST_CHECK_SMALL(Bi[0] - (0.1 + 0.2*x - 0.3*y + 0.4*z), 1e-12);
+                BOOST_CHECK_SMALL(Bi[1] - (-0.2*x + 0.5*z), 1e-12);
+                BOOST_CHECK_SMALL(Bi[2] - (1. + 0.3*y), 1e-12);
+                BOOST_CHECK_SMALL(dBidxj[0][0] - 0.2, 1e-10);
+                BOOST_CHECK_SMALL(dBidxj[0][1] + 0.3, 1e-10);
+                BOOST_CHECK_SMALL(dBidxj[1][2] - 0.5, 1e-10);
+                BOOST_CHECK_SMALL(dBidxj[2][1] - 0.3, 1e-10);
+                BOOST_CHECK_SMALL(Vi - (2.*x - y + 3.*z), 1e-12);
+                BOOST_CHECK_SMALL(Ei[0] + 2., 1e-10);
+                BOOST_CHECK_SMALL(Ei[1] - 1., 1e-10);
+                BOOST_CHECK_SMALL(Ei[2] + 3., 1e-10);
+            }
+            else{
+                BOOST_CHECK_EQUAL(Bi[0], 0.);
+                BOOST_CHECK_EQUAL(Vi, 0.);
+            }
+        }
+    }
+}
+
+
+// check that the compact mode of TabField3 gives the same interpolation as the precalculated coefficients
+BOOST_AUTO_TEST_CASE(TabField3CompactTest){
+    std::array<std::vector<double>, 3> xyz, B;
+    std::vector<double> V;
+    for (int i = 0; i <= 10; ++i){
+        for (int j = 0; j <= 12; ++j){
+            for (int k = 0; k <= 8; ++k){
+                double x = -1. + 0.2*i, y = -1. + 0.15*j + 0.01*j*j, z = -1. + 0.25*k;
+                xyz[0].push_back(x);
+                xyz[1].push_back(y);
+                xyz[2].push_back(z);
+                B[0].push_back(std::sin(x)*std::cos(2*y) + z*z);
+                B[1].push_back(std::exp(-x*x - y*y)*z);
+                B[2].push_back(std::cos(x*y*z));
+                V.push_back(std::sin(x + 2*y - z));
+            }
+        }
+    }
+    TabField3 f(xyz, B, V), fc(xyz, B, V, true);
+    // saving and loading binary files has to preserve interpolation
+    boost::filesystem::path bin = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("%%%%-%%%%.bin"),
+                            binc = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("%%%%-%%%%.bin");
+    f.Save(bin.native());
+    fc.Save(binc.native());
+    TabField3 fb(bin.native()), fcb(binc.native());
+    boost::filesystem::remove(bin); // file stays mapped until field is destroyed
+    boost::filesystem::remove(binc);
+
+    int nTests = 10000;
+    for (int n = 0; n < nTests; ++n){
+        double x = 0.99*uni(rng)/2, y = 0.99*uni(rng)/2, z = 0.99*uni(rng)/2;
+        BOOST_TEST_CONTEXT("Parameters: x = " << x << ", y = " << y << ", z = " << z){
+            compareMagneticFields(f, fc, x, y, z);
+            compareMagneticFields(f, fb, x, y, z);
+            compareMagneticFields(fc, fcb, x, y, z);
+            double V1, V2, E1[3], E2[3];
+            f.EField(x, y, z, 0, V1, E1);
+            fc.EField(x, y, z, 0, V2, E2);
+            BOOST_CHECK_SMALL(V1 - V2, 1e-12);
+            for (int i = 0; i < 3; ++i)
+                BOOST_CHECK_SMALL(E1[i] - E2[i], 1e-10);
+        }
+    }
+}
+
+
+// check that resampling a table on an octree reproduces the table, and that saving and loading the octree preserves it
+BOOST_AUTO_TEST_CASE(TOctreeFieldTableTest){
+    boost::filesystem::path table = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("%%%%-%%%%.tab");
+    {
+        std::ofstream f(table.native());
+        f << "41 41 41 2\n 1 X\n 2 Y\n 3 Z\n 4 BX\n 5 BY\n 6 BZ\n 7 V\n 0\n";
+        f.precision(17);
+        for (int i = 0; i <= 40; ++i){
+            for (int j = 0; j <= 40; ++j){
+                for (int k = 0; k <= 40; ++k){
+                    double x = -1 + 0.05*i, y = -1 + 0.05*j, z = -1 + 0.05*k, r2 = (x - 1.2)*(x - 1.2) + y*y; // line current along z close to the table's edge
+                    f << x << " " << y << " " << z << " " << -0.1*y/r2 << " " << 0.1*(x - 1.2)/r2 << " " << 0.01*z << " " << std::log(r2) << "\n";
+                }
+            }
+        }
+    }
+    boost::filesystem::path octree = table;
+    octree += ".octree";
+    TConfig tableconf({{"FIELDS", {{"1", "OPERA3D " + table.native() + " 1 1 0 1"}}}}),
+            octreeconf({{"FIELDS", {{"1", "OPERA3D " + table.native() + " 1 1 0 1 octree 1e-5 1e-4 6 convert"}}}}),
+            loadconf({{"FIELDS", {{"1", "BINARYOCTREE " + octree.native() + " 1 1 0"}}}});
+    TFieldManager mtable(tableconf), moctree(octreeconf), mloaded(loadconf);
+    boost::filesystem::remove(table);
+    boost::filesystem::remove(octree);
+
+    int nTests = 1000;
+    for (int n = 0; n < nTests; ++n){
+        double x = 0.5*uni(rng), y = 0.5*uni(rng), z = 0.5*uni(rng);
+        double B1[3], B2[3], B3[3], dB[3][3], V1, V2, V3, E1[3], E2[3], E3[3];
+        mtable.BField(x, y, z, 0, B1);
+        moctree.BField(x, y, z, 0, B2);
+        mloaded.BField(x, y, z, 0, B3, dB);
+        mtable.EField(x, y, z, 0, V1, E1);
+        moctree.EField(x, y, z, 0, V2, E2);
+        mloaded.EField(x, y, z, 0, V3, E3);
+        BOOST_TEST_CONTEXT("Parameters: x = " << x << ", y = " << y << ", z = " << z){
+            for (int i = 0; i < 3; ++i){
+                BOOST_CHECK_SMALL(B2[i] - B1[i], 1e-4);
+                BOOST_CHECK_EQUAL(B3[i], B2[i]);
+                BOOST_CHECK_EQUAL(E3[i], E2[i]);
+            }
+            BOOST_CHECK_SMALL(V2 - V1, 1e-3);
+            BOOST_CHECK_EQUAL(V3, V2);
+        }
+    }
+}
+
+
+// check that the precalculated cell coefficients of TabField reproduce alglib's bicubic spline of the same table
+BOOST_AUTO_TEST_CASE(TabFieldTest){
+    const int m = 11, n = 15;
+    auto field = [](const double r, const double z){
+        return std::array<double, 4>{{std::sin(3*r)*std::cos(2*z), r*std::exp(-z*z), 1. + r*r - 0.3*z, std::cos(r*z)}};
+    };
+    boost::filesystem::path tab = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("%%%%-%%%%.tab");
+    alglib::real_1d_array rind, zind, col[4];
+    rind.setlength(m);
+    zind.setlength(n);
+    for (auto &c: col)
+        c.setlength(m*n);
+    {
+        std::ofstream f(tab.native());
+        f << m << " 1 " << n << " 2\n 1 X [LENGU]\n 2 Z [LENGU]\n 3 RBX [FLUXU]\n 4 RBY [FLUXU]\n 5 RBZ [FLUXU]\n 6 RV [ENERU]\n 0\n";
+        f.precision(17);
+        for (int i = 0; i < m; ++i){
+            for (int k = 0; k < n; ++k){
+                double r = 0.1*i, z = -0.5 + 0.1*k;
+                rind[i] = r;
+                zind[k] = z;
+                std::array<double, 4> v = field(r, z);
+                f << r/0.01 << " " << z/0.01; // table is in cm
+                for (int c = 0; c < 4; ++c){
+                    f << " " << v[c];
+                    col[c][k*m + i] = v[c];
+                }
+                f << "\n";
+            }
+        }
+    }
+    TabField tf(tab.native(), 0.01);
+    boost::filesystem::remove(tab);
+    alglib::spline2dinterpolant spline[4];
+    for (int c = 0; c < 4; ++c)
+        alglib::spline2dbuildbicubicv(rind, m, zind, n, col[c], 1, spline[c]);
+
+    int nTests = 10000;
+    for (int i = 0; i < nTests; ++i){
+        double x = uni(rng)/2, y = uni(rng)/2, z = uni(rng)/4;
+        if (i == 0)
+            x = y = 0; // check field on axis
+        double r = std::sqrt(x*x + y*y), phi = std::atan2(y, x);
+        double B[3] = {0, 0, 0}, dBidxj[3][3] = {{0, 0, 0}, {0, 0, 0}, {0, 0, 0}}, V = 0, Ei[3] = {0, 0, 0};
+        tf.BField(x, y, z, 0, B, dBidxj);
+        tf.EField(x, y, z, 0, V, Ei);
+        BOOST_TEST_CONTEXT("Parameters: x = " << x << ", y = " << y << ", z = " << z){
+            if (r <= 1. && z >= -0.5 && z <= 0.9){
+                double f[4], dfdr[4], dfdz[4], dummy;
+                for (int c = 0; c < 4; ++c)
+                    alglib::spline2ddiff(spline[c], r, z, f[c], dfdr[c], dfdz[c], dummy);
+                BOOST_CHECK_SMALL(B[0] - (f[0]*std::cos(phi) - f[1]*std::sin(phi)), 1e-12);
+                BOOST_CHECK_SMALL(B[1] - (f[0]*std::sin(phi) + f[1]*std::cos(phi)), 1e-12);
+                BOOST_CHECK_SMALL(B[2] - f[2], 1e-12);
+                BOOST_CHECK_SMALL(dBidxj[0][2] - (dfdz[0]*std::cos(phi) - dfdz[1]*std::sin(phi)), 1e-10);
+                BOOST_CHECK_SMALL(dBidxj[2][0] - dfdr[2]*std::cos(phi), 1e-10);
+                BOOST_CHECK_SMALL(dBidxj[2][2] - dfdz[2], 1e-10);
+                BOOST_CHECK_SMALL(V - f[3], 1e-12);
+                BOOST_CHECK_SMALL(Ei[1] + dfdr[3]*std::sin(phi), 1e-10);
+                BOOST_CHECK_SMALL(Ei[2] + dfdz[3], 1e-10);
+            }
+            else{
+                BOOST_CHECK_EQUAL(B[0], 0.);
+                BOOST_CHECK_EQUAL(V, 0.);
+            }
+        }
+    }
+}
+
+
 /*****************************************************************************
- * MORE TO COME --- tests for TabField, TabField3, HarmonicExpandedBField, ...
+ * MORE TO COME --- tests for TabField, TabField3, ...
  ****************************************************************************/
\ No newline at end of file
@@ -0,0 +1,175 @@
+/**
+ * \file
+ * Benchmark of geometry queries.
+ *
+ * Loads the geometry of one or more configuration files (by default in/GEANTbenchmark and in/STARUCNbenchmark)
+ * and times TGeometry::CheckSegment, TGeometry::GetCollisions and TGeometry::GetSolids
+ * for a reproducible set of random segments inside the geometry's bounding box.
+ * GetCollisions is also timed for a random walk of consecutive segments, with and without TMeshQueryCache.
+ *
+ * Usage: geometryBenchmark [number of queries [config file ...]]
+ */
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+#include <array>
+#include <map>
+#include <sstream>
+
+#include <boost/format.hpp>
+#include <boost/filesystem.hpp>
+
+#include "geometry.h"
+#include "config.h"
+#include "globals.h"
+
+/**
+ * Print statistics of query durations
+ *
+ * @param name Name of benchmarked query
+ * @param times Duration of each query [ns]
+ * @param hits Number of queries that returned a hit
+ * @param total Total number of hits returned by all queries
+ */
+void PrintTimes(const std::string &name, std::vector<double> times, const size_t hits, const size_t total){
+	std::sort(times.begin(), times.end());
+	auto percentile = [&times](const double p){ return times[std::min(times.size() - 1, static_cast<size_t>(p*times.size()))]; };
+	double mean = std::accumulate(times.begin(), times.end(), 0.)/times.size();
+	std::cout << boost::format("%-15s %10.0f %10.0f %10.0f %10.0f %10.0f %10u %10u\n")
+				% name % mean % percentile(0.5) % percentile(0.9) % percentile(0.99) % times.back() % hits % total;
+}
+
+/**
+ * Time geometry queries of one configuration
+ *
+ * @param config Path to configuration file
+ * @param N Number of queries
+ */
+void Benchmark(const boost::filesystem::path &config, const size_t N){
+	configpath = boost::filesystem::absolute(config);
+	TConfig configin(configpath.native());
+	configin.convert(configpath.native());
+	double simtime = 1000;
+	std::istringstream(configin["GLOBAL"]["simtime"]) >> simtime;
+
+	auto start = std::chrono::steady_clock::now();
+	TGeometry geom(configin);
+	std::cout << "\nLoaded geometry of " << configpath << " in " << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() << "s\n";
+
+	// reproducible random segments inside the bounding box, with random directions and log-uniformly distributed lengths from 10um to 10cm
+	std::mt19937_64 rand(1234);
+	CCuboid bbox = geom.mesh.GetBoundingBox();
+	std::uniform_real_distribution<double> unidist(0, 1);
+	std::normal_distribution<double> normdist(0, 1);
+	std::vector<std::array<double, 3> > p1(N), p2(N);
+	std::vector<double> t(N);
+	for (size_t i = 0; i < N; ++i){
+		double dir[3] = {normdist(rand), normdist(rand), normdist(rand)};
+		double l = std::pow(10., -5 + 4*unidist(rand))/std::sqrt(dir[0]*dir[0] + dir[1]*dir[1] + dir[2]*dir[2]);
+		for (int j = 0; j < 3; ++j){
+			p1[i][j] = bbox.min_coord(j) + unidist(rand)*(bbox.max_coord(j) - bbox.min_coord(j));
+			p2[i][j] = p1[i][j] + l*dir[j];
+		}
+		t[i] = unidist(rand)*simtime;
+	}
+
+	std::cout << boost::format("%-15s %10s %10s %10s %10s %10s %10s %10s\n") % "query [ns]" % "mean" % "p50" % "p90" % "p99" % "max" % "hits" % "total";
+	std::vector<double> times(N);
+	size_t hits = 0;
+	for (size_t i = 0; i < N; ++i){
+		auto qstart = std::chrono::steady_clock::now();
+		bool inbox = geom.CheckSegment(&p1[i][0], &p2[i][0]);
+		times[i] = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - qstart).count();
+		hits += inbox;
+	}
+	PrintTimes("CheckSegment", times, hits, hits);
+
+	hits = 0;
+	size_t total = 0;
+	std::vector<std::vector<std::pair<solid, bool> > > currentsolids(N);
+	for (size_t i = 0; i < N; ++i){
+		auto qstart = std::chrono::steady_clock::now();
+		currentsolids[i] = geom.GetSolids(t[i], &p1[i][0]);
+		times[i] = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - qstart).count();
+		hits += currentsolids[i].size() > 1;
+		total += currentsolids[i].size() - 1;
+	}
+	PrintTimes("GetSolids", times, hits, total);
+
+	hits = 0;
+	total = 0;
+	std::multimap<TCollision, bool> colls;
+	for (size_t i = 0; i < N; ++i){
+		double t2 = t[i] + 1e-3;
+		auto qstart = std::chrono::steady_clock::now();
+		bool collfound = geom.GetCollisions(t[i], &p1[i][0], t2, &p2[i][0], colls, &currentsolids[i]);
+		times[i] = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - qstart).count();
+		hits += collfound;
+		total += colls.size();
+	}
+	PrintTimes("GetCollisions", times, hits, total);
+
+	// random walk of consecutive 1mm segments, like a trajectory, restarted at a random point when it leaves the bounding box
+	std::vector<double> ts(N + 1, 0.);
+	p1[0] = {{bbox.xmin() + unidist(rand)*(bbox.xmax() - bbox.xmin()), bbox.ymin() + unidist(rand)*(bbox.ymax() - bbox.ymin()), bbox.zmin() + unidist(rand)*(bbox.zmax() - bbox.zmin())}};
+	double dir[3] = {normdist(rand), normdist(rand), normdist(rand)};
+	for (size_t i = 0; i < N; ++i){
+		if (unidist(rand) < 0.01) // change direction every 100 segments on average
+			dir[0] = normdist(rand), dir[1] = normdist(rand), dir[2] = normdist(rand);
+		double l = 1e-3/std::sqrt(dir[0]*dir[0] + dir[1]*dir[1] + dir[2]*dir[2]);
+		for (int j = 0; j < 3; ++j)
+			p2[i][j] = p1[i][j] + l*dir[j];
+		if (i + 1 < N)
+			p1[i + 1] = geom.CheckSegment(&p1[i][0], &p2[i][0]) ? p2[i] : p1[0];
+		ts[i + 1] = ts[i] + 1e-3;
+	}
+	for (int cached = 0; cached < 2; ++cached){
+		TMeshQueryCache cache;
+		std::vector<std::pair<solid, bool> > cursolids = geom.GetSolids(ts[0], &p1[0][0]);
+		hits = 0;
+		total = 0;
+		for (size_t i = 0; i < N; ++i){
+			auto qstart = std::chrono::steady_clock::now();
+			bool collfound = geom.GetCollisions(ts[i], &p1[i][0], ts[i + 1], &p2[i][0], colls, &cursolids, cached ? &cache : nullptr);
+			times[i] = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - qstart).count();
+			hits += collfound;
+			total += colls.size();
+			if (i + 1 < N && p1[i + 1] != p2[i])
+				cache = TMeshQueryCache();
+		}
+		PrintTimes(cached ? "walk, cached" : "walk", times, hits, total);
+	}
+}
+
+
+/**
+ * Main function
+ *
+ * @param argc Number of command line parameters
+ * @param argv Command line parameters: [number of queries [config file ...]]
+ *
+ * @return Returns 0 on success
+ */
+int main(int argc, char **argv){
+	size_t N = 100000;
+	if (argc > 1)
+		std::istringstream(argv[1]) >> N;
+	std::vector<boost::filesystem::path> configs;
+	for (int i = 2; i < argc; ++i)
+		configs.push_back(argv[i]);
+	if (configs.empty()){
+		configs.push_back(boost::filesystem::path(PENTRACK_SOURCE_DIR) / "in/GEANTbenchmark/config.in");
+		configs.push_back(boost::filesystem::path(PENTRACK_SOURCE_DIR) / "in/STARUCNbenchmark/config.in");
+	}
+
+	std::cout << "Timing " << N << " geometry queries per configuration\n";
+	for (auto &c: configs)
+		Benchmark(c, N);
+	return 0;
+}
@@ -0,0 +1,165 @@
+/**
+ * This file contains unit tests for geometry classes
+ */
+
+#include <random>
+#include <array>
+#include <fstream>
+#include <cstdint>
+
+#include <boost/test/unit_test.hpp>
+#include <boost/filesystem.hpp>
+
+#include "primitives.h"
+#include "trianglemesh.h"
+
+namespace{
+std::mt19937 geomrng(42);
+std::uniform_real_distribution<double> geomuni(-2., 2.);
+std::uniform_real_distribution<double> unit(0., 1.);
+
+
+/**
+ * Check intersections of random segments with an analytic solid for consistency with its point-inside test:
+ * the number of intersections has to be odd if exactly one segment end is inside,
+ * each intersection point has to lie on the boundary between inside and outside with the normal pointing outward,
+ * and random surface points have to fulfill the same criterion.
+ */
+void checkPrimitive(const TPrimitive &prim){
+    const double eps = 1e-7;
+    int nTests = 1000;
+    for (int n = 0; n < nTests; ++n){
+        CPoint p1(geomuni(geomrng), geomuni(geomrng), geomuni(geomrng)), p2(geomuni(geomrng), geomuni(geomrng), geomuni(geomrng));
+        CSegment segment(p1, p2);
+        std::vector<std::pair<CPoint, CVector> > hits;
+        prim.Intersections(segment, hits);
+        BOOST_TEST_CONTEXT("Segment " << p1 << " -> " << p2){
+            BOOST_CHECK_EQUAL(hits.size() % 2, prim.Inside(p1) != prim.Inside(p2) ? 1u : 0u);
+            for (auto &h: hits){
+                BOOST_CHECK_CLOSE(h.second.squared_length(), 1., 1e-10);
+                BOOST_CHECK(prim.Inside(h.first - eps*h.second));
+                BOOST_CHECK(!prim.Inside(h.first + eps*h.second));
+                CCuboid bbox = prim.BoundingBox();
+                for (int i = 0; i < 3; ++i){
+                    BOOST_CHECK_GE(h.first[i], bbox.min_coord(i) - 1e-12);
+                    BOOST_CHECK_LE(h.first[i], bbox.max_coord(i) + 1e-12);
+                }
+            }
+        }
+
+        CPoint p;
+        CVector normal;
+        prim.SurfacePoint(unit(geomrng), unit(geomrng), unit(geomrng), p, normal);
+        BOOST_TEST_CONTEXT("Surface point " << p << ", normal " << normal){
+            BOOST_CHECK_CLOSE(normal.squared_length(), 1., 1e-10);
+            BOOST_CHECK(prim.Inside(p - eps*normal));
+            BOOST_CHECK(!prim.Inside(p + eps*normal));
+        }
+    }
+}
+}
+
+
+// check all analytic solid types with random segments
+BOOST_AUTO_TEST_CASE(TPrimitiveTest){
+    checkPrimitive(*CreatePrimitive("sphere", {0.1, -0.2, 0.3, 1.}));
+    checkPrimitive(*CreatePrimitive("box", {-1., 0.5, -0.5, 1.5, 0., 1.}));
+    checkPrimitive(*CreatePrimitive("cylinder", {-1., -0.5, 0., 1., 0.5, 0.5, 0.7}));
+    checkPrimitive(*CreatePrimitive("tube", {0., 0., -1., 0.2, 0.1, 1., 0.5, 0.8}));
+    checkPrimitive(*CreatePrimitive("cone", {0.5, 0., -1., 0., 0., 1., 1., 0.}));
+    checkPrimitive(*CreatePrimitive("cone", {0., 0., -1., 0., 0., 1., 0.3, 1.2}));
+    BOOST_CHECK_THROW(CreatePrimitive("cylinder", {0., 0., 0., 0., 0., 1.}), std::runtime_error);
+    BOOST_CHECK_THROW(CreatePrimitive("tube", {0., 0., 0., 0., 0., 1., 1., 0.5}), std::runtime_error);
+}
+
+
+// check that collisions with a rotated and translated analytic solid in TTriangleMesh are consistent with InSolid
+BOOST_AUTO_TEST_CASE(TTriangleMeshPrimitiveTest){
+    TTriangleMesh mesh;
+    mesh.AddPrimitive(CreatePrimitive("box", {-0.5, 0.5, -0.2, 0.2, -1., 1.}), 2);
+    mesh.SetTransform(2, CTransform(0.8, -0.6, 0., 0.3, 0.6, 0.8, 0., -0.1, 0., 0., 1., 0.2)); // rotation around z by 36.87 degree and translation
+    int nTests = 1000;
+    for (int n = 0; n < nTests; ++n){
+        std::vector<double> p1 = {geomuni(geomrng), geomuni(geomrng), geomuni(geomrng)}, p2 = {geomuni(geomrng), geomuni(geomrng), geomuni(geomrng)};
+        std::vector<TCollision> colls = mesh.Collision(p1, p2);
+        BOOST_CHECK_EQUAL(colls.size() % 2, mesh.InSolid(p1[0], p1[1], p1[2]) != mesh.InSolid(p2[0], p2[1], p2[2]) ? 1u : 0u);
+        for (auto &c: colls){
+            double p[3] = {p1[0] + c.s*(p2[0] - p1[0]), p1[1] + c.s*(p2[1] - p1[1]), p1[2] + c.s*(p2[2] - p1[2])};
+            BOOST_CHECK(mesh.InSolid(p[0] - 1e-7*c.normal[0], p[1] - 1e-7*c.normal[1], p[2] - 1e-7*c.normal[2]));
+            BOOST_CHECK(!mesh.InSolid(p[0] + 1e-7*c.normal[0], p[1] + 1e-7*c.normal[1], p[2] + 1e-7*c.normal[2]));
+            BOOST_CHECK_EQUAL(c.ID, 2u);
+        }
+    }
+}
+
+
+// check that merging coplanar triangles of a finely tessellated STL file does not change collisions
+BOOST_AUTO_TEST_CASE(TTriangleMeshMergeTest){
+    // surface of 5x5x2 voxels of size 0.2 with a hole through the center and a missing corner, two triangles per voxel face
+    const int N[3] = {5, 5, 2};
+    auto occupied = [&N](const int i, const int j, const int k){
+        return i >= 0 && j >= 0 && k >= 0 && i < N[0] && j < N[1] && k < N[2] && !(i == 2 && j == 2) && !(i == 4 && j == 4);
+    };
+    std::vector<std::array<std::array<float, 3>, 3> > triangles;
+    for (int i = 0; i < N[0]; ++i){
+        for (int j = 0; j < N[1]; ++j){
+            for (int k = 0; k < N[2]; ++k){
+                if (!occupied(i, j, k))
+                    continue;
+                for (int axis = 0; axis < 3; ++axis){
+                    for (int side = 0; side < 2; ++side){
+                        int n[3] = {i, j, k};
+                        n[axis] += 2*side - 1;
+                        if (occupied(n[0], n[1], n[2]))
+                            continue;
+                        std::array<std::array<float, 3>, 4> corners;
+                        for (int c = 0; c < 4; ++c){
+                            int v[3] = {i, j, k};
+                            v[axis] += side;
+                            v[(axis + 1) % 3] += (c == 1 || c == 2);
+                            v[(axis + 2) % 3] += (c >= 2);
+                            for (int l = 0; l < 3; ++l)
+                                corners[c][l] = 0.2f*v[l];
+                        }
+                        if (side == 0)
+                            std::swap(corners[1], corners[3]); // normal has to point outward
+                        triangles.push_back({{corners[0], corners[1], corners[2]}});
+                        triangles.push_back({{corners[0], corners[2], corners[3]}});
+                    }
+                }
+            }
+        }
+    }
+    boost::filesystem::path stl = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("%%%%-%%%%.stl");
+    {
+        std::ofstream f(stl.native(), std::ios::binary);
+        char header[80] = "voxels";
+        f.write(header, 80);
+        uint32_t n = triangles.size();
+        f.write(reinterpret_cast<char*>(&n), 4);
+        for (auto &t: triangles){
+            float normal[3] = {0, 0, 0};
+            uint16_t attributes = 0;
+            f.write(reinterpret_cast<char*>(normal), 12);
+            for (auto &v: t)
+                f.write(reinterpret_cast<const char*>(v.data()), 12);
+            f.write(reinterpret_cast<char*>(&attributes), 2);
+        }
+    }
+    TTriangleMesh mesh, merged;
+    mesh.ReadFile(stl.native(), 2);
+    merged.ReadFile(stl.native(), 2, true);
+    boost::filesystem::remove(stl);
+
+    int nTests = 1000;
+    for (int n = 0; n < nTests; ++n){
+        std::vector<double> p1 = {geomuni(geomrng), geomuni(geomrng), geomuni(geomrng)}, p2 = {geomuni(geomrng), geomuni(geomrng), geomuni(geomrng)};
+        std::vector<TCollision> colls = mesh.Collision(p1, p2), mergedcolls = merged.Collision(p1, p2);
+        BOOST_CHECK_EQUAL(mesh.InSolid(p1[0], p1[1], p1[2]), merged.InSolid(p1[0], p1[1], p1[2]));
+        BOOST_REQUIRE_EQUAL(colls.size(), mergedcolls.size());
+        for (size_t i = 0; i < colls.size(); ++i){
+            BOOST_CHECK_SMALL(colls[i].s - mergedcolls[i].s, 1e-12);
+            BOOST_CHECK_SMALL(colls[i].distnormal - mergedcolls[i].distnormal, 1e-12);
+        }
+    }
+}
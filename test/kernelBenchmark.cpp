@@ -0,0 +1,283 @@
+/**
+ * \file
+ * Benchmark of physics kernels.
+ *
+ * Times the inner kernels of the trajectory integration for a reproducible set of inputs:
+ * each field type with and without derivatives, the superposition of several fields by TFieldManager,
+ * the MicroRoughness model (MR::MRDist, MR::MRProb, MR::MRDistMax), RotateVector,
+ * neutron wall interactions (TNeutron::OnHit, called through TParticle::DoHit), and TParticle::EquationOfMotion.
+ *
+ * Each kernel is called for the same number of inputs several times and the fastest pass is reported as ns per call,
+ * together with a checksum of the results, which changes if the results of a kernel change.
+ * The results are written to stdout as CSV (kernel,calls,ns_per_call,checksum) or as a JSON array.
+ *
+ * Usage: kernelBenchmark [number of calls [csv|json]]
+ */
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+#include <array>
+#include <sstream>
+#include <stdexcept>
+
+#include <boost/format.hpp>
+#include <boost/filesystem.hpp>
+
+#include "analyticFields.h"
+#include "conductor.h"
+#include "edmfields.h"
+#include "harmonicfields.h"
+#include "field_2d.h"
+#include "field_3d.h"
+#include "field_octree.h"
+#include "fields.h"
+#include "microroughness.h"
+#include "neutron.h"
+#include "geometry.h"
+#include "config.h"
+#include "globals.h"
+
+/// Timing result of one kernel
+struct TKernelResult{
+	std::string kernel; ///< name of kernel
+	size_t calls; ///< number of calls per pass
+	double ns; ///< duration per call of fastest pass [ns]
+	double checksum; ///< sum of results of all calls in one pass
+};
+
+/**
+ * Time a kernel
+ *
+ * @param name Name of kernel
+ * @param N Number of calls per pass
+ * @param kernel Function called with index of input, returning a number that is added to the checksum
+ * @param results Timing result is appended to this list
+ */
+template<class Kernel> void Time(const std::string &name, const size_t N, Kernel kernel, std::vector<TKernelResult> &results){
+	const int passes = 5;
+	double best = std::numeric_limits<double>::infinity(), checksum = 0;
+	for (size_t i = 0; i < std::min<size_t>(N, 1000); ++i) // warm up caches
+		kernel(i);
+	for (int pass = 0; pass < passes; ++pass){
+		double sum = 0;
+		auto start = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < N; ++i)
+			sum += kernel(i);
+		best = std::min(best, std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count()/N);
+		checksum = sum;
+	}
+	results.push_back({name, N, best, checksum});
+}
+
+/**
+ * Time magnetic field of a field with and without derivatives, and its electric field
+ *
+ * @param name Name of field type
+ * @param f Field
+ * @param p Positions and times
+ * @param results Timing results are appended to this list
+ * @param withE Also time electric field
+ */
+void TimeField(const std::string &name, const TField &f, const std::vector<std::array<double, 4> > &p, std::vector<TKernelResult> &results, const bool withE = false){
+	Time(name + "::BField", p.size(), [&](const size_t i){
+		double B[3] = {0, 0, 0};
+		f.BField(p[i][0], p[i][1], p[i][2], p[i][3], B, nullptr);
+		return B[0] + B[1] + B[2];
+	}, results);
+	Time(name + "::BField+dB", p.size(), [&](const size_t i){
+		double B[3] = {0, 0, 0}, dBidxj[3][3] = {{0, 0, 0}, {0, 0, 0}, {0, 0, 0}};
+		f.BField(p[i][0], p[i][1], p[i][2], p[i][3], B, dBidxj);
+		return B[0] + B[1] + B[2] + dBidxj[0][0] + dBidxj[1][2] + dBidxj[2][1];
+	}, results);
+	if (withE){
+		Time(name + "::EField", p.size(), [&](const size_t i){
+			double V = 0, Ei[3] = {0, 0, 0};
+			f.EField(p[i][0], p[i][1], p[i][2], p[i][3], V, Ei);
+			return V + Ei[0] + Ei[1] + Ei[2];
+		}, results);
+	}
+}
+
+
+/**
+ * Main function
+ *
+ * @param argc Number of command line parameters
+ * @param argv Command line parameters: [number of calls [csv|json]]
+ *
+ * @return Returns 0 on success
+ */
+int main(int argc, char **argv){
+	size_t N = 100000;
+	std::string format = "csv";
+	if (argc > 1)
+		std::istringstream(argv[1]) >> N;
+	if (argc > 2)
+		format = argv[2];
+	if (N == 0 || (format != "csv" && format != "json")){
+		std::cerr << "Usage: kernelBenchmark [number of calls [csv|json]]\n";
+		return 1;
+	}
+
+	std::ostream nullout(nullptr); // discards log messages of field constructors
+	std::cout.setstate(std::ios::failbit); // TGeometry, TFieldManager, and TNeutron write log messages to cout
+	std::vector<TKernelResult> results;
+
+	// reproducible positions inside [0.05, 0.45]^3, which lies inside all tables, and times between 0 and 1
+	std::mt19937_64 rand(1234);
+	std::uniform_real_distribution<double> unidist(0, 1);
+	std::vector<std::array<double, 4> > p(N);
+	for (auto &pt: p)
+		pt = {{0.05 + 0.4*unidist(rand), 0.05 + 0.4*unidist(rand), 0.05 + 0.4*unidist(rand), unidist(rand)}};
+
+	// analytic fields
+	TimeField("TExponentialFieldX", TExponentialFieldX(1e-3, 2., 0.1, 1e-4, 0.5), p, results);
+	TimeField("TLinearFieldZ", TLinearFieldZ(1e-3, 1e-4), p, results);
+	TimeField("TB0GradZ", TB0GradZ(1e-6, 1e-5, 0.2), p, results);
+	TimeField("TB0GradX2", TB0GradX2(1e-6, 1e-6, 1e-5, 0.2), p, results);
+	TimeField("TB0GradXY", TB0GradXY(1e-6, 1e-5, 0.2), p, results);
+	TimeField("TB0_XY", TB0_XY(1e-6, 0.2), p, results);
+	TimeField("TCustomBField", TCustomBField("1e-6*x*y", "1e-6*sin(3*z)*exp(-x^2)", "1e-6*(1 + x^2 - y^2)"), p, results);
+	TimeField("TEDMStaticB0GradZField", TEDMStaticB0GradZField(0.1, 0.2, 0.3, 0.5, 1., 1e-6, 1e-9), p, results);
+	TimeField("TEDMStaticEField", TEDMStaticEField(0., 1e3, 1e6), p, results, true);
+	std::vector<double> G(24);
+	for (size_t i = 0; i < G.size(); ++i)
+		G[i] = 1e-6/(i + 1);
+	TimeField("HarmonicExpandedBField", HarmonicExpandedBField(0.1, 0.2, 0.3, 1, 1, 1, 0.5, G), p, results);
+
+	// conductors
+	TConductorField conductor(0.8, 0., -1., 0.8, 0., 1., 1e3);
+	TimeField("TConductorField", conductor, p, results);
+	std::vector<std::array<double, 7> > wires;
+	for (int i = 0; i < 100; ++i){ // wires on a circle of radius 1 around the z axis
+		double phi = 2*pi*i/100;
+		wires.push_back({{10., std::cos(phi), std::sin(phi), -1., std::cos(phi + 0.01), std::sin(phi + 0.01), 1.}});
+	}
+	TimeField("TConductorSetField(100)", TConductorSetField(wires), p, results);
+
+	// tables
+	TabField tab((boost::filesystem::path(PENTRACK_SOURCE_DIR) / "test/VerticalLinearGradientField2D.tab").native(), 0.01, nullout);
+	TimeField("TabField", tab, p, results, true);
+	std::array<std::vector<double>, 3> xyz, Btab;
+	std::vector<double> Vtab;
+	for (int i = 0; i <= 25; ++i){
+		for (int j = 0; j <= 25; ++j){
+			for (int k = 0; k <= 25; ++k){
+				double x = 0.02*i, y = 0.02*j, z = 0.02*k, B[3];
+				conductor.BField(x, y, z, 0, B, nullptr);
+				xyz[0].push_back(x);
+				xyz[1].push_back(y);
+				xyz[2].push_back(z);
+				for (int c = 0; c < 3; ++c)
+					Btab[c].push_back(B[c]);
+				Vtab.push_back(1e3*x*y - 5e2*z*z);
+			}
+		}
+	}
+	TimeField("TabField3", TabField3(xyz, Btab, Vtab, false, nullout), p, results, true);
+	TimeField("TabField3(compact)", TabField3(xyz, Btab, Vtab, true, nullout), p, results, true);
+	TOctreeField octree({{0., 0., 0.}}, {{0.5, 0.5, 0.5}}, [&conductor](const double x, const double y, const double z, double F[4], double dFidxj[4][3]){
+		conductor.BField(x, y, z, 0, F, dFidxj);
+		F[3] = 0;
+		dFidxj[3][0] = dFidxj[3][1] = dFidxj[3][2] = 0;
+	}, true, false, 1e-9, 0, 6, nullout);
+	TimeField("TOctreeField", octree, p, results);
+
+	// superposition
+	TConfig fieldconfig({{"FIELDS", {{"1", "Conductor 1e3 0.8 0 -1 0.8 0 1 1"}, {"2", "Conductor -5e2 -0.2 0.7 -1 0.3 0.7 1 1"},
+									{"3", "EDMStaticB0GradZField 0 0 0 0 0 1e-6 1e-9 0 1 -1 1 -1 1 -1 1"},
+									{"4", "EDMStaticEField 0 1e3 1e6 t"}, {"5", "B0GradZ 1e-6 1e-5 0.2 1 -1 1 -1 1 -1 1"}}}});
+	TFieldManager field(fieldconfig);
+	Time("TFieldManager::BField", N, [&](const size_t i){
+		double B[3];
+		field.BField(p[i][0], p[i][1], p[i][2], p[i][3], B, nullptr);
+		return B[0] + B[1] + B[2];
+	}, results);
+	Time("TFieldManager::BField+dB", N, [&](const size_t i){
+		double B[3], dBidxj[3][3];
+		field.BField(p[i][0], p[i][1], p[i][2], p[i][3], B, dBidxj);
+		return B[0] + B[1] + B[2] + dBidxj[0][0] + dBidxj[1][2] + dBidxj[2][1];
+	}, results);
+	Time("TFieldManager::EField", N, [&](const size_t i){
+		double V, Ei[3];
+		field.EField(p[i][0], p[i][1], p[i][2], p[i][3], V, Ei);
+		return V + Ei[0] + Ei[1] + Ei[2];
+	}, results);
+
+	// wall interactions: neutrons with 3 to 6 m/s hitting a rough wall with normal (0, 0, 1) from above
+	TConfig geometryconfig({{"GLOBAL", {}}, {"MATERIALS", {{"default", "0 0 0 0 0 0 0 0 0"}}}, {"GEOMETRY", {{"1", "ignored default"}}}});
+	TGeometry geom(geometryconfig);
+	solid vacuum = geom.defaultsolid, rough = vacuum, smooth = vacuum;
+	std::istringstream("200 0.1 0 0 1e-9 20e-9 0 0 0") >> rough.mat;
+	std::istringstream("200 0.1 0.05 0 0 0 0 0 0") >> smooth.mat;
+	rough.ID = 2;
+	smooth.ID = 3;
+	const double normal[3] = {0, 0, 1};
+	std::vector<std::array<double, 5> > v(N); // velocity and scattering angles theta, phi
+	for (auto &vi: v){
+		double speed = 3 + 3*unidist(rand), theta = std::acos(-unidist(rand)), phi = 2*pi*unidist(rand);
+		double theta_s = 0.5*pi*unidist(rand), phi_s = 2*pi*unidist(rand);
+		vi = {{speed*std::sin(theta)*std::cos(phi), speed*std::sin(theta)*std::sin(phi), speed*std::cos(theta), theta_s, phi_s}};
+	}
+	Time("MR::MRDist", N, [&](const size_t i){
+		return MR::MRDist(false, false, &v[i][0], normal, vacuum, rough, v[i][3], v[i][4]);
+	}, results);
+	Time("MR::MRDist(integral)", N, [&](const size_t i){
+		return MR::MRDist(false, true, &v[i][0], normal, vacuum, rough, v[i][3], v[i][4]);
+	}, results);
+	Time("MR::MRProb", N, [&](const size_t i){
+		return MR::MRProb(false, &v[i][0], normal, vacuum, rough);
+	}, results);
+	Time("MR::MRDistMax", N, [&](const size_t i){
+		return MR::MRDistMax(false, &v[i][0], normal, vacuum, rough);
+	}, results);
+
+	Time("RotateVector", N, [&](const size_t i){
+		double w[3] = {p[i][0], p[i][1], p[i][2]};
+		RotateVector(w, &v[i][0]);
+		return w[0] + w[1] + w[2];
+	}, results);
+
+	TMCGenerator mc(1234);
+	TNeutron n(1, 0., 0.1, 0.1, 0.1, 100e-9, 0., 0., 1., mc, geom, field);
+	state_type y1(STATE_VARIABLES, 0.), y2;
+	y1[7] = 1;
+	for (auto &wall: {std::make_pair("TNeutron::OnHit(smooth)", &smooth), std::make_pair("TNeutron::OnHit(MR)", &rough)}){
+		mc.seed(1234);
+		Time(wall.first, std::min<size_t>(N, 10000), [&](const size_t i){ // MicroRoughness reflections sample the distribution by rejection and are slow, so limit the number of calls
+			std::copy(v[i].begin(), v[i].begin() + 3, y1.begin() + 3);
+			y2 = y1;
+			double x2 = 0;
+			n.DoHit(0., y1, x2, y2, normal, vacuum, *wall.second, mc);
+			return y2[3] + y2[4] + y2[5];
+		}, results);
+	}
+
+	state_type dydx(STATE_VARIABLES);
+	Time("TParticle::EquationOfMotion", N, [&](const size_t i){
+		std::copy(v[i].begin(), v[i].begin() + 3, y1.begin() + 3);
+		double B[3] = {p[i][0], p[i][1], 1. + p[i][2]}, dBidxj[3][3] = {{p[i][1], 0, 0}, {0, p[i][2], 0}, {0, 0, p[i][0]}}, E[3] = {0, 0, 1e6};
+		n.EquationOfMotion(y1, dydx, p[i][3], B, dBidxj, E);
+		return dydx[3] + dydx[4] + dydx[5];
+	}, results);
+
+	std::cout.clear();
+	if (format == "csv"){
+		std::cout << "kernel,calls,ns_per_call,checksum\n";
+		for (auto &r: results)
+			std::cout << boost::format("%1%,%2%,%3$.2f,%4$.17g\n") % r.kernel % r.calls % r.ns % r.checksum;
+	}
+	else{
+		std::cout << "[\n";
+		for (size_t i = 0; i < results.size(); ++i)
+			std::cout << boost::format("  {\"kernel\": \"%1%\", \"calls\": %2%, \"ns_per_call\": %3$.2f, \"checksum\": %4$.17g}%5%\n")
+						% results[i].kernel % results[i].calls % results[i].ns % results[i].checksum % (i + 1 < results.size() ? "," : "");
+		std::cout << "]\n";
+	}
+	return 0;
+}